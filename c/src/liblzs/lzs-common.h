@@ -31,6 +31,15 @@
 #ifndef __LZS_COMMON_H
 #define __LZS_COMMON_H
 
+/*****************************************************************************
+ * Includes
+ ****************************************************************************/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+
 /*****************************************************************************
  * Implementation Defines
  ****************************************************************************/
@@ -38,7 +47,14 @@
 #define SHORT_OFFSET_BITS           7u
 #define LONG_OFFSET_BITS            11u
 #define EXTENDED_LENGTH_BITS        4u
-#define BIT_QUEUE_BITS              32u
+#define LITERAL_BITS                9u
+#define BIT_QUEUE_BITS              64u
+// The decompressors' 64-bit bit queue is refilled once it holds fewer than this many bits.
+// Any token field fits in the bits that remain.
+#define BIT_READER_REFILL_BITS      32u
+// The compressors' 64-bit bit queue is written out once it holds this many bits.
+// Tokens are at most 24 bits, so the queue never holds more than 56 bits.
+#define BIT_WRITER_FLUSH_BITS       32u
 
 #define SHORT_OFFSET_MAX            ((1u << SHORT_OFFSET_BITS) - 1u)
 #define LONG_OFFSET_MAX             ((1u << LONG_OFFSET_BITS) - 1u)
@@ -54,11 +70,85 @@
 
 #define LZSMIN(X,Y)                 (((X) < (Y)) ? (X) : (Y))
 
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define LZS_MATCH_HAVE_X86          1
+#else
+#define LZS_MATCH_HAVE_X86          0
+#endif
+
+
+/*****************************************************************************
+ * Typedefs
+ ****************************************************************************/
+
+typedef size_t (*LzsMatchLenFunc_t)(const uint8_t * aPtr, const uint8_t * bPtr, size_t matchMax);
+typedef size_t (*LzsPairScanFunc_t)(const uint8_t * pData, size_t count, uint8_t first, uint8_t second);
+
+typedef struct
+{
+    uint8_t           * outPtr;
+    size_t              outCount;           // Count of output bytes that have been generated
+    size_t              outBufferSize;
+    uint64_t            bitFieldQueue;      // Code assumes bits will disappear past MS-bit 63 when shifted left.
+    uint_fast8_t        bitFieldQueueLen;
+} LzsBitWriter_t;
+
+
+/*****************************************************************************
+ * Variables
+ ****************************************************************************/
+
+// Match-length kernel selected for this CPU. See lzs-match.c.
+extern LzsMatchLenFunc_t    lzs_match_len_func;
+// Byte-pair scan kernel, selected along with the match-length kernel. See lzs-match.c.
+extern LzsPairScanFunc_t    lzs_pair_scan_func;
+
 
 /*****************************************************************************
  * Inline Functions
  ****************************************************************************/
 
+/**
+ * \brief Count the length of the match betwen two data blocks, up to a maximum match length
+ *
+ * This doesn't do any circular buffer wrapping. No more than `matchMax` bytes
+ * are read from either data block.
+ *
+ * \param aPtr: Pointer to 1st data block.
+ * \param bPtr: Pointer to 2nd data block.
+ * \param matchMax: Maximum match length to count.
+ *
+ * \return size_t: Length of consecutive matching bytes between the two data blocks.
+ */
+static inline size_t lzs_match_len(const uint8_t * aPtr, const uint8_t * bPtr, size_t matchMax)
+{
+    // Most candidates fail on the first byte, so check that before calling the kernel.
+    if (matchMax == 0 || *aPtr != *bPtr)
+    {
+        return 0;
+    }
+    return lzs_match_len_func(aPtr, bPtr, matchMax);
+}
+
+/**
+ * \brief Find the last position in a data block where a given pair of bytes starts
+ *
+ * This finds the largest `i < count` such that `pData[i] == first` and
+ * `pData[i + 1] == second`. So `count + 1` bytes are read from the data block.
+ * This doesn't do any circular buffer wrapping.
+ *
+ * \param pData: Pointer to data block.
+ * \param count: Number of positions to scan.
+ * \param first: Value of the first byte of the pair.
+ * \param second: Value of the second byte of the pair.
+ *
+ * \return size_t: Position of the last match of the pair, or `count` if there is none.
+ */
+static inline size_t lzs_pair_scan(const uint8_t * pData, size_t count, uint8_t first, uint8_t second)
+{
+    return lzs_pair_scan_func(pData, count, first, second);
+}
+
 /**
  * \brief Increment index into a circular buffer, with wrapping on the buffer size
  *
@@ -146,5 +236,185 @@ static inline uint_fast16_t lzs_idx_delta2_wrap(uint_fast16_t idx1, uint_fast16_
     return idx1 - idx2;
 }
 
+/**
+ * \brief Store a 64-bit value in big-endian byte order, at a possibly unaligned address
+ *
+ * \param p: Where to store the value. 8 bytes are written.
+ * \param value: Value to store.
+ */
+static inline void lzs_store_be64(uint8_t * p, uint64_t value)
+{
+#if defined(__GNUC__) && defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+    value = __builtin_bswap64(value);
+    memcpy(p, &value, sizeof(value));
+#elif defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+    memcpy(p, &value, sizeof(value));
+#else
+    uint_fast8_t    i;
+
+    for (i = 0; i < sizeof(value); i++)
+    {
+        p[i] = (uint8_t)(value >> (56u - 8u * i));
+    }
+#endif
+}
+
+/**
+ * \brief Load a 64-bit value in big-endian byte order, from a possibly unaligned address
+ *
+ * \param p: Where to load the value from. 8 bytes are read.
+ *
+ * \return uint64_t: The value.
+ */
+static inline uint64_t lzs_load_be64(const uint8_t * p)
+{
+    uint64_t        value;
+
+#if defined(__GNUC__) && defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+    memcpy(&value, p, sizeof(value));
+    value = __builtin_bswap64(value);
+#elif defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+    memcpy(&value, p, sizeof(value));
+#else
+    uint_fast8_t    i;
+
+    value = 0;
+    for (i = 0; i < sizeof(value); i++)
+    {
+        value = (value << 8u) | p[i];
+    }
+#endif
+    return value;
+}
+
+/**
+ * \brief Read input bytes into a bit queue, as many as will fit
+ *
+ * The bits of the queue are in its most significant bitFieldQueueLen bits.
+ *
+ * If there are at least 8 bytes of input, they are read with one 8-byte load.
+ * That may also set some bits below the queue's bitFieldQueueLen bits, from
+ * the first byte that didn't fit. Those are the same bits that the next read
+ * will put there, so they are harmless. Otherwise the input is read one byte
+ * at a time, as far as it goes.
+ *
+ * \param inPtr: Where to read the bytes.
+ * \param inLength: Length of the input.
+ * \param pBitFieldQueue: Bit queue to add the bytes to.
+ * \param bitFieldQueueLen: Number of bits in the queue, at most 64.
+ *
+ * \return size_t: Number of bytes read. The caller adds 8 bits to the queue length for each.
+ */
+static inline size_t lzs_bits_read(const uint8_t * inPtr, size_t inLength, uint64_t * pBitFieldQueue, uint_fast8_t bitFieldQueueLen)
+{
+    size_t          count;
+    size_t          i;
+
+    count = (64u - bitFieldQueueLen) / 8u;
+    if (inLength >= sizeof(uint64_t) && count)
+    {
+        *pBitFieldQueue |= lzs_load_be64(inPtr) >> bitFieldQueueLen;
+        return count;
+    }
+    count = LZSMIN(count, inLength);
+    for (i = 0; i < count; i++)
+    {
+        *pBitFieldQueue |= (uint64_t)inPtr[i] << (56u - bitFieldQueueLen - 8u * i);
+    }
+    return count;
+}
+
+/**
+ * \brief Write the complete bytes in a bit queue to an output buffer
+ *
+ * If there are at least 8 bytes of space in the output buffer, all the bytes
+ * are written with one 8-byte store, which may also write up to 7 bytes of
+ * junk after them. Otherwise they are written one at a time, as far as the
+ * space allows.
+ *
+ * \param outPtr: Where to write the bytes.
+ * \param outLength: Space in the output buffer.
+ * \param bitFieldQueue: Bit queue, with the bits to write in its least significant bitFieldQueueLen bits.
+ * \param bitFieldQueueLen: Number of bits in the queue, at most 64.
+ *
+ * \return size_t: Number of bytes written. The caller removes 8 bits from the queue for each.
+ */
+static inline size_t lzs_bits_write(uint8_t * outPtr, size_t outLength, uint64_t bitFieldQueue, uint_fast8_t bitFieldQueueLen)
+{
+    size_t          count;
+    size_t          i;
+
+    count = bitFieldQueueLen / 8u;
+    if (outLength >= sizeof(uint64_t) && count)
+    {
+        lzs_store_be64(outPtr, bitFieldQueue << (64u - bitFieldQueueLen));
+        return count;
+    }
+    count = LZSMIN(count, outLength);
+    for (i = 0; i < count; i++)
+    {
+        outPtr[i] = (uint8_t)(bitFieldQueue >> (bitFieldQueueLen - 8u * (i + 1u)));
+    }
+    return count;
+}
+
+/**
+ * \brief Initialise a bit writer for an output buffer
+ *
+ * \param pWriter: Output state.
+ * \param outPtr: Output buffer.
+ * \param outBufferSize: Size of the output buffer.
+ */
+static inline void lzs_bits_init(LzsBitWriter_t * pWriter, uint8_t * outPtr, size_t outBufferSize)
+{
+    pWriter->outPtr = outPtr;
+    pWriter->outCount = 0;
+    pWriter->outBufferSize = outBufferSize;
+    pWriter->bitFieldQueue = 0;
+    pWriter->bitFieldQueueLen = 0;
+}
+
+/**
+ * \brief Write all complete bytes in the bit queue to the output buffer
+ *
+ * \param pWriter: Output state.
+ *
+ * \return bool: false if the output buffer is full.
+ */
+static inline bool lzs_bits_flush(LzsBitWriter_t * pWriter)
+{
+    size_t          count;
+
+    count = lzs_bits_write(pWriter->outPtr, pWriter->outBufferSize - pWriter->outCount,
+                           pWriter->bitFieldQueue, pWriter->bitFieldQueueLen);
+    pWriter->outPtr += count;
+    pWriter->outCount += count;
+    pWriter->bitFieldQueueLen -= 8u * count;
+    return pWriter->bitFieldQueueLen < 8u;
+}
+
+/**
+ * \brief Add bits to the output bit queue, and write it out once it is half full
+ *
+ * Up to 7 bytes may stay in the queue, so lzs_bits_flush() must be called
+ * after the last bits are added.
+ *
+ * \param pWriter: Output state.
+ * \param value: Bits to add, in the least significant bits.
+ * \param width: Number of bits to add, at most 24.
+ *
+ * \return bool: false if the output buffer is full.
+ */
+static inline bool lzs_bits_put(LzsBitWriter_t * pWriter, uint32_t value, uint_fast8_t width)
+{
+    pWriter->bitFieldQueue = (pWriter->bitFieldQueue << width) | value;
+    pWriter->bitFieldQueueLen += width;
+    if (pWriter->bitFieldQueueLen >= BIT_WRITER_FLUSH_BITS)
+    {
+        return lzs_bits_flush(pWriter);
+    }
+    return true;
+}
+
 
 #endif // !defined(__LZS_COMMON_H)
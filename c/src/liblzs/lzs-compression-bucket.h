@@ -0,0 +1,534 @@
+/*****************************************************************************
+ *
+ * \file
+ *
+ * \brief Incremental LZS compression with a ring history buffer and a table of hash buckets
+ *
+ * This is the engine of the "compact" and "lite" incremental compressors,
+ * which differ only in the size of their hash table. Each of them defines
+ * these before including this file:
+ *
+ *     * LZS_BUCKET_PARAMS_T: Type of the incremental compression state. It has
+ *       the same members as LzsCompactCompressParameters_t, with hashTable[]
+ *       of (1 << LZS_BUCKET_HASH_BITS) * LZS_BUCKET_HASH_WAYS entries.
+ *     * LZS_BUCKET_HASH_BITS: Number of buckets, as log2.
+ *     * LZS_BUCKET_HASH_WAYS: Number of positions in each bucket, latest first.
+ *       With 1, a bucket is simply the latest position with its hash.
+ *     * LZS_BUCKET_HASH_LENGTH: Number of input bytes hashed to select a bucket.
+ *
+ * The functions are static, so each including file gets its own copy, with
+ * the candidate lookup specialised for its table.
+ *
+ * This code is licensed according to the MIT license as follows:
+ * ----------------------------------------------------------------------------
+ * Copyright (c) 2017 Craig McQueen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ----------------------------------------------------------------------------
+ ****************************************************************************/
+
+#ifndef __LZS_COMPRESSION_BUCKET_H
+#define __LZS_COMPRESSION_BUCKET_H
+
+/*****************************************************************************
+ * Includes
+ ****************************************************************************/
+
+#include "lzs.h"
+#include "lzs-common.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+
+/*****************************************************************************
+ * Defines
+ ****************************************************************************/
+
+#if !defined(LZS_BUCKET_PARAMS_T) || !defined(LZS_BUCKET_HASH_BITS) || !defined(LZS_BUCKET_HASH_WAYS) || \
+    !defined(LZS_BUCKET_HASH_LENGTH)
+#error Define the LZS_BUCKET_ parameters before including lzs-compression-bucket.h
+#endif
+
+// Matches are searched for up to the full look-ahead length.
+#define LZS_BUCKET_MATCH_MAX        LZS_MAX_LOOK_AHEAD_LEN
+
+// Multiplier for multiplicative hashing, 2^32 divided by the golden ratio
+#define LZS_HASH_MULTIPLIER         2654435761u
+
+// An empty bucket entry
+#define LZS_BUCKET_ENTRY_INVALID    UINT16_MAX
+
+#ifndef LZS_DEBUG
+//#define LZS_DEBUG(X)                printf X
+#define LZS_DEBUG(X)
+#endif
+
+#ifndef LZS_ASSERT
+#define LZS_ASSERT(X)
+#endif
+
+#if LZS_MAX_LOOK_AHEAD_LEN < MAX_SHORT_LENGTH || LZS_MAX_LOOK_AHEAD_LEN < MAX_EXTENDED_LENGTH
+#error LZS_MAX_LOOK_AHEAD_LEN is too small
+#endif
+
+#if LZS_COMPRESS_HISTORY_SIZE >= LZS_BUCKET_ENTRY_INVALID
+#error LZS_COMPRESS_HISTORY_SIZE is too large for bucket entries
+#endif
+
+
+/*****************************************************************************
+ * Typedefs
+ ****************************************************************************/
+
+typedef enum
+{
+    COMPRESS_NORMAL,
+    COMPRESS_EXTENDED
+} BucketCompressState_t;
+
+
+/*****************************************************************************
+ * Tables
+ ****************************************************************************/
+
+/* Length is encoded as:
+ *  0b00 --> 2
+ *  0b01 --> 3
+ *  0b10 --> 4
+ *  0b1100 --> 5
+ *  0b1101 --> 6
+ *  0b1110 --> 7
+ *  0b1111 xxxx --> 8 (extended)
+ */
+static const uint8_t length_value[MAX_SHORT_LENGTH + 1u] =
+{
+    0,
+    0,
+    0x0,
+    0x1,
+    0x2,
+    0xC,
+    0xD,
+    0xE,
+    0xF
+};
+
+static const uint8_t length_width[MAX_SHORT_LENGTH + 1u] =
+{
+    0,
+    0,
+    2,
+    2,
+    2,
+    4,
+    4,
+    4,
+    4,
+};
+
+
+/*****************************************************************************
+ * Inline Functions
+ ****************************************************************************/
+
+/**
+ * \brief Count the length of the match betwen the next input bytes and a point in the history.
+ *
+ * Length is counted up to a maximum match length.
+ *
+ * This does wrapping of the indices into the history buffer. If neither the
+ * look-ahead nor the history data wraps, the match-length kernel is used.
+ *
+ * \param pParams: Pointer to struct to store incremental compression state.
+ * \param offset: Reverse offset into the history buffer.
+ * \param matchMax: Maximum match length to count.
+ *
+ * \return uint_fast8_t: Length of consecutive matching bytes between the input and history.
+ */
+static inline uint_fast8_t lzs_bucket_match_len(const LZS_BUCKET_PARAMS_T * pParams, uint_fast16_t offset, uint_fast8_t matchMax)
+{
+    uint_fast16_t   historyReadIdx;
+    uint_fast16_t   historyLookAheadIdx;
+    uint_fast8_t    len;
+
+
+    historyReadIdx = lzs_idx_dec_wrap(pParams->historyLatestIdx, offset,
+                                        sizeof(pParams->historyBuffer));
+    historyLookAheadIdx = pParams->historyLatestIdx;
+
+    if (historyReadIdx + matchMax <= sizeof(pParams->historyBuffer) &&
+        historyLookAheadIdx + matchMax <= sizeof(pParams->historyBuffer))
+    {
+        return lzs_match_len(&pParams->historyBuffer[historyLookAheadIdx],
+                             &pParams->historyBuffer[historyReadIdx], matchMax);
+    }
+
+    for (len = 0; len < matchMax; ++len )
+    {
+        if (pParams->historyBuffer[historyLookAheadIdx] != pParams->historyBuffer[historyReadIdx])
+        {
+            return len;
+        }
+        historyLookAheadIdx = lzs_idx_inc_wrap(historyLookAheadIdx, 1u,
+                                                sizeof(pParams->historyBuffer));
+        historyReadIdx = lzs_idx_inc_wrap(historyReadIdx, 1u,
+                                                sizeof(pParams->historyBuffer));
+    }
+    return len;
+}
+
+/**
+ * \brief Get the hash bucket of the bytes at a position in the history buffer
+ *
+ * \param pParams: Pointer to struct to store incremental compression state.
+ * \param historyIdx: Index into the history buffer. LZS_BUCKET_HASH_LENGTH bytes must be valid there.
+ *
+ * \return uint16_t *: First entry of the bucket, in pParams->hashTable[].
+ */
+static inline uint16_t * lzs_bucket(LZS_BUCKET_PARAMS_T * pParams, uint_fast16_t historyIdx)
+{
+    uint32_t        value = 0;
+    uint_fast8_t    i;
+
+    for (i = 0; i < LZS_BUCKET_HASH_LENGTH; i++)
+    {
+        value = (value << 8u) | pParams->historyBuffer[historyIdx];
+        historyIdx = lzs_idx_inc_wrap(historyIdx, 1u, sizeof(pParams->historyBuffer));
+    }
+    value = (uint32_t)(value * LZS_HASH_MULTIPLIER) >> (32u - LZS_BUCKET_HASH_BITS);
+    return &pParams->hashTable[value * LZS_BUCKET_HASH_WAYS];
+}
+
+/**
+ * \brief Insert a position into its hash bucket, as the latest entry
+ *
+ * The oldest entry of the bucket is dropped.
+ *
+ * \param pBucket: First entry of the bucket.
+ * \param historyIdx: Index into the history buffer of the position.
+ */
+static inline void lzs_bucket_insert(uint16_t * pBucket, uint_fast16_t historyIdx)
+{
+#if LZS_BUCKET_HASH_WAYS > 1u
+    memmove(pBucket + 1u, pBucket, sizeof(uint16_t) * (LZS_BUCKET_HASH_WAYS - 1u));
+#endif
+    pBucket[0] = historyIdx;
+}
+
+/**
+ * \brief Find the longest match with the next input bytes, among the positions in their bucket
+ *
+ * \param pParams: Pointer to struct to store incremental compression state.
+ * \param pBucket: First entry of the bucket of the next input bytes.
+ * \param matchMax: Maximum match length to count.
+ * \param pOffset: Set to the offset of the best match, if one is found.
+ *
+ * \return uint_fast8_t: Length of the best match, or 0 if none.
+ */
+static inline uint_fast8_t lzs_bucket_search(const LZS_BUCKET_PARAMS_T * pParams, const uint16_t * pBucket, uint_fast8_t matchMax,
+                                             uint_fast16_t * pOffset)
+{
+    uint_fast16_t   offset;
+    uint_fast8_t    length;
+    uint_fast8_t    best_length = 0;
+    uint_fast8_t    way;
+
+
+    for (way = 0; way < LZS_BUCKET_HASH_WAYS; way++)
+    {
+        if (pBucket[way] == LZS_BUCKET_ENTRY_INVALID)
+        {
+            break;
+        }
+        offset = lzs_idx_delta2_wrap(pParams->historyLatestIdx, pBucket[way], sizeof(pParams->historyBuffer));
+        if (offset > pParams->historyLen)
+        {
+            continue;
+        }
+        length = lzs_bucket_match_len(pParams, offset, matchMax);
+        if (length > best_length)
+        {
+            *pOffset = offset;
+            best_length = length;
+            if (length >= matchMax)
+            {
+                break;
+            }
+        }
+    }
+    return best_length;
+}
+
+
+/*****************************************************************************
+ * Functions
+ ****************************************************************************/
+
+/**
+ * \brief Initialise incremental compression with a table of hash buckets
+ *
+ * \param pParams: Pointer to struct to store incremental compression state.
+ */
+static void lzs_bucket_compress_init(LZS_BUCKET_PARAMS_T * pParams)
+{
+    pParams->status = LZS_C_STATUS_NONE;
+
+    memset(pParams->hashTable, 0xFF, sizeof(pParams->hashTable));
+    pParams->lookAheadLen = 0;
+    pParams->bitFieldQueue = 0;
+    pParams->bitFieldQueueLen = 0;
+    pParams->state = COMPRESS_NORMAL;
+    pParams->historyLatestIdx = 0;
+    pParams->historyLookAheadIdx = 0;
+    pParams->historyLen = 0;
+    pParams->offset = 0;
+}
+
+/**
+ * \brief Incremental compression with a table of hash buckets
+ *
+ * Parameters and the use of the state variables are as for
+ * `lzs_simple_compress_incremental()`.
+ *
+ * \param pParams: Pointer to struct to store incremental compression state.
+ * \param add_end_marker: true to append an end-marker to output after all input & output data is processed.
+ *
+ * \return size_t: Number of bytes of compressed data written to the destination buffer.
+ */
+static size_t lzs_bucket_compress_incremental(LZS_BUCKET_PARAMS_T * pParams, bool add_end_marker)
+{
+    size_t              outCount;           // Count of output bytes that have been generated
+    uint16_t          * pBucket;
+    uint_fast16_t       historyIdx;
+    uint_fast8_t        matchMax;
+    uint_fast8_t        length;
+    uint_fast16_t       best_offset = 0;
+    uint_fast8_t        best_length;
+    uint_fast8_t        temp8;
+    size_t              bytes;
+
+
+    pParams->status = LZS_C_STATUS_NONE;
+    outCount = 0;
+
+    for (;;)
+    {
+        length = 0;
+        // Write data from the bit field queue to output, once it is half full,
+        // and at the end of the input or before returning
+        if (pParams->bitFieldQueueLen >= BIT_WRITER_FLUSH_BITS || pParams->status != LZS_C_STATUS_NONE ||
+            pParams->inLength == 0)
+        {
+            bytes = lzs_bits_write(pParams->outPtr, pParams->outLength, pParams->bitFieldQueue, pParams->bitFieldQueueLen);
+            pParams->outPtr += bytes;
+            pParams->outLength -= bytes;
+            pParams->bitFieldQueueLen -= 8u * bytes;
+            outCount += bytes;
+            if (pParams->bitFieldQueueLen >= 8u)
+            {
+                // We're out of space in the output buffer.
+                // Set status, but maintain the current state.
+                pParams->status |= LZS_C_STATUS_NO_OUTPUT_BUFFER_SPACE;
+            }
+        }
+        if (pParams->bitFieldQueueLen > BIT_WRITER_FLUSH_BITS + 24u)
+        {
+            // It is an error if we ever get here.
+            LZS_ASSERT(0);
+            pParams->status |= LZS_C_STATUS_ERROR | LZS_C_STATUS_NO_OUTPUT_BUFFER_SPACE;
+        }
+
+        // Check if we need to finish for whatever reason
+        if (pParams->status != LZS_C_STATUS_NONE)
+        {
+            // Break out of the top-level loop
+            break;
+        }
+        // Check if we've reached the end of our input data
+        if (pParams->inLength == 0)
+        {
+            pParams->status |= LZS_C_STATUS_INPUT_FINISHED | LZS_C_STATUS_INPUT_STARVED;
+            if (add_end_marker == false)
+            {
+                break;
+            }
+        }
+
+        // Try to fill look-ahead buffer in history buffer
+        temp8 = LZSMIN(LZS_MAX_LOOK_AHEAD_LEN - pParams->lookAheadLen, pParams->inLength);
+        // temp8 holds number of bytes that can be copied from input to look-ahead area of historyBuffer[].
+        // Copy that number of bytes from input into look-ahead area of historyBuffer[].
+        pParams->lookAheadLen += temp8;
+        pParams->inLength -= temp8;
+        while (temp8--)
+        {
+            pParams->historyBuffer[pParams->historyLookAheadIdx] = *pParams->inPtr++;
+            pParams->historyLookAheadIdx = lzs_idx_inc_wrap(pParams->historyLookAheadIdx, 1u,
+                                                            sizeof(pParams->historyBuffer));
+        }
+
+        // Process input data in a state machine
+        switch (pParams->state)
+        {
+            case COMPRESS_NORMAL:
+                matchMax = add_end_marker ? 1u : LZS_BUCKET_MATCH_MAX;
+                if (pParams->lookAheadLen < matchMax)
+                {
+                    // We don't have enough input data, so we're done for now.
+                    pParams->status |= LZS_C_STATUS_INPUT_STARVED;
+                    break;
+                }
+
+                // Look for a match in history, at the positions in the bucket.
+                best_length = 0;
+                matchMax = LZSMIN(pParams->lookAheadLen, LZS_BUCKET_MATCH_MAX);
+                if (matchMax >= LZS_BUCKET_HASH_LENGTH)
+                {
+                    pBucket = lzs_bucket(pParams, pParams->historyLatestIdx);
+                    best_length = lzs_bucket_search(pParams, pBucket, matchMax, &best_offset);
+                    lzs_bucket_insert(pBucket, pParams->historyLatestIdx);
+                }
+                /* Output */
+                if (best_length < MIN_LENGTH)
+                {
+                    /* Byte-literal */
+                    /* Leading 0 bit indicates offset/length token.
+                     * Following 8 bits are byte-literal. */
+                    pParams->bitFieldQueue <<= 9u;
+                    temp8 = pParams->historyBuffer[pParams->historyLatestIdx];
+                    pParams->bitFieldQueue |= temp8;
+                    pParams->bitFieldQueueLen += 9u;
+                    length = 1u;
+                    LZS_DEBUG(("Literal %c (%02X)\n", isprint(temp8) ? temp8 : '?', temp8));
+                }
+                else
+                {
+                    LZS_DEBUG(("Best offset %"PRIuFAST16" length %"PRIuFAST8"\n", best_offset, best_length));
+                    /* Offset/length token */
+                    /* 1 bit indicates offset/length token */
+                    pParams->bitFieldQueue <<= 1u;
+                    pParams->bitFieldQueueLen++;
+                    pParams->bitFieldQueue |= 1u;
+                    /* Encode offset */
+                    if (best_offset <= SHORT_OFFSET_MAX)
+                    {
+                        /* Short offset */
+                        LZS_DEBUG(("Short offset %"PRIuFAST16"\n", best_offset));
+                        pParams->bitFieldQueue <<= (1u + SHORT_OFFSET_BITS);
+                        /* Initial 1 bit indicates short offset */
+                        pParams->bitFieldQueue |= (1u << SHORT_OFFSET_BITS) | best_offset;
+                        pParams->bitFieldQueueLen += (1u + SHORT_OFFSET_BITS);
+                    }
+                    else
+                    {
+                        /* Long offset */
+                        LZS_DEBUG(("Long offset %"PRIuFAST16"\n", best_offset));
+                        pParams->bitFieldQueue <<= (1u + LONG_OFFSET_BITS);
+                        /* Initial 0 bit indicates long offset */
+                        pParams->bitFieldQueue |= best_offset;
+                        pParams->bitFieldQueueLen += (1u + LONG_OFFSET_BITS);
+                    }
+                    /* Encode length */
+                    length = LZSMIN(best_length, MAX_SHORT_LENGTH);
+                    LZS_DEBUG(("Length %"PRIuFAST8"\n", length));
+                    temp8 = length_width[length];
+                    pParams->bitFieldQueue <<= temp8;
+                    pParams->bitFieldQueue |= length_value[length];
+                    pParams->bitFieldQueueLen += temp8;
+
+                    if (length == MAX_SHORT_LENGTH)
+                    {
+                        pParams->offset = best_offset;
+                        pParams->state = COMPRESS_EXTENDED;
+                    }
+
+                    // Insert the other positions of the match that have enough bytes to hash.
+                    historyIdx = pParams->historyLatestIdx;
+                    for (temp8 = 1u; temp8 < length && temp8 + LZS_BUCKET_HASH_LENGTH <= pParams->lookAheadLen; temp8++)
+                    {
+                        historyIdx = lzs_idx_inc_wrap(historyIdx, 1u, sizeof(pParams->historyBuffer));
+                        lzs_bucket_insert(lzs_bucket(pParams, historyIdx), historyIdx);
+                    }
+                }
+                break;
+            case COMPRESS_EXTENDED:
+                if (add_end_marker == false)
+                {
+                    if (pParams->lookAheadLen < MAX_EXTENDED_LENGTH)
+                    {
+                        // We don't have enough input data, so we're done for now.
+                        pParams->status |= LZS_C_STATUS_INPUT_STARVED;
+                        break;
+                    }
+                }
+
+                // Get next length of extended match.
+                matchMax = LZSMIN(pParams->lookAheadLen, MAX_EXTENDED_LENGTH);
+                length = lzs_bucket_match_len(pParams, pParams->offset, matchMax);
+                LZS_DEBUG(("Extended length %"PRIuFAST8"\n", length));
+
+                /* Encode length */
+                pParams->bitFieldQueue <<= EXTENDED_LENGTH_BITS;
+                pParams->bitFieldQueue |= length;
+                pParams->bitFieldQueueLen += EXTENDED_LENGTH_BITS;
+
+                if (length != MAX_EXTENDED_LENGTH)
+                {
+                    pParams->state = COMPRESS_NORMAL;
+                }
+                break;
+        }
+        // 'length' contains number of input bytes encoded.
+        pParams->historyLatestIdx = lzs_idx_inc_wrap(pParams->historyLatestIdx, length,
+                                                    sizeof(pParams->historyBuffer));
+        pParams->historyLen = LZSMIN(pParams->historyLen + length, LZS_MAX_HISTORY_SIZE);
+        pParams->lookAheadLen -= length;
+    }
+
+    if (add_end_marker &&
+        pParams->inLength == 0 &&
+        pParams->state == COMPRESS_NORMAL &&
+        pParams->lookAheadLen == 0 &&
+        pParams->bitFieldQueueLen < 8u &&
+        pParams->outLength >= (pParams->bitFieldQueueLen + 2u + SHORT_OFFSET_BITS + 7u) / 8u)
+    {
+        /* Make end marker, which is like a short offset with value 0, padded out
+         * with 0 to 7 extra zeros to reach a byte boundary. That is,
+         * 0b110000000 */
+        pParams->bitFieldQueue <<= (2u + SHORT_OFFSET_BITS + 7u);
+        pParams->bitFieldQueueLen += (2u + SHORT_OFFSET_BITS + 7u);
+        pParams->bitFieldQueue |= (3u << (SHORT_OFFSET_BITS + 7u));
+        /* Copy output bits to output buffer */
+        while (pParams->bitFieldQueueLen >= 8u)
+        {
+            *pParams->outPtr++ = (pParams->bitFieldQueue >> (pParams->bitFieldQueueLen - 8u));
+            pParams->outLength--;
+            pParams->bitFieldQueueLen -= 8u;
+            ++outCount;
+        }
+        pParams->bitFieldQueueLen = 0;
+        pParams->status |= LZS_C_STATUS_END_MARKER;
+    }
+
+    return outCount;
+}
+
+#endif // !defined(__LZS_COMPRESSION_BUCKET_H)
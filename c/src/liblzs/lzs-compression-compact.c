@@ -0,0 +1,114 @@
+/*****************************************************************************
+ *
+ * \file
+ *
+ * \brief LZS Compression
+ *
+ * This implements LZS (Lempel-Ziv-Stac) compression, which is an LZ77
+ * derived algorithm with a 2kB sliding window and Huffman coding.
+ *
+ * See:
+ *     * ANSI X3.241-1994
+ *     * RFC 1967
+ *     * RFC 1974
+ *     * RFC 2395
+ *     * RFC 3943
+ *
+ * This code is licensed according to the MIT license as follows:
+ * ----------------------------------------------------------------------------
+ * Copyright (c) 2017 Craig McQueen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ----------------------------------------------------------------------------
+ ****************************************************************************/
+
+
+/*****************************************************************************
+ * Includes
+ ****************************************************************************/
+
+#include "lzs.h"
+#include "lzs-common.h"
+
+#include <stdint.h>
+
+//#include <inttypes.h>
+//#include <ctype.h>
+//#include <stdio.h>
+
+
+/*****************************************************************************
+ * Defines
+ ****************************************************************************/
+
+// Incremental compression engine, with buckets of the latest LZS_COMPACT_HASH_WAYS
+// positions with the same hash of three input bytes
+#define LZS_BUCKET_PARAMS_T         LzsCompactCompressParameters_t
+#define LZS_BUCKET_HASH_BITS        LZS_COMPACT_HASH_BITS
+#define LZS_BUCKET_HASH_WAYS        LZS_COMPACT_HASH_WAYS
+#define LZS_BUCKET_HASH_LENGTH      3u
+
+#include "lzs-compression-bucket.h"
+
+
+/*****************************************************************************
+ * Functions
+ ****************************************************************************/
+
+/**
+ * \brief Initialise incremental compression ("compact" version)
+ *
+ * This does initialisation for lzs_compact_compress_incremental().
+ *
+ * \param pParams: Pointer to struct to store incremental compression state.
+ */
+void lzs_compact_compress_init(LzsCompactCompressParameters_t * pParams)
+{
+    lzs_bucket_compress_init(pParams);
+}
+
+
+/**
+ * \brief Incremental compression ("compact" version)
+ *
+ * This is like `lzs_compress_incremental()`, but with a much smaller context,
+ * for applications that keep many compression streams at once. The history
+ * buffer is a ring, as for `lzs_simple_compress_incremental()`, and matches
+ * are found in a small hash table of buckets, each of which holds the latest
+ * LZS_COMPACT_HASH_WAYS positions with the same hash, rather than in hash
+ * chains. Positions that are dropped from a bucket, or overwritten in the
+ * ring, are simply not found any more; since the bytes are compared, a stale
+ * entry costs a comparison, but can't give a wrong match. Parsing is greedy.
+ *
+ * The context size is sizeof(LzsCompactCompressParameters_t). The output is
+ * standard LZS, but the compression ratio is lower than that of
+ * `lzs_compress_incremental()` at its default level.
+ *
+ * Parameters and the use of the state variables are as for
+ * `lzs_simple_compress_incremental()`.
+ *
+ * \param pParams: Pointer to struct to store incremental compression state.
+ * \param add_end_marker: true to append an end-marker to output after all input & output data is processed.
+ *
+ * \return size_t: Number of bytes of compressed data written to the destination buffer.
+ */
+size_t lzs_compact_compress_incremental(LzsCompactCompressParameters_t * pParams, bool add_end_marker)
+{
+    return lzs_bucket_compress_incremental(pParams, add_end_marker);
+}
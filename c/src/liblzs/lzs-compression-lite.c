@@ -0,0 +1,307 @@
+/*****************************************************************************
+ *
+ * \file
+ *
+ * \brief LZS Compression
+ *
+ * This implements LZS (Lempel-Ziv-Stac) compression, which is an LZ77
+ * derived algorithm with a 2kB sliding window and Huffman coding.
+ *
+ * See:
+ *     * ANSI X3.241-1994
+ *     * RFC 1967
+ *     * RFC 1974
+ *     * RFC 2395
+ *     * RFC 3943
+ *
+ * This code is licensed according to the MIT license as follows:
+ * ----------------------------------------------------------------------------
+ * Copyright (c) 2017 Craig McQueen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ----------------------------------------------------------------------------
+ ****************************************************************************/
+
+
+/*****************************************************************************
+ * Includes
+ ****************************************************************************/
+
+#include "lzs.h"
+#include "lzs-common.h"
+
+#include <stdint.h>
+
+//#include <inttypes.h>
+//#include <ctype.h>
+//#include <stdio.h>
+
+#include <string.h>
+
+
+/*****************************************************************************
+ * Defines
+ ****************************************************************************/
+
+// Matches are searched for up to the full look-ahead length.
+#define LZS_LITE_MATCH_MAX          LZS_MAX_LOOK_AHEAD_LEN
+
+// Number of input bytes hashed to select a table entry
+#define LZS_LITE_HASH_LENGTH        2u
+
+// Incremental compression engine, with buckets of just the latest position
+// with the same hash
+#define LZS_BUCKET_PARAMS_T         LzsLiteCompressParameters_t
+#define LZS_BUCKET_HASH_BITS        LZS_LITE_HASH_BITS
+#define LZS_BUCKET_HASH_WAYS        1u
+#define LZS_BUCKET_HASH_LENGTH      LZS_LITE_HASH_LENGTH
+
+#include "lzs-compression-bucket.h"
+
+
+/*****************************************************************************
+ * Inline Functions
+ ****************************************************************************/
+
+/**
+ * \brief Hash the first LZS_LITE_HASH_LENGTH bytes of a data block
+ *
+ * \param value: The bytes, most significant first.
+ *
+ * \return uint_fast16_t: Index into a hash table of (1 << LZS_LITE_HASH_BITS) entries.
+ */
+static inline uint_fast16_t lzs_lite_hash(uint32_t value)
+{
+    return (uint32_t)(value * LZS_HASH_MULTIPLIER) >> (32u - LZS_LITE_HASH_BITS);
+}
+
+/**
+ * \brief Hash the bytes at a position in contiguous input data
+ *
+ * \param pData: Pointer to the data. LZS_LITE_HASH_LENGTH bytes must be valid there.
+ *
+ * \return uint_fast16_t: Index into a hash table of (1 << LZS_LITE_HASH_BITS) entries.
+ */
+static inline uint_fast16_t lzs_lite_hash_ptr(const uint8_t * pData)
+{
+    return lzs_lite_hash(((uint32_t)pData[0] << 8u) | pData[1]);
+}
+
+
+/*****************************************************************************
+ * Functions
+ ****************************************************************************/
+
+/**
+ * \brief Single-call compression ("lite" version)
+ *
+ * This is like `lzs_compress()`, but it finds matches in a small table that
+ * holds only the latest position of each hash of two input bytes, rather than
+ * in hash chains. The table is on the stack, and is
+ * (1 << LZS_LITE_HASH_BITS) * sizeof(uint16_t) bytes. So it uses much less
+ * RAM than `lzs_compress()`, and is much faster than `lzs_simple_compress()`,
+ * but only one candidate is checked for each input position, so the
+ * compression ratio is lower. Parsing is greedy.
+ *
+ * Table entries are the low 16 bits of input positions. An entry may be stale,
+ * or may be for a different pair of bytes with the same hash; since the bytes
+ * are compared, that costs a comparison, but can't give a wrong match.
+ *
+ * No state is kept between calls. Compression is expected to complete in a single call.
+ * It will stop if/when it reaches the end of either the input or the output buffer.
+ *
+ * \param a_pOutData: Pointer to destination buffer for compressed data.
+ * \param a_outBufferSize: Size, in bytes, of the destination buffer.
+ * \param a_pInData: Pointer to source buffer of data to be compressed.
+ * \param a_inLen: Size, in bytes, of source data.
+ *
+ * \return size_t: Number of bytes of compressed data written to the destination buffer.
+ */
+size_t lzs_lite_compress(uint8_t * a_pOutData, size_t a_outBufferSize, const uint8_t * a_pInData, size_t a_inLen)
+{
+    uint16_t            hashTable[1u << LZS_LITE_HASH_BITS];
+    const uint8_t     * inPtr;
+    LzsBitWriter_t      writer;
+    size_t              historyLen;
+    size_t              inRemaining;        // Count of remaining bytes of input
+    uint16_t          * pEntry;
+    uint_fast16_t       offset;
+    uint_fast8_t        matchMax;
+    uint_fast8_t        length;
+    uint_fast16_t       best_offset = 0;
+    uint_fast8_t        best_length;
+    uint_fast8_t        i;
+    bool                ok;
+    BucketCompressState_t state;
+
+
+    memset(hashTable, 0, sizeof(hashTable));
+    historyLen = 0;
+    inPtr = a_pInData;
+    inRemaining = a_inLen;
+    state = COMPRESS_NORMAL;
+    lzs_bits_init(&writer, a_pOutData, a_outBufferSize);
+
+    for (;;)
+    {
+        if (inRemaining == 0 && state == COMPRESS_NORMAL)
+        {
+            /* Exit for loop when all input data is processed. */
+            break;
+        }
+
+        switch (state)
+        {
+            case COMPRESS_NORMAL:
+                /* Look for a match in history, at the position in the table. */
+                best_length = 0;
+                matchMax = LZSMIN(inRemaining, LZS_LITE_MATCH_MAX);
+                if (matchMax >= LZS_LITE_HASH_LENGTH)
+                {
+                    pEntry = &hashTable[lzs_lite_hash_ptr(inPtr)];
+                    offset = (uint16_t)((uint16_t)(inPtr - a_pInData) - *pEntry);
+                    if (offset != 0 && offset <= historyLen)
+                    {
+                        best_length = lzs_match_len(inPtr, inPtr - offset, matchMax);
+                        best_offset = offset;
+                    }
+                    *pEntry = (uint16_t)(inPtr - a_pInData);
+                }
+                /* Output */
+                if (best_length < MIN_LENGTH)
+                {
+                    /* Byte-literal */
+                    /* Leading 0 bit indicates offset/length token.
+                     * Following 8 bits are byte-literal. */
+                    ok = lzs_bits_put(&writer, *inPtr, LITERAL_BITS);
+                    length = 1u;
+                    LZS_DEBUG(("Literal %c (%02X)\n", isprint(*inPtr) ? *inPtr : '?', *inPtr));
+                }
+                else
+                {
+                    LZS_DEBUG(("Best offset %"PRIuFAST16" length %"PRIuFAST8"\n", best_offset, best_length));
+                    /* Offset/length token */
+                    /* 1 bit indicates offset/length token */
+                    /* Encode offset */
+                    if (best_offset <= SHORT_OFFSET_MAX)
+                    {
+                        /* Short offset */
+                        LZS_DEBUG(("Short offset %"PRIuFAST16"\n", best_offset));
+                        /* Initial 1 bit indicates short offset */
+                        ok = lzs_bits_put(&writer, (3u << SHORT_OFFSET_BITS) | best_offset, 2u + SHORT_OFFSET_BITS);
+                    }
+                    else
+                    {
+                        /* Long offset */
+                        LZS_DEBUG(("Long offset %"PRIuFAST16"\n", best_offset));
+                        /* Initial 0 bit indicates long offset */
+                        ok = lzs_bits_put(&writer, (2u << LONG_OFFSET_BITS) | best_offset, 2u + LONG_OFFSET_BITS);
+                    }
+                    /* Encode length */
+                    length = LZSMIN(best_length, MAX_SHORT_LENGTH);
+                    LZS_DEBUG(("Length %"PRIuFAST8"\n", length));
+                    ok = ok && lzs_bits_put(&writer, length_value[length], length_width[length]);
+
+                    if (length == MAX_SHORT_LENGTH)
+                    {
+                        state = COMPRESS_EXTENDED;
+                    }
+
+                    // Insert the other positions of the match that have enough bytes to hash.
+                    for (i = 1u; i < length && i + LZS_LITE_HASH_LENGTH <= inRemaining; i++)
+                    {
+                        hashTable[lzs_lite_hash_ptr(inPtr + i)] = (uint16_t)(inPtr + i - a_pInData);
+                    }
+                }
+                break;
+            case COMPRESS_EXTENDED:
+                matchMax = LZSMIN(inRemaining, MAX_EXTENDED_LENGTH);
+                length = lzs_match_len(inPtr, inPtr - best_offset, matchMax);
+                LZS_DEBUG(("Extended length %"PRIuFAST8"\n", length));
+
+                /* Encode length */
+                ok = lzs_bits_put(&writer, length, EXTENDED_LENGTH_BITS);
+
+                if (length != MAX_EXTENDED_LENGTH)
+                {
+                    state = COMPRESS_NORMAL;
+                }
+                break;
+        }
+        if (!ok)
+        {
+            return writer.outCount;
+        }
+        // 'length' contains number of input bytes encoded.
+        // Update inPtr and inRemaining accordingly.
+        inPtr += length;
+        inRemaining -= length;
+
+        historyLen = LZSMIN(historyLen + length, LZS_MAX_HISTORY_SIZE);
+    }
+    /* Make end marker, which is like a short offset with value 0, padded out
+     * with 0 to 7 extra zeros to reach a byte boundary. That is,
+     * 0b110000000 */
+    if (lzs_bits_put(&writer, 3u << (SHORT_OFFSET_BITS + 7u), 2u + SHORT_OFFSET_BITS + 7u))
+    {
+        /* Copy output bits to output buffer */
+        lzs_bits_flush(&writer);
+    }
+    return writer.outCount;
+}
+
+/**
+ * \brief Initialise incremental compression ("lite" version)
+ *
+ * This does initialisation for lzs_lite_compress_incremental().
+ *
+ * \param pParams: Pointer to struct to store incremental compression state.
+ */
+void lzs_lite_compress_init(LzsLiteCompressParameters_t * pParams)
+{
+    lzs_bucket_compress_init(pParams);
+}
+
+
+/**
+ * \brief Incremental compression ("lite" version)
+ *
+ * This is like `lzs_lite_compress()`, for incremental compression. The
+ * history buffer is a ring, as for `lzs_simple_compress_incremental()`, and
+ * the hash table of the latest position of each hash of two bytes is kept in
+ * the context. Positions that are overwritten in the ring are simply not found
+ * any more; since the bytes are compared, a stale entry costs a comparison,
+ * but can't give a wrong match.
+ *
+ * The context size is sizeof(LzsLiteCompressParameters_t), which is between
+ * those of `lzs_simple_compress_incremental()` and
+ * `lzs_compact_compress_incremental()`. The output is standard LZS.
+ *
+ * Parameters and the use of the state variables are as for
+ * `lzs_simple_compress_incremental()`.
+ *
+ * \param pParams: Pointer to struct to store incremental compression state.
+ * \param add_end_marker: true to append an end-marker to output after all input & output data is processed.
+ *
+ * \return size_t: Number of bytes of compressed data written to the destination buffer.
+ */
+size_t lzs_lite_compress_incremental(LzsLiteCompressParameters_t * pParams, bool add_end_marker)
+{
+    return lzs_bucket_compress_incremental(pParams, add_end_marker);
+}
@@ -126,38 +126,13 @@ static const uint8_t length_width[MAX_SHORT_LENGTH + 1u] =
  * Inline Functions
  ****************************************************************************/
 
-/**
- * \brief Count the length of the match betwen two data blocks, up to a maximum match length
- *
- * This doesn't do any circular buffer wrapping.
- *
- * \param aPtr: Pointer to 1st data block.
- * \param bPtr: Pointer to 2nd data block.
- * \param matchMax: Maximum match length to count.
- *
- * \return uint_fast8_t: Length of consecutive matching bytes between the two data blocks.
- */
-static inline uint_fast8_t lzs_match_len(const uint8_t * aPtr, const uint8_t * bPtr, uint_fast8_t matchMax)
-{
-    uint_fast8_t    len;
-
-
-    for (len = 0; len < matchMax; len++)
-    {
-        if (*aPtr++ != *bPtr++)
-        {
-            return len;
-        }
-    }
-    return len;
-}
-
 /**
  * \brief Count the length of the match betwen the next input bytes and a point in the history.
  *
  * Length is counted up to a maximum match length.
  *
- * This does wrapping of the indices into the history buffer.
+ * This does wrapping of the indices into the history buffer. If neither the
+ * look-ahead nor the history data wraps, the match-length kernel is used.
  *
  * \param pParams: Pointer to struct to store incremental compression state.
  * \param offset: Reverse offset into the history buffer.
@@ -176,6 +151,13 @@ static inline uint_fast8_t lzs_inc_match_len(LzsSimpleCompressParameters_t * pPa
                                         sizeof(pParams->historyBuffer));
     historyLookAheadIdx = pParams->historyLatestIdx;
 
+    if (historyReadIdx + matchMax <= sizeof(pParams->historyBuffer) &&
+        historyLookAheadIdx + matchMax <= sizeof(pParams->historyBuffer))
+    {
+        return lzs_match_len(&pParams->historyBuffer[historyLookAheadIdx],
+                             &pParams->historyBuffer[historyReadIdx], matchMax);
+    }
+
     for (len = 0; len < matchMax; ++len )
     {
         if (pParams->historyBuffer[historyLookAheadIdx] != pParams->historyBuffer[historyReadIdx])
@@ -190,6 +172,115 @@ static inline uint_fast8_t lzs_inc_match_len(LzsSimpleCompressParameters_t * pPa
     return len;
 }
 
+/**
+ * \brief Check a candidate match in the history, and update the best match found so far.
+ *
+ * \param pParams: Pointer to struct to store incremental compression state.
+ * \param offset: Reverse offset into the history buffer.
+ * \param matchMax: Maximum match length to count.
+ * \param pBestOffset: Pointer to the offset of the best match.
+ * \param pBestLength: Pointer to the length of the best match.
+ *
+ * \return bool: true if the match reaches `matchMax`, so the search is done.
+ */
+static inline bool lzs_inc_candidate(LzsSimpleCompressParameters_t * pParams, uint_fast16_t offset, uint_fast8_t matchMax,
+                                     uint_fast16_t * pBestOffset, uint_fast8_t * pBestLength)
+{
+    uint_fast8_t    length;
+
+
+    length = lzs_inc_match_len(pParams, offset, matchMax);
+    if (length > *pBestLength)
+    {
+        *pBestOffset = offset;
+        *pBestLength = length;
+    }
+    return (length >= matchMax);
+}
+
+/**
+ * \brief Check all candidate matches in a contiguous segment of the history buffer, from the last to the first.
+ *
+ * Candidates are found by scanning for the first two look-ahead bytes.
+ *
+ * \param pParams: Pointer to struct to store incremental compression state.
+ * \param segmentIdx: Index into the history buffer of the start of the segment.
+ * \param count: Number of positions in the segment. The byte following the segment is also read.
+ * \param segmentOffset: Reverse offset of the start of the segment.
+ * \param matchMax: Maximum match length to count.
+ * \param pBestOffset: Pointer to the offset of the best match.
+ * \param pBestLength: Pointer to the length of the best match.
+ *
+ * \return bool: true if a match reaches `matchMax`, so the search is done.
+ */
+static inline bool lzs_inc_search_segment(LzsSimpleCompressParameters_t * pParams,
+                                          uint_fast16_t segmentIdx, size_t count, uint_fast16_t segmentOffset,
+                                          uint_fast8_t matchMax, uint_fast16_t * pBestOffset, uint_fast8_t * pBestLength)
+{
+    uint8_t         first;
+    uint8_t         second;
+    size_t          pos;
+
+
+    first = pParams->historyBuffer[pParams->historyLatestIdx];
+    second = pParams->historyBuffer[lzs_idx_inc_wrap(pParams->historyLatestIdx, 1u, sizeof(pParams->historyBuffer))];
+    while ((pos = lzs_pair_scan(&pParams->historyBuffer[segmentIdx], count, first, second)) < count)
+    {
+        if (lzs_inc_candidate(pParams, segmentOffset - pos, matchMax, pBestOffset, pBestLength))
+        {
+            return true;
+        }
+        count = pos;
+    }
+    return false;
+}
+
+/**
+ * \brief Find the best match in the history for the look-ahead data.
+ *
+ * Offsets are checked in increasing order, so the smallest offset wins among
+ * matches of equal length. Only matches of at least MIN_LENGTH are found.
+ *
+ * The history is in a circular buffer, so it is scanned in up to two
+ * contiguous segments, plus the one position whose byte pair straddles the
+ * end of the buffer.
+ *
+ * \param pParams: Pointer to struct to store incremental compression state.
+ * \param matchMax: Maximum match length to count.
+ * \param pBestOffset: Pointer to store the offset of the best match.
+ *
+ * \return uint_fast8_t: Length of the best match, or 0 if there is none.
+ */
+static uint_fast8_t lzs_inc_search(LzsSimpleCompressParameters_t * pParams, uint_fast8_t matchMax, uint_fast16_t * pBestOffset)
+{
+    uint_fast16_t   latestIdx;
+    uint_fast16_t   historyLen;
+    uint_fast8_t    bestLength;
+
+
+    bestLength = 0;
+    if (matchMax < MIN_LENGTH)
+    {
+        return bestLength;
+    }
+    latestIdx = pParams->historyLatestIdx;
+    historyLen = pParams->historyLen;
+    if (latestIdx >= historyLen)
+    {
+        lzs_inc_search_segment(pParams, latestIdx - historyLen, historyLen, historyLen,
+                               matchMax, pBestOffset, &bestLength);
+    }
+    else if (!lzs_inc_search_segment(pParams, 0, latestIdx, latestIdx,
+                                     matchMax, pBestOffset, &bestLength) &&
+             !lzs_inc_candidate(pParams, latestIdx + 1u, matchMax, pBestOffset, &bestLength))
+    {
+        lzs_inc_search_segment(pParams, sizeof(pParams->historyBuffer) - historyLen + latestIdx,
+                               historyLen - latestIdx - 1u, historyLen,
+                               matchMax, pBestOffset, &bestLength);
+    }
+    return (bestLength >= MIN_LENGTH) ? bestLength : 0;
+}
+
 
 /*****************************************************************************
  * Functions
@@ -199,7 +290,8 @@ static inline uint_fast8_t lzs_inc_match_len(LzsSimpleCompressParameters_t * pPa
  * \brief Single-call compression
  *
  * This is like `lzs_compress()`, but it doesn't use hash tables to quickly find
- * data matches in the history. So it uses less RAM, but is slower.
+ * data matches in the history. Instead it scans the whole history for the first
+ * two input bytes. So it uses less RAM, but is slower.
  *
  * No state is kept between calls. Compression is expected to complete in a single call.
  * It will stop if/when it reaches the end of either the input or the output buffer.
@@ -214,43 +306,28 @@ static inline uint_fast8_t lzs_inc_match_len(LzsSimpleCompressParameters_t * pPa
 size_t lzs_simple_compress(uint8_t * a_pOutData, size_t a_outBufferSize, const uint8_t * a_pInData, size_t a_inLen)
 {
     const uint8_t     * inPtr;
-    uint8_t           * outPtr;
+    LzsBitWriter_t      writer;
     size_t              historyLen;
     size_t              inRemaining;        // Count of remaining bytes of input
-    size_t              outCount;           // Count of output bytes that have been generated
-    uint32_t            bitFieldQueue;      // Code assumes bits will disappear past MS-bit 31 when shifted left.
-    uint_fast8_t        bitFieldQueueLen;
+    size_t              scanLen;
+    size_t              candidate;
     uint_fast16_t       offset;
     uint_fast8_t        matchMax;
     uint_fast8_t        length;
     uint_fast16_t       best_offset;
     uint_fast8_t        best_length;
-    uint8_t             temp8;
+    bool                ok;
     SimpleCompressState_t state;
 
 
     historyLen = 0;
-    bitFieldQueue = 0;
-    bitFieldQueueLen = 0;
     inPtr = a_pInData;
-    outPtr = a_pOutData;
     inRemaining = a_inLen;
-    outCount = 0;
     state = COMPRESS_NORMAL;
+    lzs_bits_init(&writer, a_pOutData, a_outBufferSize);
 
     for (;;)
     {
-        /* Copy output bits to output buffer */
-        while (bitFieldQueueLen >= 8u)
-        {
-            if (outCount >= a_outBufferSize)
-            {
-                return outCount;
-            }
-            *outPtr++ = (bitFieldQueue >> (bitFieldQueueLen - 8u));
-            bitFieldQueueLen -= 8u;
-            outCount++;
-        }
         if (inRemaining == 0 && state == COMPRESS_NORMAL)
         {
             /* Exit for loop when all input data is processed. */
@@ -263,17 +340,25 @@ size_t lzs_simple_compress(uint8_t * a_pOutData, size_t a_outBufferSize, const u
                 /* Look for a match in history */
                 best_length = 0;
                 matchMax = LZSMIN(inRemaining, LZS_SEARCH_MATCH_MAX);
-                for (offset = 1; offset <= historyLen; offset++)
+                if (matchMax >= MIN_LENGTH)
                 {
-                    length = lzs_match_len(inPtr, inPtr - offset, matchMax);
-                    if (length > best_length)
+                    /* Scan back through the history for the first two bytes,
+                     * so offsets are checked in increasing order. */
+                    scanLen = historyLen;
+                    while ((candidate = lzs_pair_scan(inPtr - historyLen, scanLen, inPtr[0], inPtr[1])) < scanLen)
                     {
-                        best_offset = offset;
-                        best_length = length;
-                        if (length >= matchMax)
+                        offset = historyLen - candidate;
+                        length = lzs_match_len(inPtr, inPtr - offset, matchMax);
+                        if (length > best_length)
                         {
-                            break;
+                            best_offset = offset;
+                            best_length = length;
+                            if (length >= matchMax)
+                            {
+                                break;
+                            }
                         }
+                        scanLen = candidate;
                     }
                 }
                 /* Output */
@@ -282,9 +367,7 @@ size_t lzs_simple_compress(uint8_t * a_pOutData, size_t a_outBufferSize, const u
                     /* Byte-literal */
                     /* Leading 0 bit indicates offset/length token.
                      * Following 8 bits are byte-literal. */
-                    bitFieldQueue <<= 9u;
-                    bitFieldQueue |= *inPtr;
-                    bitFieldQueueLen += 9u;
+                    ok = lzs_bits_put(&writer, *inPtr, LITERAL_BITS);
                     length = 1u;
                     LZS_DEBUG(("Literal %c (%02X)\n", isprint(*inPtr) ? *inPtr : '?', *inPtr));
                 }
@@ -293,35 +376,25 @@ size_t lzs_simple_compress(uint8_t * a_pOutData, size_t a_outBufferSize, const u
                     LZS_DEBUG(("Best offset %"PRIuFAST16" length %"PRIuFAST8"\n", best_offset, best_length));
                     /* Offset/length token */
                     /* 1 bit indicates offset/length token */
-                    bitFieldQueue <<= 1u;
-                    bitFieldQueueLen++;
-                    bitFieldQueue |= 1u;
                     /* Encode offset */
                     if (best_offset <= SHORT_OFFSET_MAX)
                     {
                         /* Short offset */
                         LZS_DEBUG(("Short offset %"PRIuFAST16"\n", best_offset));
-                        bitFieldQueue <<= (1u + SHORT_OFFSET_BITS);
                         /* Initial 1 bit indicates short offset */
-                        bitFieldQueue |= (1u << SHORT_OFFSET_BITS) | best_offset;
-                        bitFieldQueueLen += (1u + SHORT_OFFSET_BITS);
+                        ok = lzs_bits_put(&writer, (3u << SHORT_OFFSET_BITS) | best_offset, 2u + SHORT_OFFSET_BITS);
                     }
                     else
                     {
                         /* Long offset */
                         LZS_DEBUG(("Long offset %"PRIuFAST16"\n", best_offset));
-                        bitFieldQueue <<= (1u + LONG_OFFSET_BITS);
                         /* Initial 0 bit indicates long offset */
-                        bitFieldQueue |= best_offset;
-                        bitFieldQueueLen += (1u + LONG_OFFSET_BITS);
+                        ok = lzs_bits_put(&writer, (2u << LONG_OFFSET_BITS) | best_offset, 2u + LONG_OFFSET_BITS);
                     }
                     /* Encode length */
                     length = LZSMIN(best_length, MAX_SHORT_LENGTH);
                     LZS_DEBUG(("Length %"PRIuFAST8"\n", length));
-                    temp8 = length_width[length];
-                    bitFieldQueue <<= temp8;
-                    bitFieldQueue |= length_value[length];
-                    bitFieldQueueLen += temp8;
+                    ok = ok && lzs_bits_put(&writer, length_value[length], length_width[length]);
 
                     if (length == MAX_SHORT_LENGTH)
                     {
@@ -335,9 +408,7 @@ size_t lzs_simple_compress(uint8_t * a_pOutData, size_t a_outBufferSize, const u
                 LZS_DEBUG(("Extended length %"PRIuFAST8"\n", length));
 
                 /* Encode length */
-                bitFieldQueue <<= EXTENDED_LENGTH_BITS;
-                bitFieldQueue |= length;
-                bitFieldQueueLen += EXTENDED_LENGTH_BITS;
+                ok = lzs_bits_put(&writer, length, EXTENDED_LENGTH_BITS);
 
                 if (length != MAX_EXTENDED_LENGTH)
                 {
@@ -345,6 +416,10 @@ size_t lzs_simple_compress(uint8_t * a_pOutData, size_t a_outBufferSize, const u
                 }
                 break;
         }
+        if (!ok)
+        {
+            return writer.outCount;
+        }
         // 'length' contains number of input bytes encoded.
         // Update inPtr and inRemaining accordingly.
         inPtr += length;
@@ -355,21 +430,12 @@ size_t lzs_simple_compress(uint8_t * a_pOutData, size_t a_outBufferSize, const u
     /* Make end marker, which is like a short offset with value 0, padded out
      * with 0 to 7 extra zeros to reach a byte boundary. That is,
      * 0b110000000 */
-    bitFieldQueue <<= (2u + SHORT_OFFSET_BITS + 7u);
-    bitFieldQueueLen += (2u + SHORT_OFFSET_BITS + 7u);
-    bitFieldQueue |= (3u << (SHORT_OFFSET_BITS + 7u));
-    /* Copy output bits to output buffer */
-    while (bitFieldQueueLen >= 8u)
+    if (lzs_bits_put(&writer, 3u << (SHORT_OFFSET_BITS + 7u), 2u + SHORT_OFFSET_BITS + 7u))
     {
-        if (outCount >= a_outBufferSize)
-        {
-            return outCount;
-        }
-        *outPtr++ = (bitFieldQueue >> (bitFieldQueueLen - 8u));
-        bitFieldQueueLen -= 8u;
-        outCount++;
+        /* Copy output bits to output buffer */
+        lzs_bits_flush(&writer);
     }
-    return outCount;
+    return writer.outCount;
 }
 
 /**
@@ -398,7 +464,8 @@ void lzs_simple_compress_init(LzsSimpleCompressParameters_t * pParams)
  * \brief Incremental compression ("simple" version)
  *
  * This is like `lzs_compress_incremental()`, but it doesn't use hash tables to
- * quickly find data matches in the history. So it uses less RAM, but is slower.
+ * quickly find data matches in the history. Instead it scans the whole history
+ * for the first two input bytes. So it uses less RAM, but is slower.
  *
  * State is kept between calls, so compression can be done gradually, and flexibly
  * depending on the application's needs for input/output buffer handling.
@@ -435,12 +502,12 @@ void lzs_simple_compress_init(LzsSimpleCompressParameters_t * pParams)
 size_t lzs_simple_compress_incremental(LzsSimpleCompressParameters_t * pParams, bool add_end_marker)
 {
     size_t              outCount;           // Count of output bytes that have been generated
-    uint_fast16_t       offset;
     uint_fast8_t        matchMax;
     uint_fast8_t        length;
     uint_fast16_t       best_offset;
     uint_fast8_t        best_length;
     uint_fast8_t        temp8;
+    size_t              bytes;
 
 
     pParams->status = LZS_C_STATUS_NONE;
@@ -449,23 +516,24 @@ size_t lzs_simple_compress_incremental(LzsSimpleCompressParameters_t * pParams,
     for (;;)
     {
         length = 0;
-        // Write data from the bit field queue to output
-        while (pParams->bitFieldQueueLen >= 8u)
+        // Write data from the bit field queue to output, once it is half full,
+        // and at the end of the input or before returning
+        if (pParams->bitFieldQueueLen >= BIT_WRITER_FLUSH_BITS || pParams->status != LZS_C_STATUS_NONE ||
+            pParams->inLength == 0)
         {
-            // Check if we have space in the output buffer
-            if (pParams->outLength == 0)
+            bytes = lzs_bits_write(pParams->outPtr, pParams->outLength, pParams->bitFieldQueue, pParams->bitFieldQueueLen);
+            pParams->outPtr += bytes;
+            pParams->outLength -= bytes;
+            pParams->bitFieldQueueLen -= 8u * bytes;
+            outCount += bytes;
+            if (pParams->bitFieldQueueLen >= 8u)
             {
                 // We're out of space in the output buffer.
-                // Set status, exit this inner copying loop, but maintain the current state.
+                // Set status, but maintain the current state.
                 pParams->status |= LZS_C_STATUS_NO_OUTPUT_BUFFER_SPACE;
-                break;
             }
-            *pParams->outPtr++ = (pParams->bitFieldQueue >> (pParams->bitFieldQueueLen - 8u));
-            pParams->outLength--;
-            pParams->bitFieldQueueLen -= 8u;
-            ++outCount;
         }
-        if (pParams->bitFieldQueueLen > BIT_QUEUE_BITS)
+        if (pParams->bitFieldQueueLen > BIT_WRITER_FLUSH_BITS + 24u)
         {
             // It is an error if we ever get here.
             LZS_ASSERT(0);
@@ -514,21 +582,8 @@ size_t lzs_simple_compress_incremental(LzsSimpleCompressParameters_t * pParams,
                 }
 
                 // Look for a match in history.
-                best_length = 0;
                 matchMax = LZSMIN(pParams->lookAheadLen, LZS_SEARCH_MATCH_MAX);
-                for (offset = 1; offset <= pParams->historyLen; offset++)
-                {
-                    length = lzs_inc_match_len(pParams, offset, matchMax);
-                    if (length > best_length)
-                    {
-                        best_offset = offset;
-                        best_length = length;
-                        if (length >= matchMax)
-                        {
-                            break;
-                        }
-                    }
-                }
+                best_length = lzs_inc_search(pParams, matchMax, &best_offset);
                 /* Output */
                 if (best_length < MIN_LENGTH)
                 {
@@ -59,19 +59,79 @@
  * Defines
  ****************************************************************************/
 
-#define LZS_SEARCH_MATCH_MAX        12u
-
 //#define LZS_DEBUG(X)                printf X
 #define LZS_DEBUG(X)
 
 #define LZS_ASSERT(X)
 
-#if LZS_MAX_LOOK_AHEAD_LEN < MAX_SHORT_LENGTH || LZS_MAX_LOOK_AHEAD_LEN < MAX_EXTENDED_LENGTH || LZS_MAX_LOOK_AHEAD_LEN < LZS_SEARCH_MATCH_MAX
+// Maximum number of following input positions checked by lazy matching
+#define LZS_LAZY_STEPS_MAX          2u
+
+// Once the input looks incompressible, only one of every LZS_PROBE_INTERVAL
+// positions is searched for a match, and put in the hash tables.
+#define LZS_PROBE_INTERVAL          8u
+
+// Optimal parsing is done in blocks of this many input bytes.
+#define LZS_OPTIMAL_BLOCK_SIZE      1024u
+
+// Optimal parsing takes matches at least this long without considering the
+// positions inside them, to limit the time spent on long runs.
+#define LZS_OPTIMAL_NICE_LENGTH     (MAX_SHORT_LENGTH + 2u * MAX_EXTENDED_LENGTH)
+
+#define LZS_OPTIMAL_PRICE_MAX       UINT32_MAX
+
+// Multiplier for multiplicative hashing, 2^32 divided by the golden ratio
+#define LZS_HASH_MULTIPLIER         2654435761u
+
+#if LZS_MAX_LOOK_AHEAD_LEN < MAX_SHORT_LENGTH || LZS_MAX_LOOK_AHEAD_LEN < MAX_EXTENDED_LENGTH
 #error LZS_MAX_LOOK_AHEAD_LEN is too small
 #endif
 
 #define ARRAY_ENTRIES(a)            (sizeof(a)/sizeof((a)[0]))
 
+// Hash table entries are history indices, tagged with the hash epoch in the
+// bits above them. Changing the epoch invalidates all entries, so a context
+// can be reset without clearing its tables, until the epochs run out.
+#define LZS_HASH_EPOCH_SHIFT        12u
+#define LZS_HASH_EPOCH_INC          (1u << LZS_HASH_EPOCH_SHIFT)
+#define LZS_HASH_EPOCH_LAST         (0xFFFFu & ~(LZS_HASH_EPOCH_INC - 1u))
+
+// Hash table entries are moved with the history window in blocks of this many,
+// which compilers can vectorise.
+#define LZS_SLIDE_BLOCK_LEN         8u
+
+// An entry whose history index is this is never valid, whatever the epoch.
+#define LZS_HASH_ENTRY_INVALID_IDX  (LZS_HASH_EPOCH_INC - 1u)
+
+// Incremental compression reads the caller's input buffer in place, rather
+// than copying it into the history buffer, while at least this much input
+// remains in the call.
+#define LZS_BULK_INPUT_MIN          LZS_MAX_HISTORY_SIZE
+
+#if LZS_COMPRESS_WINDOW_SIZE > LZS_HASH_ENTRY_INVALID_IDX
+#error LZS_HASH_EPOCH_SHIFT is too small for LZS_COMPRESS_WINDOW_SIZE
+#endif
+
+#if LZS_COMPRESS_WINDOW_SIZE < LZS_MAX_HISTORY_SIZE + 2u * LZS_MAX_LOOK_AHEAD_LEN
+#error LZS_COMPRESS_WINDOW_SIZE is too small
+#endif
+
+// Maximum number of matches found by the binary tree at one position: one for
+// each length up to the longest that is searched for.
+#define LZS_TREE_MATCHES_MAX        LZS_OPTIMAL_NICE_LENGTH
+
+#if LZS_MAX_LOOK_AHEAD_LEN > LZS_TREE_MATCHES_MAX
+#error LZS_TREE_MATCHES_MAX is too small for LZS_MAX_LOOK_AHEAD_LEN
+#endif
+
+#if LZS_TREE_WINDOW_SIZE <= LZS_MAX_HISTORY_SIZE || (LZS_TREE_WINDOW_SIZE & (LZS_TREE_WINDOW_SIZE - 1u))
+#error LZS_TREE_WINDOW_SIZE must be a power of two, larger than LZS_MAX_HISTORY_SIZE
+#endif
+
+// Signature in the header of a workspace whose hash tables have been cleared, "LZSW"
+#define LZS_WORKSPACE_SIGNATURE0    0x4C5Au
+#define LZS_WORKSPACE_SIGNATURE1    0x5357u
+
 
 /*****************************************************************************
  * Typedefs
@@ -80,9 +140,65 @@
 typedef enum
 {
     COMPRESS_NORMAL,
-    COMPRESS_EXTENDED
+    COMPRESS_EXTENDED,
+    COMPRESS_END_MARKER                     // An end marker is in the bit field queue, waiting for output buffer space
 } SimpleCompressState_t;
 
+typedef struct
+{
+    uint16_t          * hashTable;          // Most recent window index for each hash value
+    uint16_t          * historyHash;        // Previous window index with the same hash, for each window index modulo LZS_MAX_HISTORY_SIZE
+    uint16_t          * hash2Table;         // Most recent window index for each 2-byte hash value, if hashLength > MIN_LENGTH
+    const uint8_t     * inBase;             // Input position of window index 0
+    const uint8_t     * inEnd;              // End of the input data
+    uint_fast16_t       hashEpoch;          // Tag of valid hash table entries
+    uint_fast8_t        hashType;           // LzsHashType_t
+    uint_fast8_t        hashBits;
+    uint_fast8_t        hashLength;         // Number of input bytes hashed for hashTable[]
+} LzsMatchFinder_t;
+
+typedef struct
+{
+    uint16_t            length;
+    uint16_t            offset;
+} LzsMatch_t;
+
+// Tables of optimal parsing, in the workspace after the match finder's tables
+typedef struct
+{
+    uint32_t            price[LZS_OPTIMAL_BLOCK_SIZE + 1u];     // Size in bits to encode the block up to each position
+    uint16_t            fromLength[LZS_OPTIMAL_BLOCK_SIZE + 1u];// Length of the literal (1) or match that reaches each position
+    uint16_t            fromOffset[LZS_OPTIMAL_BLOCK_SIZE + 1u];// Offset of the match that reaches each position
+    LzsMatch_t          overlapMatches[LZS_OPTIMAL_NICE_LENGTH][LZS_TREE_MATCHES_MAX];  // Matches found at the positions in the overlap
+} LzsOptimalTables_t;
+
+// Fails to compile if LZS_OPTIMAL_WORKSPACE_LEN is too small for LzsOptimalTables_t.
+typedef char LzsOptimalTablesSizeCheck_t[(sizeof(LzsOptimalTables_t) <= LZS_OPTIMAL_WORKSPACE_LEN) ? 1 : -1];
+
+typedef struct
+{
+    uint32_t          * head;               // Latest position + 1 for each hash value, or 0 if none
+    uint32_t          * head2;              // Latest position + 1 for each 2-byte hash value, if hashLength > MIN_LENGTH
+    uint32_t          * son;                // Smaller and larger subtree of each position in the window, as position + 1
+    const uint8_t     * inStart;            // Start of the input data, from which positions are counted
+    const uint8_t     * inEnd;              // End of the input data
+    const uint8_t     * treePtr;            // First input position that isn't yet in the trees
+    LzsMatch_t          latest;             // Longest match at treePtr - 1, for when lazy matching searches it again
+    uint_fast16_t       cutMax;             // Maximum number of tree nodes to visit for each position
+    uint_fast8_t        lenMax;             // Maximum match length to search for
+    uint_fast8_t        hashType;           // LzsHashType_t
+    uint_fast8_t        hashBits;
+    uint_fast8_t        hashLength;         // Number of input bytes hashed for head[]
+} LzsTreeFinder_t;
+
+// Header of a workspace for single-call compression. It is LZS_WORKSPACE_HEADER_LEN uint16_t.
+typedef struct
+{
+    uint16_t            signature[2];       // LZS_WORKSPACE_SIGNATURE0/1 once the hash tables have been cleared
+    uint16_t            hashEpoch;          // Tag of the hash table entries of the latest call
+    uint16_t            hashBits;           // Hash table size that the tables were cleared for
+} LzsWorkspaceHeader_t;
+
 
 /*****************************************************************************
  * Tables
@@ -124,344 +240,1902 @@ static const uint8_t length_width[MAX_SHORT_LENGTH + 1u] =
 };
 
 
+// Number of input bytes hashed, for each LzsHashType_t
+static const uint8_t hashTypeLength[NUM_LZS_HASH_TYPES] =
+{
+    2u,
+    2u,
+    3u,
+    4u,
+};
+
+/*
+ * Search parameters for each compression level. Index 0 is unused; levels below
+ * LZS_COMPRESS_LEVEL_FASTEST are treated as LZS_COMPRESS_LEVEL_FASTEST.
+ * LZS_COMPRESS_LEVEL_DEFAULT gives the same output as lzs_compress().
+ * Only the fast levels skip positions of input that looks incompressible
+ * (incompressibleRun), since that costs some compression on mixed input.
+ */
+static const LzsCompressConfig_t levelConfig[LZS_COMPRESS_LEVEL_MAX + 1u] =
+{
+    //  chainMax                niceLength  searchLength    lazyLength  lazySteps   optimal     hashType            hashBits            matchFinder                     incompressibleRun
+    {   1u,                     8u,         8u,             0,          0,          0,          LZS_HASH_4BYTE,     INPUT_HASH_BITS,    LZS_MATCH_FINDER_HASH_CHAIN,    64u  },  // 0 (unused)
+    {   1u,                     8u,         8u,             0,          0,          0,          LZS_HASH_4BYTE,     INPUT_HASH_BITS,    LZS_MATCH_FINDER_HASH_CHAIN,    64u  },  // 1
+    {   2u,                     8u,         8u,             0,          0,          0,          LZS_HASH_4BYTE,     INPUT_HASH_BITS,    LZS_MATCH_FINDER_HASH_CHAIN,    64u  },  // 2
+    {   4u,                     10u,        10u,            0,          0,          0,          LZS_HASH_3BYTE,     INPUT_HASH_BITS,    LZS_MATCH_FINDER_HASH_CHAIN,    64u  },  // 3
+    {   8u,                     12u,        12u,            0,          0,          0,          LZS_HASH_3BYTE,     INPUT_HASH_BITS,    LZS_MATCH_FINDER_HASH_CHAIN,    64u  },  // 4
+    {   32u,                    12u,        12u,            0,          0,          0,          LZS_HASH_LEGACY,    INPUT_HASH_BITS,    LZS_MATCH_FINDER_HASH_CHAIN,    0    },  // 5
+    {   LZS_MAX_HISTORY_SIZE,   12u,        12u,            0,          0,          0,          LZS_HASH_LEGACY,    INPUT_HASH_BITS,    LZS_MATCH_FINDER_HASH_CHAIN,    0    },  // 6
+    {   LZS_MAX_HISTORY_SIZE,   12u,        12u,            8u,         1u,         0,          LZS_HASH_LEGACY,    INPUT_HASH_BITS,    LZS_MATCH_FINDER_HASH_CHAIN,    0    },  // 7
+    {   LZS_MAX_HISTORY_SIZE,   13u,        13u,            13u,        1u,         0,          LZS_HASH_LEGACY,    INPUT_HASH_BITS,    LZS_MATCH_FINDER_HASH_CHAIN,    0    },  // 8
+    {   LZS_MAX_HISTORY_SIZE,   13u,        13u,            13u,        2u,         0,          LZS_HASH_LEGACY,    INPUT_HASH_BITS,    LZS_MATCH_FINDER_HASH_CHAIN,    0    },  // 9
+    {   LZS_MAX_HISTORY_SIZE,   13u,        13u,            13u,        2u,         1u,         LZS_HASH_LEGACY,    INPUT_HASH_BITS,    LZS_MATCH_FINDER_BINARY_TREE,   0    },  // 10
+};
+
+
 /*****************************************************************************
  * Inline Functions
  ****************************************************************************/
 
 /**
- * \brief Return hash of two input bytes, modulo INPUT_HASH_SIZE.
+ * \brief Return hash of input bytes, for the main hash table
  *
- * \param a: Input byte
- * \param b: Input byte
+ * \param pBytes: Pointer to the input bytes. hashTypeLength[hashType] bytes are read.
+ * \param hashType: LzsHashType_t.
+ * \param hashBits: Hash table size, as log2 of the number of entries.
  *
- * \return A simple hash of the two input bytes
+ * \return Hash of the input bytes, less than (1 << hashBits).
  */
-static inline lzs_input_hash_t inputs_hash(uint8_t a, uint8_t b)
+static inline lzs_input_hash_t inputs_hash(const uint8_t * pBytes, uint_fast8_t hashType, uint_fast8_t hashBits)
 {
-    return (((lzs_input_hash_t)a << 4u) ^ (lzs_input_hash_t)b) % INPUT_HASH_SIZE;
+    uint32_t        value;
+
+    switch (hashType)
+    {
+        case LZS_HASH_LEGACY:
+        default:
+            return (((lzs_input_hash_t)pBytes[0] << 4u) ^ (lzs_input_hash_t)pBytes[1]) & ((1u << hashBits) - 1u);
+        case LZS_HASH_2BYTE:
+            value = ((uint32_t)pBytes[0] << 8u) | pBytes[1];
+            if (hashBits == 16u)
+            {
+                return value;
+            }
+            value <<= 16u;
+            break;
+        case LZS_HASH_3BYTE:
+            value = ((uint32_t)pBytes[0] << 24u) | ((uint32_t)pBytes[1] << 16u) | ((uint32_t)pBytes[2] << 8u);
+            break;
+        case LZS_HASH_4BYTE:
+            value = ((uint32_t)pBytes[0] << 24u) | ((uint32_t)pBytes[1] << 16u) | ((uint32_t)pBytes[2] << 8u) | pBytes[3];
+            break;
+    }
+    return (uint32_t)(value * LZS_HASH_MULTIPLIER) >> (32u - hashBits);
 }
 
 /**
- * \brief Return hash of next two input bytes for incremental compression, modulo INPUT_HASH_SIZE.
+ * \brief Return hash of two input bytes, for the 2-byte hash table
  *
- * The next two input bytes are in the look-ahead buffer in the incremental compression state.
+ * \param pBytes: Pointer to the input bytes.
  *
- * \param pParams: Pointer to struct to store incremental compression state.
+ * \return Hash of the two input bytes, less than INPUT_HASH2_SIZE.
+ */
+static inline lzs_input_hash_t inputs_hash2(const uint8_t * pBytes)
+{
+    uint32_t        value;
+
+    value = ((uint32_t)pBytes[0] << 24u) | ((uint32_t)pBytes[1] << 16u);
+    return (uint32_t)(value * LZS_HASH_MULTIPLIER) >> (32u - INPUT_HASH2_BITS);
+}
+
+/**
+ * \brief Make compression parameters consistent with each other and with the implementation limits
+ *
+ * \param pConfig: Pointer to compression parameters, which are modified as needed.
+ * \param hashBitsMax: Largest hash table size that is available, as log2 of the number of entries.
+ */
+static inline void lzs_compress_config_check(LzsCompressConfig_t * pConfig, uint_fast8_t hashBitsMax)
+{
+    if (pConfig->chainMax == 0)
+    {
+        pConfig->chainMax = 1u;
+    }
+    if (pConfig->hashType >= NUM_LZS_HASH_TYPES)
+    {
+        pConfig->hashType = LZS_HASH_LEGACY;
+    }
+    if (pConfig->matchFinder >= NUM_LZS_MATCH_FINDERS)
+    {
+        pConfig->matchFinder = LZS_MATCH_FINDER_HASH_CHAIN;
+    }
+    if (pConfig->hashBits == 0)
+    {
+        pConfig->hashBits = INPUT_HASH_BITS;
+    }
+    if (pConfig->hashBits < LZS_HASH_BITS_MIN)
+    {
+        pConfig->hashBits = LZS_HASH_BITS_MIN;
+    }
+    if (pConfig->hashBits > hashBitsMax)
+    {
+        pConfig->hashBits = hashBitsMax;
+    }
+    if (pConfig->searchLength < hashTypeLength[pConfig->hashType])
+    {
+        // Incremental compression needs this much look-ahead to hash a position.
+        pConfig->searchLength = hashTypeLength[pConfig->hashType];
+    }
+    if (pConfig->searchLength > LZS_MAX_LOOK_AHEAD_LEN)
+    {
+        pConfig->searchLength = LZS_MAX_LOOK_AHEAD_LEN;
+    }
+    if (pConfig->niceLength < MIN_LENGTH || pConfig->niceLength > pConfig->searchLength)
+    {
+        pConfig->niceLength = pConfig->searchLength;
+    }
+    if (pConfig->lazySteps < 1u)
+    {
+        pConfig->lazySteps = 1u;
+    }
+    if (pConfig->lazySteps > LZS_LAZY_STEPS_MAX)
+    {
+        pConfig->lazySteps = LZS_LAZY_STEPS_MAX;
+    }
+    if (pConfig->lazySteps > LZS_MAX_LOOK_AHEAD_LEN - pConfig->searchLength)
+    {
+        // Limited by the look-ahead needed for incremental compression
+        pConfig->searchLength = LZS_MAX_LOOK_AHEAD_LEN - pConfig->lazySteps;
+        pConfig->niceLength = LZSMIN(pConfig->niceLength, pConfig->searchLength);
+    }
+}
+
+/**
+ * \brief Return the number of bits needed to encode an offset/length token
+ *
+ * Lengths from MAX_SHORT_LENGTH upwards take one extended length field for
+ * every MAX_EXTENDED_LENGTH bytes, plus one.
  *
- * \return A simple hash of the next two input bytes.
+ * \param offset: Match offset.
+ * \param length: Match length, at least MIN_LENGTH.
+ *
+ * \return uint_fast16_t: Size of the token in bits.
  */
-static inline lzs_input_hash_t inputs_hash_inc(const LzsCompressParameters_t * pParams)
+static inline uint_fast16_t lzs_match_cost(uint_fast16_t offset, size_t length)
 {
-    uint_fast16_t   index0;
-    uint_fast16_t   index1;
+    uint_fast16_t   cost;
 
-    index0 = pParams->historyLatestIdx;
-    index1 = index0 + 1u;
-    if (index1 >= sizeof(pParams->historyBuffer))
+    cost = (offset <= SHORT_OFFSET_MAX) ? (2u + SHORT_OFFSET_BITS) : (2u + LONG_OFFSET_BITS);
+    if (length >= MAX_SHORT_LENGTH)
     {
-        index1 = 0;
+        return cost + length_width[MAX_SHORT_LENGTH] +
+                EXTENDED_LENGTH_BITS * ((length - MAX_SHORT_LENGTH) / MAX_EXTENDED_LENGTH + 1u);
     }
-    return inputs_hash(pParams->historyBuffer[index0], pParams->historyBuffer[index1]);
+    return cost + length_width[length];
 }
 
 /**
- * \brief Count the length of the match betwen two data blocks, up to a maximum match length
+ * \brief Decide whether lazy matching should output literals, to take a later match instead of the current one
  *
- * This doesn't do any circular buffer wrapping.
+ * For one step, the two choices are compared by their cost in bits per input byte encoded.
+ * For more steps, the current match is assumed to be followed by the remainder of
+ * the later match, at the same offset, and the total costs are compared. Comparing
+ * cost per byte would favour the later match too much, and output too many literals.
  *
- * \param aPtr: Pointer to 1st data block.
- * \param bPtr: Pointer to 2nd data block.
- * \param matchMax: Maximum match length to count.
+ * \param best_offset: Offset of the match at the current position.
+ * \param best_length: Length of the match at the current position.
+ * \param steps: Number of literals that would be output before the later match.
+ * \param next_offset: Offset of the later match.
+ * \param next_length: Length of the later match, or 0 if none.
+ *
+ * \return bool: true if the later match is better.
+ */
+static inline bool lzs_lazy_is_better(uint_fast16_t best_offset, uint_fast8_t best_length,
+                                      uint_fast8_t steps, uint_fast16_t next_offset, uint_fast8_t next_length)
+{
+    uint_fast16_t   best_cost;
+    uint_fast16_t   next_cost;
+
+    if (next_length <= best_length)
+    {
+        return false;
+    }
+    best_cost = lzs_match_cost(best_offset, best_length);
+    next_cost = steps * LITERAL_BITS + lzs_match_cost(next_offset, next_length);
+    if (steps > 1u)
+    {
+        // The remainder is at least MIN_LENGTH bytes, since next_length > best_length.
+        best_cost += lzs_match_cost(next_offset, steps + next_length - best_length);
+        return next_cost < best_cost;
+    }
+    return (uint_fast32_t)next_cost * best_length < (uint_fast32_t)best_cost * (steps + next_length);
+}
+
+/**
+ * \brief Decide whether to output a literal without searching for a match, because the input looks incompressible
+ *
+ * After incompressibleRun literals in a row, the input is assumed to be
+ * incompressible, such as encrypted or already compressed data. Then only one
+ * of every LZS_PROBE_INTERVAL positions is searched, to find where matches can
+ * be found again. The other positions are output as literals, and aren't put in
+ * the hash tables.
+ *
+ * \param literalRun: Number of literals in a row before the current position.
+ * \param incompressibleRun: Number of literals in a row after which only some positions are searched, or 0 to search all.
+ *
+ * \return bool: true to output a literal without searching.
+ */
+static inline bool lzs_literal_skip(uint_fast16_t literalRun, uint_fast8_t incompressibleRun)
+{
+    return incompressibleRun != 0 && literalRun >= incompressibleRun &&
+           literalRun < incompressibleRun + LZS_PROBE_INTERVAL - 1u;
+}
+
+/**
+ * \brief Update the number of literals in a row, after a literal or match is output
+ *
+ * The count goes back to incompressibleRun after each LZS_PROBE_INTERVAL positions
+ * with no match, so it doesn't overflow.
  *
- * \return uint_fast8_t: Length of consecutive matching bytes between the two data blocks.
+ * \param literalRun: Number of literals in a row before the token.
+ * \param incompressibleRun: As for lzs_literal_skip().
+ * \param literal: true if the token is a literal.
+ *
+ * \return uint_fast16_t: Number of literals in a row after the token.
  */
-static inline uint_fast8_t lzs_match_len(const uint8_t * aPtr, const uint8_t * bPtr, uint_fast8_t matchMax)
+static inline uint_fast16_t lzs_literal_run(uint_fast16_t literalRun, uint_fast8_t incompressibleRun, bool literal)
 {
-    uint_fast8_t    len;
+    if (!literal)
+    {
+        return 0;
+    }
+    literalRun++;
+    if (literalRun >= incompressibleRun + LZS_PROBE_INTERVAL)
+    {
+        literalRun = incompressibleRun;
+    }
+    return literalRun;
+}
 
+/**
+ * \brief Update the cheapest ways to reach the positions that a match can reach, for optimal parsing
+ *
+ * \param price: Size in bits to encode the block up to each position.
+ * \param fromLength: Length of the literal (1) or match that reaches each position.
+ * \param fromOffset: Offset of the match that reaches each position.
+ * \param pos: Position of the match in the block.
+ * \param offset: Match offset.
+ * \param minLength: Shortest length of the match to consider.
+ * \param maxLength: Longest length of the match to consider.
+ */
+static inline void lzs_optimal_price_match(uint32_t * price, uint16_t * fromLength, uint16_t * fromOffset, size_t pos,
+                                           uint_fast16_t offset, size_t minLength, size_t maxLength)
+{
+    size_t          length;
+    uint32_t        cost;
 
-    for (len = 0; len < matchMax; len++)
+    for (length = minLength; length <= maxLength; length++)
     {
-        if (*aPtr++ != *bPtr++)
+        cost = price[pos] + lzs_match_cost(offset, length);
+        if (cost < price[pos + length])
         {
-            return len;
+            price[pos + length] = cost;
+            fromLength[pos + length] = length;
+            fromOffset[pos + length] = offset;
         }
     }
-    return len;
 }
 
 /**
- * \brief Count the length of the match betwen the next input bytes and a point in the history.
+ * \brief Get the history index from a hash table entry
  *
- * Length is counted up to a maximum match length.
+ * For an empty entry, or an entry of another epoch, the result is at least
+ * LZS_HASH_EPOCH_INC - 1, so it is rejected by any check against the history size.
  *
- * This does wrapping of the indices into the history buffer.
+ * \param entry: Hash table entry.
+ * \param hashEpoch: Tag of valid hash table entries.
  *
- * \param pParams: Pointer to struct to store incremental compression state.
- * \param offset: Reverse offset into the history buffer.
- * \param matchMax: Maximum match length to count.
+ * \return uint_fast16_t: History index.
+ */
+static inline uint_fast16_t lzs_hash_entry_idx(uint16_t entry, uint_fast16_t hashEpoch)
+{
+    return (uint16_t)(entry - hashEpoch);
+}
+
+/**
+ * \brief Move a hash table entry down with the history window, for incremental compression
  *
- * \return uint_fast8_t: Length of consecutive matching bytes between the input and history.
+ * \param entry: Hash table entry.
+ * \param hashEpoch: Tag of valid hash table entries.
+ * \param delta: Distance that the window is moved.
+ *
+ * \return uint16_t: The entry for the moved position, or an invalid entry if
+ *                   the position is no longer in the window, or wasn't valid.
  */
-static inline uint_fast8_t lzs_inc_match_len(LzsCompressParameters_t * pParams, uint_fast16_t offset, uint_fast8_t matchMax)
+static inline uint16_t lzs_hash_entry_slide(uint16_t entry, uint16_t hashEpoch, uint16_t delta)
 {
-    uint_fast16_t   historyReadIdx;
-    uint_fast16_t   historyLookAheadIdx;
-    uint_fast8_t    len;
+    uint16_t        historyIdx;
+
+    // A single unsigned comparison checks both ends of the range. It is
+    // written without branches, so that loops of it can be vectorised.
+    historyIdx = (uint16_t)(entry - hashEpoch - delta);
+    return (historyIdx < (uint16_t)(LZS_COMPRESS_WINDOW_SIZE - delta)) ? (uint16_t)(entry - delta)
+                                                                      : (uint16_t)(LZS_HASH_ENTRY_INVALID_IDX + hashEpoch);
+}
 
+/**
+ * \brief Move hash table entries down with the history window
+ *
+ * \param pDst: Where to put the moved entries.
+ * \param pSrc: Entries to move. They may overlap pDst, if they are not before it.
+ * \param len: Number of entries.
+ * \param hashEpoch: Tag of valid hash table entries.
+ * \param delta: Distance that the window is moved.
+ */
+static void lzs_hash_table_slide(uint16_t * pDst, const uint16_t * pSrc, uint_fast16_t len, uint16_t hashEpoch, uint16_t delta)
+{
+    uint16_t        block[LZS_SLIDE_BLOCK_LEN];
+    uint_fast16_t   i;
+    uint_fast8_t    j;
 
-    historyReadIdx = lzs_idx_dec_wrap(pParams->historyLatestIdx, offset,
-                                        sizeof(pParams->historyBuffer));
-    historyLookAheadIdx = pParams->historyLatestIdx;
 
-    for (len = 0; len < matchMax; ++len )
+    for (i = 0; i + LZS_SLIDE_BLOCK_LEN <= len; i += LZS_SLIDE_BLOCK_LEN)
     {
-        if (pParams->historyBuffer[historyLookAheadIdx] != pParams->historyBuffer[historyReadIdx])
+        for (j = 0; j < LZS_SLIDE_BLOCK_LEN; j++)
         {
-            return len;
+            block[j] = lzs_hash_entry_slide(pSrc[i + j], hashEpoch, delta);
         }
-        historyLookAheadIdx = lzs_idx_inc_wrap(historyLookAheadIdx, 1u,
-                                                sizeof(pParams->historyBuffer));
-        historyReadIdx = lzs_idx_inc_wrap(historyReadIdx, 1u,
-                                                sizeof(pParams->historyBuffer));
+        memcpy(pDst + i, block, sizeof(block));
+    }
+    for ( ; i < len; i++)
+    {
+        pDst[i] = lzs_hash_entry_slide(pSrc[i], hashEpoch, delta);
     }
-    return len;
 }
 
+/**
+ * \brief Get the offset of a window index from the window index of later input bytes
+ *
+ * \param historyLookAheadIdx: Window index of the input bytes.
+ * \param historyReadIdx: Window index from a hash table entry.
+ *
+ * \return uint_fast16_t: Offset, or more than any history length if historyReadIdx
+ *                        isn't before historyLookAheadIdx, which includes invalid entries.
+ */
+static inline uint_fast16_t lzs_window_offset(uint_fast16_t historyLookAheadIdx, uint_fast16_t historyReadIdx)
+{
+    return (historyReadIdx < historyLookAheadIdx) ? (historyLookAheadIdx - historyReadIdx) : LZS_COMPRESS_WINDOW_SIZE;
+}
 
-/*****************************************************************************
- * Functions
- ****************************************************************************/
+/**
+ * \brief Insert a position of the input into the hash tables
+ *
+ * \param hashTable: Table of most recent history index for each hash value.
+ * \param historyHash: Table of previous history index with the same hash, for each history index.
+ * \param inputHash: Hash of the input bytes at the position.
+ * \param historyIdx: History index of the position.
+ * \param hashEpoch: Tag of valid hash table entries.
+ */
+static inline void lzs_hash_insert(uint16_t * hashTable, uint16_t * historyHash, lzs_input_hash_t inputHash, uint_fast16_t historyIdx,
+                                   uint_fast16_t hashEpoch)
+{
+    historyHash[historyIdx] = hashTable[inputHash];
+    hashTable[inputHash] = historyIdx + hashEpoch;
+}
 
 /**
- * \brief Single-call compression
+ * \brief Get the index into historyHash[] of a window index, for single-call compression
  *
- * No state is kept between calls. Compression is expected to complete in a single call.
- * It will stop if/when it reaches the end of either the input or the output buffer.
+ * \param windowIdx: Window index, less than LZS_COMPRESS_WINDOW_SIZE.
  *
- * \param a_pOutData: Pointer to destination buffer for compressed data.
- * \param a_outBufferSize: Size, in bytes, of the destination buffer.
- * \param a_pInData: Pointer to source buffer of data to be compressed.
- * \param a_inLen: Size, in bytes, of source data.
+ * \return uint_fast16_t: The window index modulo LZS_MAX_HISTORY_SIZE.
+ */
+static inline uint_fast16_t lzs_window_ring_idx(uint_fast16_t windowIdx)
+{
+    return (windowIdx >= LZS_MAX_HISTORY_SIZE) ? windowIdx - LZS_MAX_HISTORY_SIZE : windowIdx;
+}
+
+/**
+ * \brief Slide the window of the hash tables forward, if needed to give an input position a window index, for single-call compression
  *
- * \return size_t: Number of bytes of compressed data written to the destination buffer.
+ * The window moves by a multiple of LZS_MAX_HISTORY_SIZE, so that historyHash[]
+ * entries stay at the same index. Entries for positions that are dropped are
+ * invalidated, so that a stale entry can't alias a position in the history.
+ * Positions within LZS_MAX_HISTORY_SIZE before pBytes are kept.
+ *
+ * \param pFinder: Match finder state.
+ * \param pBytes: Pointer to the input position.
+ *
+ * \return uint_fast16_t: Distance that the window indices were moved, capped at
+ *                        LZS_COMPRESS_WINDOW_SIZE, or 0 if they weren't moved.
  */
-size_t lzs_compress(uint8_t * a_pOutData, size_t a_outBufferSize, const uint8_t * a_pInData, size_t a_inLen)
+static inline uint_fast16_t lzs_finder_slide(LzsMatchFinder_t * pFinder, const uint8_t * pBytes)
 {
-    const uint8_t     * inPtr;
-    uint8_t           * outPtr;
-    uint16_t            hashTable[INPUT_HASH_SIZE];
-    uint16_t            historyHash[LZS_MAX_HISTORY_SIZE];
-    size_t              historyLen;
-    size_t              inRemaining;        // Count of remaining bytes of input
-    size_t              outCount;           // Count of output bytes that have been generated
-    uint32_t            bitFieldQueue;      // Code assumes bits will disappear past MS-bit 31 when shifted left.
-    lzs_input_hash_t    inputHash;
-    uint_fast8_t        bitFieldQueueLen;
-    uint_fast16_t       historyReadIdx;
-    uint_fast16_t       historyLatestIdx;
-    uint_fast16_t       offset;
-    uint_fast8_t        matchMax;
-    uint_fast8_t        length;
-    uint_fast16_t       best_offset;
-    uint_fast8_t        best_length;
-    uint16_t            temp16;
-    uint8_t             temp8;
-    SimpleCompressState_t state;
+    size_t          delta;
 
 
-#if 0
-    // TODO: Do initialisation of hash tables for consistency.
-    for (temp16 = 0; temp16 < ARRAY_ENTRIES(hashTable); temp16++)
+    if ((size_t)(pBytes - pFinder->inBase) < LZS_COMPRESS_WINDOW_SIZE)
+    {
+        return 0;
+    }
+    delta = ((size_t)(pBytes - pFinder->inBase) / LZS_MAX_HISTORY_SIZE - 1u) * LZS_MAX_HISTORY_SIZE;
+    pFinder->inBase += delta;
+    // Every entry is dropped by a slide of the whole window, so a longer one is the same.
+    delta = LZSMIN(delta, LZS_COMPRESS_WINDOW_SIZE);
+    lzs_hash_table_slide(pFinder->historyHash, pFinder->historyHash, LZS_MAX_HISTORY_SIZE, pFinder->hashEpoch, delta);
+    lzs_hash_table_slide(pFinder->hashTable, pFinder->hashTable, 1u << pFinder->hashBits, pFinder->hashEpoch, delta);
+    if (pFinder->hashLength > MIN_LENGTH)
     {
-        hashTable[temp16] = (uint16_t)-1;
+        lzs_hash_table_slide(pFinder->hash2Table, pFinder->hash2Table, INPUT_HASH2_SIZE, pFinder->hashEpoch, delta);
     }
+    return delta;
+}
+
+/**
+ * \brief Insert an input position into the hash tables, for single-call compression
+ *
+ * The position is only put in the main hash table if there are enough input
+ * bytes to hash. It is always put in the 2-byte hash table, if that is used.
+ *
+ * \param pFinder: Match finder state.
+ * \param pBytes: Pointer to the input position. At least MIN_LENGTH bytes must be valid,
+ *                and the position must have a window index.
+ */
+static inline void lzs_hash_insert_input(LzsMatchFinder_t * pFinder, const uint8_t * pBytes)
+{
+    uint_fast16_t   windowIdx;
+    lzs_input_hash_t inputHash;
 
-    historyLen = ARRAY_ENTRIES(historyHash);
-    if (historyLen > a_inLen)
+
+    windowIdx = pBytes - pFinder->inBase;
+    if ((size_t)(pFinder->inEnd - pBytes) >= pFinder->hashLength)
     {
-        historyLen = a_inLen;
+        inputHash = inputs_hash(pBytes, pFinder->hashType, pFinder->hashBits);
+        pFinder->historyHash[lzs_window_ring_idx(windowIdx)] = pFinder->hashTable[inputHash];
+        pFinder->hashTable[inputHash] = windowIdx + pFinder->hashEpoch;
     }
-    for (temp16 = 0; temp16 < historyLen; temp16++)
+    if (pFinder->hashLength > MIN_LENGTH)
     {
-        historyHash[temp16] = (uint16_t)-1;
+        pFinder->hash2Table[inputs_hash2(pBytes)] = windowIdx + pFinder->hashEpoch;
     }
-#endif
+}
 
-    historyLen = 0;
-    bitFieldQueue = 0;
-    bitFieldQueueLen = 0;
-    historyLatestIdx = 0;
-    inPtr = a_pInData;
-    outPtr = a_pOutData;
-    inRemaining = a_inLen;
-    outCount = 0;
-    state = COMPRESS_NORMAL;
+/**
+ * \brief Insert into the hash tables all input positions that precede a given position, for single-call compression
+ *
+ * Positions further back than the history size are skipped, since they can't
+ * be matched anyway. Nothing is inserted if hashPtr is already past inPtr, which
+ * happens after lazy matching. The window is slid first, if needed, so that
+ * inPtr has a window index.
+ *
+ * \param pFinder: Match finder state.
+ * \param hashPtr: Pointer to the first input position that isn't yet in the hash tables.
+ * \param inPtr: Pointer to the current input position. The byte at this position must be valid.
+ *
+ * \return const uint8_t *: Updated hashPtr, at least inPtr.
+ */
+static inline const uint8_t * lzs_hash_update(LzsMatchFinder_t * pFinder, const uint8_t * hashPtr, const uint8_t * inPtr)
+{
+    lzs_finder_slide(pFinder, inPtr);
+    if (hashPtr >= inPtr)
+    {
+        return hashPtr;
+    }
+    if ((size_t)(inPtr - hashPtr) > LZS_MAX_HISTORY_SIZE)
+    {
+        hashPtr = inPtr - LZS_MAX_HISTORY_SIZE;
+    }
+    while (hashPtr < inPtr)
+    {
+        lzs_hash_insert_input(pFinder, hashPtr);
+        hashPtr++;
+    }
+    return hashPtr;
+}
 
-    for (;;)
+/**
+ * \brief Check the latest candidate in the 2-byte hash table, for matches shorter than the main hash table finds
+ *
+ * \param pFinder: Match finder state.
+ * \param inPtr: Pointer to the input position. It must have a window index.
+ * \param historyLen: Length of valid history preceding the input position.
+ * \param matchMax: Maximum match length to count. At least MIN_LENGTH bytes must be available at inPtr.
+ * \param pOffset: Set to the offset of the match, if one is found.
+ *
+ * \return uint_fast8_t: Length of the match, or 0 if none.
+ */
+static inline uint_fast8_t lzs_search2(const LzsMatchFinder_t * pFinder, const uint8_t * inPtr, size_t historyLen,
+                                       uint_fast8_t matchMax, uint_fast16_t * pOffset)
+{
+    uint_fast16_t   offset;
+
+    offset = lzs_window_offset(inPtr - pFinder->inBase,
+                               lzs_hash_entry_idx(pFinder->hash2Table[inputs_hash2(inPtr)], pFinder->hashEpoch));
+    if (offset > historyLen)
+    {
+        return 0;
+    }
+    *pOffset = offset;
+    return lzs_match_len(inPtr, inPtr - offset, matchMax);
+}
+
+/**
+ * \brief Search the hash chain for the longest match with the input at a given position, for single-call compression
+ *
+ * If the main hash table hashes more than MIN_LENGTH bytes, and finds no match
+ * that long, the 2-byte hash table is checked for a shorter match.
+ *
+ * \param pFinder: Match finder state.
+ * \param inPtr: Pointer to the input position. It must have a window index.
+ * \param historyLen: Length of valid history preceding the input position.
+ * \param matchMax: Maximum match length to count. At least MIN_LENGTH bytes must be available at inPtr.
+ * \param pConfig: Search parameters.
+ * \param pOffset: Set to the offset of the best match, if one is found.
+ *
+ * \return uint_fast8_t: Length of the best match, or 0 if none.
+ */
+static inline uint_fast8_t lzs_search(const LzsMatchFinder_t * pFinder, const uint8_t * inPtr, size_t historyLen,
+                                      uint_fast8_t matchMax, const LzsCompressConfig_t * pConfig, uint_fast16_t * pOffset)
+{
+    uint_fast16_t   windowIdx;
+    uint_fast16_t   historyReadIdx;
+    uint_fast16_t   nextIdx;
+    uint_fast16_t   offset;
+    uint_fast16_t   offset2;
+    uint_fast16_t   chainCount;
+    uint_fast16_t   temp16;
+    uint_fast8_t    niceLength;
+    uint_fast8_t    length;
+    uint_fast8_t    best_length;
+
+
+    best_length = 0;
+    niceLength = LZSMIN(matchMax, pConfig->niceLength);
+    windowIdx = inPtr - pFinder->inBase;
+    if ((size_t)(pFinder->inEnd - inPtr) < pFinder->hashLength)
+    {
+        offset = LZS_COMPRESS_WINDOW_SIZE;
+    }
+    else
     {
-        /* Copy output bits to output buffer */
-        while (bitFieldQueueLen >= 8u)
+        historyReadIdx = lzs_hash_entry_idx(pFinder->hashTable[inputs_hash(inPtr, pFinder->hashType, pFinder->hashBits)],
+                                            pFinder->hashEpoch);
+        offset = lzs_window_offset(windowIdx, historyReadIdx);
+    }
+    for (chainCount = pConfig->chainMax; offset <= historyLen; )
+    {
+        // Get the next link of the chain from historyHash[] before comparing
+        // this candidate. The compare may call the match-length kernel, which
+        // the compiler can't move the load past, so this takes the load of
+        // the link off the critical path of the walk.
+        nextIdx = lzs_hash_entry_idx(pFinder->historyHash[lzs_window_ring_idx(windowIdx - offset)], pFinder->hashEpoch);
+
+        length = lzs_match_len(inPtr, inPtr - offset, matchMax);
+        if (length > best_length)
         {
-            if (outCount >= a_outBufferSize)
+            *pOffset = offset;
+            best_length = length;
+            if (length >= niceLength)
             {
-                return outCount;
+                break;
             }
-            *outPtr++ = (bitFieldQueue >> (bitFieldQueueLen - 8u));
-            bitFieldQueueLen -= 8u;
-            outCount++;
         }
-        if (inRemaining == 0 && state == COMPRESS_NORMAL)
+        if (--chainCount == 0)
         {
-            /* Exit for loop when all input data is processed. */
             break;
         }
 
-        switch (state)
+        // Calculate new offset. A stale link gives a longer offset than the
+        // history, which ends the loop.
+        temp16 = lzs_window_offset(windowIdx, nextIdx);
+        if (temp16 <= offset)
         {
-            case COMPRESS_NORMAL:
-                /* Look for a match in history */
-                best_length = 0;
-                matchMax = LZSMIN(inRemaining, LZS_SEARCH_MATCH_MAX);
-                if (matchMax >= 2u)
-                {
-                    inputHash = inputs_hash(*inPtr, *(inPtr + 1));
-                    historyReadIdx = hashTable[inputHash];
-                    if (historyReadIdx < historyLen)
-                    {
-                        offset = lzs_idx_delta2_wrap(historyLatestIdx, historyReadIdx, ARRAY_ENTRIES(historyHash));
+            break;
+        }
+        offset = temp16;
+    }
+    if (best_length < pFinder->hashLength && pFinder->hashLength > MIN_LENGTH)
+    {
+        length = lzs_search2(pFinder, inPtr, historyLen, matchMax, &offset2);
+        if (length > best_length)
+        {
+            *pOffset = offset2;
+            best_length = length;
+        }
+    }
+    return best_length;
+}
 
-                        for ( ; offset <= historyLen; )
-                        {
-                            length = lzs_match_len(inPtr, inPtr - offset, matchMax);
-                            if (length > best_length)
-                            {
-                                best_offset = offset;
-                                best_length = length;
-                                if (length >= matchMax)
-                                {
-                                    break;
-                                }
-                            }
-
-                            // Get next offset from historyHash[]
-                            // This involves calculating historyReadIdx to index into it.
-                            historyReadIdx = historyHash[historyReadIdx];
-                            if (historyReadIdx >= historyLen)
-                            {
-                                break;
-                            }
-                            // Calculate new offset.
-                            temp16 = lzs_idx_delta2_wrap(historyLatestIdx, historyReadIdx, ARRAY_ENTRIES(historyHash));
-                            if (temp16 <= offset)
-                            {
-                                break;
-                            }
-                            offset = temp16;
-                        }
-                    }
-                }
-                /* Output */
-                if (best_length < MIN_LENGTH)
-                {
-                    /* Byte-literal */
-                    /* Leading 0 bit indicates offset/length token.
-                     * Following 8 bits are byte-literal. */
-                    bitFieldQueue <<= 9u;
-                    bitFieldQueue |= *inPtr;
-                    bitFieldQueueLen += 9u;
-                    length = 1u;
-                    LZS_DEBUG(("Literal %c (%02X)\n", isprint(*inPtr) ? *inPtr : '?', *inPtr));
-                }
-                else
-                {
-                    LZS_DEBUG(("Best offset %"PRIuFAST16" length %"PRIuFAST8"\n", best_offset, best_length));
-                    /* Offset/length token */
-                    /* 1 bit indicates offset/length token */
-                    bitFieldQueue <<= 1u;
-                    bitFieldQueueLen++;
-                    bitFieldQueue |= 1u;
-                    /* Encode offset */
-                    if (best_offset <= SHORT_OFFSET_MAX)
+/**
+ * \brief Insert the next input position into the binary trees, and find its matches, for single-call compression
+ *
+ * Each hash value has a binary tree of the positions in the history, sorted by
+ * the input bytes that follow them. As in the LZMA binary tree match finder, the
+ * new position becomes the root, and the old tree is split around it on the way
+ * down. Every node visited is compared with the input, and the nodes visited
+ * are the ones that sort closest to it, so each longer match is found with
+ * a walk of logarithmic depth. Nodes are compared up to pTree->lenMax bytes; a
+ * node that matches that far is replaced by the new position.
+ *
+ * If the main hash table hashes more than MIN_LENGTH bytes, the latest
+ * candidate in the 2-byte hash table is checked first, for a shorter match.
+ *
+ * \param pTree: Match finder state. The position is pTree->treePtr, which is advanced past it.
+ * \param pMatches: Set to the matches found, in order of increasing length. It has
+ *                  LZS_TREE_MATCHES_MAX entries. NULL to only insert the position.
+ *
+ * \return size_t: Number of matches found.
+ */
+static inline size_t lzs_tree_insert(LzsTreeFinder_t * pTree, LzsMatch_t * pMatches)
+{
+    const uint8_t     * inPtr;
+    uint32_t          * pSmaller;           // Link to set to the next node that sorts before the input
+    uint32_t          * pLarger;            // Link to set to the next node that sorts after the input
+    uint32_t          * pair;               // Subtrees of the node
+    uint32_t            pos;
+    uint32_t            node;
+    uint32_t            offset;
+    uint32_t            historyLen;
+    size_t              lenLimit;
+    size_t              lenSmaller;         // Length matched by all nodes linked from pSmaller
+    size_t              lenLarger;          // Length matched by all nodes linked from pLarger
+    size_t              len;
+    size_t              best_length;
+    size_t              count;
+    uint_fast16_t       cutCount;
+    lzs_input_hash_t    inputHash;
+
+
+    inPtr = pTree->treePtr++;
+    pos = (uint32_t)(inPtr - pTree->inStart);
+    historyLen = LZSMIN(pos, LZS_MAX_HISTORY_SIZE);
+    lenLimit = LZSMIN((size_t)(pTree->inEnd - inPtr), pTree->lenMax);
+    count = 0;
+    best_length = MIN_LENGTH - 1u;
+    if (lenLimit < MIN_LENGTH)
+    {
+        return 0;
+    }
+
+    if (pTree->hashLength > MIN_LENGTH)
+    {
+        inputHash = inputs_hash2(inPtr);
+        // An empty entry gives offset pos + 1, which is rejected along with older positions.
+        offset = pos + 1u - pTree->head2[inputHash];
+        pTree->head2[inputHash] = pos + 1u;
+        if (pMatches && offset - 1u < historyLen)
+        {
+            len = lzs_match_len(inPtr, inPtr - offset, LZSMIN(lenLimit, pTree->hashLength - 1u));
+            if (len >= MIN_LENGTH)
+            {
+                pMatches[count].length = len;
+                pMatches[count].offset = offset;
+                count++;
+                best_length = len;
+            }
+        }
+    }
+    if ((size_t)(pTree->inEnd - inPtr) < pTree->hashLength)
+    {
+        return count;
+    }
+
+    inputHash = inputs_hash(inPtr, pTree->hashType, pTree->hashBits);
+    node = pTree->head[inputHash];
+    pTree->head[inputHash] = pos + 1u;
+    pSmaller = &pTree->son[(pos % LZS_TREE_WINDOW_SIZE) * 2u];
+    pLarger = pSmaller + 1u;
+    lenSmaller = 0;
+    lenLarger = 0;
+    for (cutCount = pTree->cutMax; ; cutCount--)
+    {
+        offset = pos + 1u - node;
+        if (offset - 1u >= historyLen || cutCount == 0)
+        {
+            *pSmaller = 0;
+            *pLarger = 0;
+            return count;
+        }
+        pair = &pTree->son[((node - 1u) % LZS_TREE_WINDOW_SIZE) * 2u];
+        // All nodes below the links being followed match at least this far.
+        len = LZSMIN(lenSmaller, lenLarger);
+        len += lzs_match_len(inPtr + len, inPtr + len - offset, lenLimit - len);
+        if (len > best_length)
+        {
+            best_length = len;
+            if (pMatches)
+            {
+                pMatches[count].length = len;
+                pMatches[count].offset = offset;
+                count++;
+            }
+        }
+        if (len == lenLimit)
+        {
+            // The node is replaced by the new position, which takes over its subtrees.
+            *pSmaller = pair[0];
+            *pLarger = pair[1];
+            return count;
+        }
+        if (inPtr[len - offset] < inPtr[len])
+        {
+            *pSmaller = node;
+            pSmaller = &pair[1];
+            node = *pSmaller;
+            lenSmaller = len;
+        }
+        else
+        {
+            *pLarger = node;
+            pLarger = &pair[0];
+            node = *pLarger;
+            lenLarger = len;
+        }
+    }
+}
+
+/**
+ * \brief Insert into the binary trees all input positions that precede a given position, for single-call compression
+ *
+ * Positions further back than the history size are skipped, since they can't
+ * be matched anyway. Nothing is done if the trees are already past inPtr, which
+ * happens after lazy matching.
+ *
+ * \param pTree: Match finder state.
+ * \param inPtr: Pointer to the current input position.
+ */
+static inline void lzs_tree_update(LzsTreeFinder_t * pTree, const uint8_t * inPtr)
+{
+    if (pTree->treePtr < inPtr && (size_t)(inPtr - pTree->treePtr) > LZS_MAX_HISTORY_SIZE)
+    {
+        pTree->treePtr = inPtr - LZS_MAX_HISTORY_SIZE;
+    }
+    while (pTree->treePtr < inPtr)
+    {
+        lzs_tree_insert(pTree, NULL);
+    }
+}
+
+/**
+ * \brief Search the binary trees for the longest match with the input at a given position, for single-call compression
+ *
+ * The position and those before it are inserted into the trees. A position can
+ * only be inserted once, so if lazy matching has already searched it, the
+ * result of that search is given again.
+ *
+ * \param pTree: Match finder state.
+ * \param inPtr: Pointer to the input position. At least MIN_LENGTH bytes must be available.
+ * \param pOffset: Set to the offset of the best match, if one is found.
+ *
+ * \return uint_fast8_t: Length of the best match, or 0 if none.
+ */
+static inline uint_fast8_t lzs_tree_search(LzsTreeFinder_t * pTree, const uint8_t * inPtr, uint_fast16_t * pOffset)
+{
+    LzsMatch_t          matches[LZS_TREE_MATCHES_MAX];
+    size_t              count;
+
+    if (inPtr >= pTree->treePtr)
+    {
+        lzs_tree_update(pTree, inPtr);
+        count = lzs_tree_insert(pTree, matches);
+        pTree->latest.length = 0;
+        if (count)
+        {
+            pTree->latest = matches[count - 1u];
+        }
+    }
+    LZS_ASSERT(inPtr + 1u == pTree->treePtr);
+    *pOffset = pTree->latest.offset;
+    return pTree->latest.length;
+}
+
+/**
+ * \brief Add a run of 1 bits to the output bit queue
+ *
+ * Whole bytes of ones are written to the output buffer directly, so that the
+ * extended length fields of a very long match cost little more than a memset.
+ *
+ * \param pWriter: Output state.
+ * \param count: Number of 1 bits to add.
+ *
+ * \return bool: false if the output buffer is full.
+ */
+static inline bool lzs_bits_put_ones(LzsBitWriter_t * pWriter, size_t count)
+{
+    size_t          bytes;
+
+    if (count >= 8u)
+    {
+        /* Fill out the byte that the queue has started, leaving fewer than 8
+         * bits in the queue, all ones. Then whole bytes of ones can be written
+         * to the output directly, ahead of them. */
+        if (!lzs_bits_put(pWriter, 0xFFu, 8u) || !lzs_bits_flush(pWriter))
+        {
+            return false;
+        }
+        count -= 8u;
+        bytes = count / 8u;
+        count %= 8u;
+        if (bytes > pWriter->outBufferSize - pWriter->outCount)
+        {
+            bytes = pWriter->outBufferSize - pWriter->outCount;
+            memset(pWriter->outPtr, 0xFF, bytes);
+            pWriter->outPtr += bytes;
+            pWriter->outCount += bytes;
+            return false;
+        }
+        memset(pWriter->outPtr, 0xFF, bytes);
+        pWriter->outPtr += bytes;
+        pWriter->outCount += bytes;
+    }
+    return lzs_bits_put(pWriter, (1u << count) - 1u, count);
+}
+
+/**
+ * \brief Output an offset/length token, including any extended length fields
+ *
+ * \param pWriter: Output state.
+ * \param offset: Match offset.
+ * \param length: Match length, at least MIN_LENGTH.
+ *
+ * \return bool: false if the output buffer is full.
+ */
+static inline bool lzs_bits_put_match(LzsBitWriter_t * pWriter, uint_fast16_t offset, size_t length)
+{
+    bool            ok;
+
+    LZS_DEBUG(("Offset %"PRIuFAST16" length %zu\n", offset, length));
+    /* 1 bit indicates offset/length token, then 1 bit for short offset, or 0 bit for long offset */
+    if (offset <= SHORT_OFFSET_MAX)
+    {
+        ok = lzs_bits_put(pWriter, (3u << SHORT_OFFSET_BITS) | offset, 2u + SHORT_OFFSET_BITS);
+    }
+    else
+    {
+        ok = lzs_bits_put(pWriter, (2u << LONG_OFFSET_BITS) | offset, 2u + LONG_OFFSET_BITS);
+    }
+    if (length < MAX_SHORT_LENGTH)
+    {
+        return ok && lzs_bits_put(pWriter, length_value[length], length_width[length]);
+    }
+    ok = ok && lzs_bits_put(pWriter, length_value[MAX_SHORT_LENGTH], length_width[MAX_SHORT_LENGTH]);
+    length -= MAX_SHORT_LENGTH;
+    /* Each full extended length field is all ones, so a long run of them is
+     * output in bulk. The final field is less than MAX_EXTENDED_LENGTH. */
+    ok = ok && lzs_bits_put_ones(pWriter, (length / MAX_EXTENDED_LENGTH) * EXTENDED_LENGTH_BITS);
+    return ok && lzs_bits_put(pWriter, length % MAX_EXTENDED_LENGTH, EXTENDED_LENGTH_BITS);
+}
+
+/**
+ * \brief Count the length of the match betwen input bytes in the look-ahead and a point in the history.
+ *
+ * Length is counted up to a maximum match length. The history window is
+ * linear, so the match-length kernel can always be used.
+ *
+ * \param pWindow: History window: pParams->historyBuffer, or the caller's input on the bulk input path.
+ * \param historyLookAheadIdx: Index into the history buffer of the input bytes.
+ * \param offset: Reverse offset into the history buffer, from historyLookAheadIdx.
+ * \param matchMax: Maximum match length to count.
+ *
+ * \return uint_fast8_t: Length of consecutive matching bytes between the input and history.
+ */
+static inline uint_fast8_t lzs_inc_match_len(const uint8_t * pWindow, uint_fast16_t historyLookAheadIdx, uint_fast16_t offset, uint_fast8_t matchMax)
+{
+    return lzs_match_len(&pWindow[historyLookAheadIdx], &pWindow[historyLookAheadIdx - offset], matchMax);
+}
+
+/**
+ * \brief Slide the history window positions back, so that the history starts at position 0, for incremental compression
+ *
+ * The positions of the latest LZS_MAX_HISTORY_SIZE bytes of history, and the
+ * look-ahead, are moved down. The hash tables are moved with them, and their
+ * entries for positions that are dropped are invalidated. The caller moves
+ * the window's bytes. pParams->historyLatestIdx must be at least LZS_MAX_HISTORY_SIZE.
+ *
+ * \param pParams: Pointer to struct to store incremental compression state.
+ *
+ * \return uint_fast16_t: Distance that the positions were moved.
+ */
+static uint_fast16_t lzs_inc_slide(LzsCompressParameters_t * pParams)
+{
+    uint16_t        delta;
+    uint_fast16_t   keepLen;
+
+
+    delta = pParams->historyLatestIdx - LZS_MAX_HISTORY_SIZE;
+    if (delta == 0)
+    {
+        return 0;
+    }
+    keepLen = pParams->historyLookAheadIdx - delta;
+    LZS_DEBUG(("Slide window by %u\n", delta));
+    lzs_hash_table_slide(pParams->historyHash, pParams->historyHash + delta, keepLen, pParams->hashEpoch, delta);
+    lzs_hash_table_slide(pParams->hashTable, pParams->hashTable, 1u << pParams->config.hashBits, pParams->hashEpoch, delta);
+    if (hashTypeLength[pParams->config.hashType] > MIN_LENGTH)
+    {
+        lzs_hash_table_slide(pParams->hash2Table, pParams->hash2Table, ARRAY_ENTRIES(pParams->hash2Table), pParams->hashEpoch, delta);
+    }
+    pParams->historyLatestIdx -= delta;
+    pParams->historyLookAheadIdx -= delta;
+    return delta;
+}
+
+/**
+ * \brief Insert a position in the history buffer into the hash tables, for incremental compression
+ *
+ * The position is only put in the main hash table if there are enough bytes
+ * to hash. It is always put in the 2-byte hash table, if that is used.
+ *
+ * \param pParams: Pointer to struct to store incremental compression state.
+ * \param pWindow: History window: pParams->historyBuffer, or the caller's input on the bulk input path.
+ * \param historyIdx: Index into the history buffer of the position.
+ * \param available: Number of valid bytes at the position, at least MIN_LENGTH.
+ */
+static inline void lzs_inc_hash_insert(LzsCompressParameters_t * pParams, const uint8_t * pWindow, uint_fast16_t historyIdx,
+                                       uint_fast16_t available)
+{
+    const uint8_t     * pBytes;
+
+    pBytes = &pWindow[historyIdx];
+    if (available >= hashTypeLength[pParams->config.hashType])
+    {
+        lzs_hash_insert(pParams->hashTable, pParams->historyHash,
+                        inputs_hash(pBytes, pParams->config.hashType, pParams->config.hashBits), historyIdx, pParams->hashEpoch);
+    }
+    if (hashTypeLength[pParams->config.hashType] > MIN_LENGTH)
+    {
+        pParams->hash2Table[inputs_hash2(pBytes)] = historyIdx + pParams->hashEpoch;
+    }
+}
+
+/**
+ * \brief Insert into the hash tables all positions that precede a given look-ahead position, for incremental compression
+ *
+ * These are the pParams->historyUnhashedLen positions just before pParams->historyLatestIdx,
+ * then the look-ahead positions before lookAheadPos that are not yet in the hash tables.
+ * The byte at lookAheadPos must be valid.
+ *
+ * \param pParams: Pointer to struct to store incremental compression state.
+ * \param pWindow: History window: pParams->historyBuffer, or the caller's input on the bulk input path.
+ * \param lookAheadPos: Position in the look-ahead, 0 for pParams->historyLatestIdx.
+ */
+static inline void lzs_inc_hash_update(LzsCompressParameters_t * pParams, const uint8_t * pWindow, uint_fast8_t lookAheadPos)
+{
+    uint_fast16_t   historyIdx;
+
+    historyIdx = pParams->historyLatestIdx - pParams->historyUnhashedLen;
+    for ( ; pParams->historyUnhashedLen; pParams->historyUnhashedLen--)
+    {
+        lzs_inc_hash_insert(pParams, pWindow, historyIdx, pParams->historyUnhashedLen + pParams->lookAheadLen);
+        historyIdx++;
+    }
+    for ( ; pParams->lookAheadHashedLen < lookAheadPos; pParams->lookAheadHashedLen++)
+    {
+        lzs_inc_hash_insert(pParams, pWindow, pParams->historyLatestIdx + pParams->lookAheadHashedLen,
+                            pParams->lookAheadLen - pParams->lookAheadHashedLen);
+    }
+}
+
+/**
+ * \brief Search the hash chain for the longest match with input in the look-ahead, for incremental compression
+ *
+ * If the main hash table hashes more than MIN_LENGTH bytes, and finds no match
+ * that long, the 2-byte hash table is checked for a shorter match.
+ *
+ * \param pParams: Pointer to struct to store incremental compression state.
+ * \param pWindow: History window: pParams->historyBuffer, or the caller's input on the bulk input path.
+ * \param historyLookAheadIdx: Index into the history buffer of the input bytes.
+ * \param historyLen: Length of valid history preceding the input bytes.
+ * \param available: Number of valid bytes at historyLookAheadIdx.
+ * \param matchMax: Maximum match length to count. At least MIN_LENGTH bytes must be available.
+ * \param pOffset: Set to the offset of the best match, if one is found.
+ *
+ * \return uint_fast8_t: Length of the best match, or 0 if none.
+ */
+static inline uint_fast8_t lzs_inc_search(LzsCompressParameters_t * pParams, const uint8_t * pWindow, uint_fast16_t historyLookAheadIdx,
+                                          uint_fast16_t historyLen, uint_fast8_t available, uint_fast8_t matchMax, uint_fast16_t * pOffset)
+{
+    const uint8_t     * pBytes;
+    uint_fast16_t       historyReadIdx;
+    uint_fast16_t       nextIdx;
+    uint_fast16_t       offset;
+    uint_fast16_t       chainCount;
+    uint_fast16_t       temp16;
+    uint_fast8_t        niceLength;
+    uint_fast8_t        hashLength;
+    uint_fast8_t        length;
+    uint_fast8_t        best_length;
+
+
+    best_length = 0;
+    niceLength = LZSMIN(matchMax, pParams->config.niceLength);
+    hashLength = hashTypeLength[pParams->config.hashType];
+    pBytes = &pWindow[historyLookAheadIdx];
+    if (available >= hashLength)
+    {
+        historyReadIdx = lzs_hash_entry_idx(pParams->hashTable[inputs_hash(pBytes, pParams->config.hashType, pParams->config.hashBits)],
+                                            pParams->hashEpoch);
+        offset = lzs_window_offset(historyLookAheadIdx, historyReadIdx);
+
+        for (chainCount = pParams->config.chainMax; offset <= historyLen; )
+        {
+            // Get the next link of the chain from historyHash[] before comparing
+            // this candidate, as in lzs_search().
+            nextIdx = lzs_hash_entry_idx(pParams->historyHash[historyReadIdx], pParams->hashEpoch);
+
+            length = lzs_inc_match_len(pWindow, historyLookAheadIdx, offset, matchMax);
+            if (length > best_length)
+            {
+                *pOffset = offset;
+                best_length = length;
+                if (length >= niceLength)
+                {
+                    break;
+                }
+            }
+            if (--chainCount == 0)
+            {
+                break;
+            }
+
+            historyReadIdx = nextIdx;
+
+            // Calculate new offset.
+            temp16 = lzs_window_offset(historyLookAheadIdx, historyReadIdx);
+            if (temp16 <= offset)
+            {
+                break;
+            }
+            offset = temp16;
+        }
+    }
+    if (best_length < hashLength && hashLength > MIN_LENGTH)
+    {
+        // Check the latest candidate in the 2-byte hash table, for a shorter match.
+        historyReadIdx = lzs_hash_entry_idx(pParams->hash2Table[inputs_hash2(pBytes)], pParams->hashEpoch);
+        offset = lzs_window_offset(historyLookAheadIdx, historyReadIdx);
+        if (offset <= historyLen)
+        {
+            length = lzs_inc_match_len(pWindow, historyLookAheadIdx, offset, matchMax);
+            if (length > best_length)
+            {
+                *pOffset = offset;
+                best_length = length;
+            }
+        }
+    }
+    return best_length;
+}
+
+
+/**
+ * \brief Get the hash epoch for a call of single-call compression with a workspace, clearing the hash tables if needed
+ *
+ * A workspace that has been used before with the same hash table size only
+ * needs a new epoch, which invalidates the entries of earlier calls. Otherwise,
+ * or when the epochs run out, the hash tables are cleared. historyHash[] needn't
+ * be cleared, since each entry is set before it is reached from a hash table.
+ *
+ * \param pWorkspace: Workspace of LZS_WORKSPACE_SIZE(hashBits) bytes.
+ * \param hashBits: Hash table size, as log2 of the number of entries.
+ *
+ * \return uint_fast16_t: Tag of valid hash table entries for this call.
+ */
+static inline uint_fast16_t lzs_workspace_epoch(void * pWorkspace, uint_fast8_t hashBits)
+{
+    LzsWorkspaceHeader_t  * pHeader;
+    uint16_t              * pHashTable;
+
+    pHeader = (LzsWorkspaceHeader_t *)pWorkspace;
+    if (pHeader->signature[0] == LZS_WORKSPACE_SIGNATURE0 && pHeader->signature[1] == LZS_WORKSPACE_SIGNATURE1 &&
+        pHeader->hashBits == hashBits && pHeader->hashEpoch != LZS_HASH_EPOCH_LAST)
+    {
+        pHeader->hashEpoch += LZS_HASH_EPOCH_INC;
+    }
+    else
+    {
+        pHashTable = (uint16_t *)pWorkspace + LZS_WORKSPACE_HEADER_LEN;
+        memset(pHashTable, 0xFF, sizeof(uint16_t) << hashBits);
+        memset(pHashTable + (1u << hashBits) + LZS_MAX_HISTORY_SIZE, 0xFF, sizeof(uint16_t) * INPUT_HASH2_SIZE);
+        pHeader->signature[0] = LZS_WORKSPACE_SIGNATURE0;
+        pHeader->signature[1] = LZS_WORKSPACE_SIGNATURE1;
+        pHeader->hashBits = hashBits;
+        pHeader->hashEpoch = 0;
+    }
+    return pHeader->hashEpoch;
+}
+
+/**
+ * \brief Set up the binary tree match finder for a call of single-call compression, in a workspace
+ *
+ * The hash tables are cleared. The tree nodes needn't be, since each is set
+ * when its position is inserted, before it can be reached. The trees overwrite
+ * the hash chain tables of the workspace, so its signature is cleared too.
+ *
+ * \param pTree: Match finder state to set up.
+ * \param pWorkspace: Workspace of LZS_TREE_WORKSPACE_SIZE(pConfig->hashBits) bytes.
+ * \param pConfig: Compression parameters, already checked.
+ * \param a_pInData: Pointer to source buffer of data to be compressed.
+ * \param a_inLen: Size, in bytes, of source data.
+ * \param lenMax: Maximum match length to search for.
+ */
+static inline void lzs_tree_init(LzsTreeFinder_t * pTree, void * pWorkspace, const LzsCompressConfig_t * pConfig,
+                                 const uint8_t * a_pInData, size_t a_inLen, uint_fast8_t lenMax)
+{
+    ((LzsWorkspaceHeader_t *)pWorkspace)->signature[0] = 0;
+    pTree->head = (uint32_t *)((uint16_t *)pWorkspace + LZS_WORKSPACE_HEADER_LEN);
+    pTree->head2 = pTree->head + (1u << pConfig->hashBits);
+    pTree->son = pTree->head2 + INPUT_HASH2_SIZE;
+    memset(pTree->head, 0, sizeof(uint32_t) * ((1u << pConfig->hashBits) + INPUT_HASH2_SIZE));
+    pTree->inStart = a_pInData;
+    pTree->inEnd = a_pInData + a_inLen;
+    pTree->treePtr = a_pInData;
+    pTree->latest.length = 0;
+    pTree->latest.offset = 0;
+    pTree->cutMax = pConfig->chainMax;
+    pTree->lenMax = lenMax;
+    pTree->hashType = pConfig->hashType;
+    pTree->hashBits = pConfig->hashBits;
+    pTree->hashLength = hashTypeLength[pConfig->hashType];
+}
+
+/**
+ * \brief Write out an end marker that is in the bit field queue, for incremental compression
+ *
+ * As much of it as fits is written to the output buffer. Once it has all been
+ * written, the LZS_C_STATUS_END_MARKER status is set.
+ *
+ * \param pParams: Pointer to struct to store incremental compression state.
+ *
+ * \return size_t: Number of bytes written to the output buffer.
+ */
+static size_t lzs_inc_end_marker_write(LzsCompressParameters_t * pParams)
+{
+    size_t              bytes;
+
+    bytes = lzs_bits_write(pParams->outPtr, pParams->outLength, pParams->bitFieldQueue, pParams->bitFieldQueueLen);
+    pParams->outPtr += bytes;
+    pParams->outLength -= bytes;
+    pParams->bitFieldQueueLen -= 8u * bytes;
+    if (pParams->bitFieldQueueLen == 0)
+    {
+        pParams->state = COMPRESS_NORMAL;
+        pParams->status |= LZS_C_STATUS_END_MARKER;
+    }
+    else
+    {
+        pParams->status |= LZS_C_STATUS_NO_OUTPUT_BUFFER_SPACE;
+    }
+    return bytes;
+}
+
+/**
+ * \brief Add an end marker to the bit field queue, and write it out, for incremental compression
+ *
+ * All input must have been encoded, and the queue must hold less than a byte.
+ * The end marker is padded with zeros to a byte boundary. For a full flush,
+ * the history is reset after the end marker, so that later data doesn't refer
+ * to data before it.
+ *
+ * \param pParams: Pointer to struct to store incremental compression state.
+ * \param flush: LZS_FLUSH_SYNC, optionally with LZS_FLUSH_FULL.
+ *
+ * \return size_t: Number of bytes written to the output buffer.
+ */
+static size_t lzs_inc_end_marker(LzsCompressParameters_t * pParams, unsigned int flush)
+{
+    uint64_t            bitFieldQueue;
+    uint_fast8_t        bitFieldQueueLen;
+    uint_fast8_t        status;
+
+    /* Make end marker, which is like a short offset with value 0, padded out
+     * with 0 to 7 extra zeros to reach a byte boundary. That is,
+     * 0b110000000 */
+    bitFieldQueueLen = (pParams->bitFieldQueueLen + 2u + SHORT_OFFSET_BITS + 7u) / 8u * 8u;
+    bitFieldQueue = pParams->bitFieldQueue << (bitFieldQueueLen - pParams->bitFieldQueueLen);
+    bitFieldQueue |= (uint64_t)3u << (bitFieldQueueLen - pParams->bitFieldQueueLen - 2u);
+    if (flush & LZS_FLUSH_FULL)
+    {
+        LZS_DEBUG(("Full flush\n"));
+        status = pParams->status;
+        lzs_compress_reset(pParams);
+        pParams->status = status;
+    }
+    pParams->bitFieldQueue = bitFieldQueue;
+    pParams->bitFieldQueueLen = bitFieldQueueLen;
+    pParams->state = COMPRESS_END_MARKER;
+    return lzs_inc_end_marker_write(pParams);
+}
+
+
+/*****************************************************************************
+ * Functions
+ ****************************************************************************/
+
+/**
+ * \brief Get the compression parameters for a compression level
+ *
+ * This can be used as a starting point for a custom configuration, to pass to
+ * `lzs_compress_config()` or `lzs_compress_init_config()`.
+ *
+ * \param pConfig: Pointer to compression parameters to fill in.
+ * \param level: Compression level, from LZS_COMPRESS_LEVEL_FASTEST to LZS_COMPRESS_LEVEL_MAX.
+ *               Values outside this range are clamped to it.
+ */
+void lzs_compress_level_config(LzsCompressConfig_t * pConfig, unsigned int level)
+{
+    if (level < LZS_COMPRESS_LEVEL_FASTEST)
+    {
+        level = LZS_COMPRESS_LEVEL_FASTEST;
+    }
+    if (level > LZS_COMPRESS_LEVEL_MAX)
+    {
+        level = LZS_COMPRESS_LEVEL_MAX;
+    }
+    *pConfig = levelConfig[level];
+}
+
+/**
+ * \brief Single-call compression, with optimal parsing
+ *
+ * The input is processed in blocks of up to LZS_OPTIMAL_BLOCK_SIZE bytes. For
+ * each block, every match found by the match finder is considered at every
+ * position, and the sequence of literals and matches with the smallest total
+ * size in bits is found by dynamic programming. The last LZS_OPTIMAL_NICE_LENGTH
+ * bytes of a block are parsed again as part of the next block, so that matches
+ * aren't cut short at block boundaries. Those bytes are removed from the hash
+ * tables before that, so the tables are as if they had not been searched.
+ * With the binary trees, which can't be undone like that, the matches found at
+ * those bytes are kept instead.
+ *
+ * A match of LZS_OPTIMAL_NICE_LENGTH bytes or more is taken as soon as it is
+ * found, and ends the block. This limits the time spent on long runs, and
+ * lets a long match use extended lengths rather than being split up.
+ *
+ * Parameters are as for lzs_compress_config_ws(). pConfig->chainMax limits the hash
+ * chain candidates, or tree nodes, checked at each position. Matches are found
+ * with either pFinder, which holds the hash tables, or pTree, which holds the
+ * binary trees; the other is NULL. pTables is in the workspace, after them.
+ *
+ * \return size_t: Number of bytes of compressed data written to the destination buffer.
+ */
+static size_t lzs_compress_optimal(uint8_t * a_pOutData, size_t a_outBufferSize, const uint8_t * a_pInData, size_t a_inLen,
+                                   const LzsCompressConfig_t * pConfig, LzsMatchFinder_t * pFinder, LzsTreeFinder_t * pTree,
+                                   LzsOptimalTables_t * pTables)
+{
+    const uint8_t     * inPtr;              // Start of the current block
+    const uint8_t     * hashPtr;            // First input position that isn't yet in the hash tables
+    uint32_t          * price = pTables->price;
+    uint16_t          * fromLength = pTables->fromLength;
+    uint16_t          * fromOffset = pTables->fromOffset;
+    uint16_t            savedHash[LZS_OPTIMAL_NICE_LENGTH];     // historyHash[] entries replaced by positions in the overlap
+    uint16_t            savedHash2[LZS_OPTIMAL_NICE_LENGTH];    // hash2Table[] entries replaced by positions in the overlap
+    LzsMatch_t          matches[LZS_TREE_MATCHES_MAX];          // Matches found in the binary trees at one position
+    LzsMatch_t       (* overlapMatches)[LZS_TREE_MATCHES_MAX] = pTables->overlapMatches;
+    uint8_t             overlapCount[LZS_OPTIMAL_NICE_LENGTH];  // Number of matches found at the positions in the overlap
+    LzsMatch_t        * pMatches;
+    const uint8_t     * overlapPtr = NULL;  // Start of the overlap of the previous block
+    LzsBitWriter_t      writer;
+    size_t              inRemaining;        // Count of remaining bytes of input
+    size_t              blockLen;
+    size_t              commitLen;          // Length of the block to output; the rest is parsed again with the next block
+    size_t              overlapStart;       // Start of the part of the block that may be parsed again
+    size_t              historyLen;
+    size_t              pos;
+    size_t              matchMax;
+    size_t              length;
+    size_t              best_length;
+    size_t              long_length;
+    size_t              short_length;       // Longest match length with a short offset
+    size_t              count;
+    size_t              temp;
+    uint_fast16_t       windowIdx;
+    uint_fast16_t       historyReadIdx;
+    uint_fast16_t       offset;
+    uint_fast16_t       long_offset = 0;
+    uint_fast16_t       chainCount;
+    uint_fast16_t       temp16;
+
+
+    lzs_bits_init(&writer, a_pOutData, a_outBufferSize);
+    inPtr = a_pInData;
+    hashPtr = a_pInData;
+    inRemaining = a_inLen;
+
+    while (inRemaining)
+    {
+        blockLen = LZSMIN(inRemaining, LZS_OPTIMAL_BLOCK_SIZE);
+        overlapStart = (blockLen < inRemaining) ? blockLen - LZS_OPTIMAL_NICE_LENGTH : blockLen;
+        price[0] = 0;
+        fromLength[0] = 0;
+        fromOffset[0] = 0;
+        for (pos = 1u; pos <= blockLen; pos++)
+        {
+            price[pos] = LZS_OPTIMAL_PRICE_MAX;
+        }
+
+        /* Find the cheapest way to reach each position of the block */
+        long_length = 0;
+        for (pos = 0; pos < blockLen; pos++)
+        {
+            /* Byte-literal */
+            if (price[pos] + LITERAL_BITS < price[pos + 1u])
+            {
+                price[pos + 1u] = price[pos] + LITERAL_BITS;
+                fromLength[pos + 1u] = 1u;
+                fromOffset[pos + 1u] = 0;
+            }
+            matchMax = inRemaining - pos;
+            if (matchMax < MIN_LENGTH)
+            {
+                continue;
+            }
+
+            best_length = MIN_LENGTH - 1u;
+            if (pTree)
+            {
+                /* Matches from the binary trees. A position in the overlap can't
+                 * be inserted again, so its matches are kept for the next block. */
+                if (inPtr + pos < pTree->treePtr)
+                {
+                    pMatches = overlapMatches[inPtr + pos - overlapPtr];
+                    count = overlapCount[inPtr + pos - overlapPtr];
+                }
+                else
+                {
+                    pMatches = (pos >= overlapStart) ? overlapMatches[pos - overlapStart] : matches;
+                    lzs_tree_update(pTree, inPtr + pos);
+                    count = lzs_tree_insert(pTree, pMatches);
+                    if (pos >= overlapStart)
                     {
-                        /* Short offset */
-                        LZS_DEBUG(("Short offset %"PRIuFAST16"\n", best_offset));
-                        bitFieldQueue <<= (1u + SHORT_OFFSET_BITS);
-                        /* Initial 1 bit indicates short offset */
-                        bitFieldQueue |= (1u << SHORT_OFFSET_BITS) | best_offset;
-                        bitFieldQueueLen += (1u + SHORT_OFFSET_BITS);
+                        overlapCount[pos - overlapStart] = count;
                     }
-                    else
+                }
+                /* Matches come in order of increasing length. A match is only
+                 * useful for lengths longer than all previous ones, or if it has
+                 * a short offset, longer than all previous short offset ones. */
+                short_length = MIN_LENGTH - 1u;
+                for (temp = 0; temp < count; temp++)
+                {
+                    length = pMatches[temp].length;
+                    offset = pMatches[temp].offset;
+                    if (length >= LZS_OPTIMAL_NICE_LENGTH)
                     {
-                        /* Long offset */
-                        LZS_DEBUG(("Long offset %"PRIuFAST16"\n", best_offset));
-                        bitFieldQueue <<= (1u + LONG_OFFSET_BITS);
-                        /* Initial 0 bit indicates long offset */
-                        bitFieldQueue |= best_offset;
-                        bitFieldQueueLen += (1u + LONG_OFFSET_BITS);
+                        long_length = length + lzs_match_len(inPtr + pos + length, inPtr + pos + length - offset, matchMax - length);
+                        long_offset = offset;
+                        break;
+                    }
+                    lzs_optimal_price_match(price, fromLength, fromOffset, pos, offset,
+                                            ((offset <= SHORT_OFFSET_MAX) ? short_length : best_length) + 1u,
+                                            LZSMIN(length, blockLen - pos));
+                    best_length = length;
+                    if (offset <= SHORT_OFFSET_MAX)
+                    {
+                        short_length = length;
+                    }
+                }
+            }
+            else
+            {
+                /* Matches. Candidates come in order of increasing offset, so a
+                 * candidate is only useful for lengths longer than all previous ones. */
+                historyLen = LZSMIN((size_t)(inPtr + pos - a_pInData), LZS_MAX_HISTORY_SIZE);
+                if (pos <= overlapStart)
+                {
+                    hashPtr = lzs_hash_update(pFinder, hashPtr, inPtr + pos);
+                }
+                else
+                {
+                    // Save the entries that are replaced, to be able to undo the insertion.
+                    // If the window slides, the saved entries must slide with it.
+                    temp16 = lzs_finder_slide(pFinder, inPtr + pos);
+                    if (temp16)
+                    {
+                        lzs_hash_table_slide(savedHash, savedHash, pos - 1u - overlapStart, pFinder->hashEpoch, temp16);
+                        lzs_hash_table_slide(savedHash2, savedHash2, pos - 1u - overlapStart, pFinder->hashEpoch, temp16);
+                    }
+                    savedHash[pos - 1u - overlapStart] = pFinder->historyHash[lzs_window_ring_idx(inPtr + pos - 1u - pFinder->inBase)];
+                    savedHash2[pos - 1u - overlapStart] = pFinder->hash2Table[inputs_hash2(inPtr + pos - 1u)];
+                    lzs_hash_insert_input(pFinder, inPtr + pos - 1u);
+                    hashPtr++;
+                }
+                windowIdx = inPtr + pos - pFinder->inBase;
+                offset = LZS_COMPRESS_WINDOW_SIZE;
+                if (matchMax >= pFinder->hashLength)
+                {
+                    historyReadIdx = lzs_hash_entry_idx(pFinder->hashTable[inputs_hash(inPtr + pos, pFinder->hashType, pFinder->hashBits)],
+                                                        pFinder->hashEpoch);
+                    offset = lzs_window_offset(windowIdx, historyReadIdx);
+                }
+                for (chainCount = pConfig->chainMax; offset <= historyLen; )
+                {
+                    length = lzs_match_len(inPtr + pos, inPtr + pos - offset, matchMax);
+                    if (length >= LZS_OPTIMAL_NICE_LENGTH)
+                    {
+                        long_length = length;
+                        long_offset = offset;
+                        break;
+                    }
+                    lzs_optimal_price_match(price, fromLength, fromOffset, pos, offset,
+                                            best_length + 1u, LZSMIN(length, blockLen - pos));
+                    if (length > best_length)
+                    {
+                        best_length = length;
+                    }
+                    if (--chainCount == 0)
+                    {
+                        break;
                     }
-                    /* Encode length */
-                    length = LZSMIN(best_length, MAX_SHORT_LENGTH);
-                    LZS_DEBUG(("Length %"PRIuFAST8"\n", length));
-                    temp8 = length_width[length];
-                    bitFieldQueue <<= temp8;
-                    bitFieldQueue |= length_value[length];
-                    bitFieldQueueLen += temp8;
 
-                    if (length == MAX_SHORT_LENGTH)
+                    // Get next offset from historyHash[]. A stale link gives a
+                    // longer offset than the history, which ends the loop.
+                    historyReadIdx = lzs_hash_entry_idx(pFinder->historyHash[lzs_window_ring_idx(windowIdx - offset)],
+                                                        pFinder->hashEpoch);
+                    temp16 = lzs_window_offset(windowIdx, historyReadIdx);
+                    if (temp16 <= offset)
                     {
-                        state = COMPRESS_EXTENDED;
+                        break;
                     }
+                    offset = temp16;
                 }
+                if (pFinder->hashLength > MIN_LENGTH && !long_length)
+                {
+                    /* Matches shorter than the main hash table finds. This candidate
+                     * may not have the smallest offset, so compare every length. */
+                    length = lzs_search2(pFinder, inPtr + pos, historyLen,
+                                         LZSMIN(matchMax, pFinder->hashLength - 1u), &offset);
+                    lzs_optimal_price_match(price, fromLength, fromOffset, pos, offset, MIN_LENGTH, LZSMIN(length, blockLen - pos));
+                }
+            }
+            if (long_length)
+            {
+                // End the block here, and follow it with the long match.
+                blockLen = pos;
                 break;
-            case COMPRESS_EXTENDED:
-                matchMax = LZSMIN(inRemaining, MAX_EXTENDED_LENGTH);
-                length = lzs_match_len(inPtr, inPtr - best_offset, matchMax);
-                LZS_DEBUG(("Extended length %"PRIuFAST8"\n", length));
+            }
+        }
+        if (long_length || blockLen == inRemaining)
+        {
+            commitLen = blockLen;
+        }
+        else
+        {
+            commitLen = blockLen - LZS_OPTIMAL_NICE_LENGTH;
+        }
 
-                /* Encode length */
-                bitFieldQueue <<= EXTENDED_LENGTH_BITS;
-                bitFieldQueue |= length;
-                bitFieldQueueLen += EXTENDED_LENGTH_BITS;
+        /* Trace back the cheapest path from the end of the block, reversing
+         * it so that fromLength[] and fromOffset[] at each step give the next step. */
+        pos = blockLen;
+        length = fromLength[pos];
+        offset = fromOffset[pos];
+        while (pos)
+        {
+            pos -= length;
+            temp = fromLength[pos];
+            temp16 = fromOffset[pos];
+            fromLength[pos] = length;
+            fromOffset[pos] = offset;
+            length = temp;
+            offset = temp16;
+        }
 
-                if (length != MAX_EXTENDED_LENGTH)
+        /* Output */
+        for (pos = 0; pos < commitLen; pos += length)
+        {
+            length = fromLength[pos];
+            if (length == 1u)
+            {
+                /* Leading 0 bit indicates offset/length token.
+                 * Following 8 bits are byte-literal. */
+                LZS_DEBUG(("Literal %c (%02X)\n", isprint(inPtr[pos]) ? inPtr[pos] : '?', inPtr[pos]));
+                if (!lzs_bits_put(&writer, inPtr[pos], LITERAL_BITS))
                 {
-                    state = COMPRESS_NORMAL;
+                    return writer.outCount;
                 }
-                break;
+            }
+            else if (!lzs_bits_put_match(&writer, fromOffset[pos], length))
+            {
+                return writer.outCount;
+            }
         }
-        // 'length' contains number of input bytes encoded.
-        // Update inPtr, inRemaining and hash tables accordingly.
-        for (temp8 = 0; temp8 < length; temp8++)
+        if (long_length)
         {
-            inputHash = inputs_hash(*inPtr, *(inPtr + 1));
-            inPtr++;
+            if (!lzs_bits_put_match(&writer, long_offset, long_length))
+            {
+                return writer.outCount;
+            }
+            pos += long_length;
+        }
+        /* Remove positions that will be parsed again from the hash tables, latest first */
+        while (hashPtr > inPtr + pos)
+        {
+            hashPtr--;
+            temp16 = lzs_window_ring_idx(hashPtr - pFinder->inBase);
+            temp = hashPtr - inPtr - overlapStart;
+            if ((size_t)(pFinder->inEnd - hashPtr) >= pFinder->hashLength)
+            {
+                pFinder->hashTable[inputs_hash(hashPtr, pFinder->hashType, pFinder->hashBits)] = pFinder->historyHash[temp16];
+            }
+            pFinder->historyHash[temp16] = savedHash[temp];
+            if (pFinder->hashLength > MIN_LENGTH)
+            {
+                pFinder->hash2Table[inputs_hash2(hashPtr)] = savedHash2[temp];
+            }
+        }
+        overlapPtr = inPtr + overlapStart;
+        inPtr += pos;
+        inRemaining -= pos;
+    }
+    /* Make end marker, which is like a short offset with value 0, padded out
+     * with 0 to 7 extra zeros to reach a byte boundary. That is,
+     * 0b110000000 */
+    if (lzs_bits_put(&writer, 3u << (SHORT_OFFSET_BITS + 7u), 2u + SHORT_OFFSET_BITS + 7u))
+    {
+        lzs_bits_flush(&writer);
+    }
+    return writer.outCount;
+}
+
+/**
+ * \brief Get the size of the part of the workspace for the match finder
+ *
+ * \param pConfig: Checked compression parameters.
+ *
+ * \return size_t: Size of the hash tables or binary trees in bytes, including the header.
+ */
+static size_t lzs_finder_workspace_size(const LzsCompressConfig_t * pConfig)
+{
+    if (pConfig->matchFinder == LZS_MATCH_FINDER_BINARY_TREE)
+    {
+        return LZS_TREE_WORKSPACE_SIZE(pConfig->hashBits);
+    }
+    return LZS_WORKSPACE_SIZE(pConfig->hashBits);
+}
+
+/**
+ * \brief Get the size of the workspace needed by lzs_compress_config_ws()
+ *
+ * \param pConfig: Compression parameters.
+ *
+ * \return size_t: Size of the workspace in bytes.
+ */
+size_t lzs_compress_workspace_size(const LzsCompressConfig_t * pConfig)
+{
+    LzsCompressConfig_t config;
 
-            historyHash[historyLatestIdx] = hashTable[inputHash];
-            hashTable[inputHash] = historyLatestIdx;
-            historyLatestIdx = lzs_idx_inc_wrap(historyLatestIdx, 1u, ARRAY_ENTRIES(historyHash));
+    config = *pConfig;
+    lzs_compress_config_check(&config, LZS_HASH_BITS_MAX);
+    if (config.optimal)
+    {
+        return LZS_OPTIMAL_WORKSPACE_SIZE(lzs_finder_workspace_size(&config));
+    }
+    return lzs_finder_workspace_size(&config);
+}
+
+/**
+ * \brief Get the size of the workspace needed by lzs_compress_ws()
+ *
+ * This is LZS_WORKSPACE_SIZE(INPUT_HASH_BITS), for callers that allocate the
+ * workspace at run time.
+ *
+ * \return size_t: Size of the workspace in bytes.
+ */
+size_t lzs_workspace_size(void)
+{
+    return LZS_WORKSPACE_SIZE(INPUT_HASH_BITS);
+}
+
+/**
+ * \brief Single-call compression, with custom compression parameters, using a caller-provided workspace
+ *
+ * No state is kept between calls. Compression is expected to complete in a single call.
+ * It will stop if/when it reaches the end of either the input or the output buffer.
+ *
+ * The workspace holds the hash tables, so this allows hash table sizes up to
+ * LZS_HASH_BITS_MAX. It needn't be initialised: it is cleared on first use,
+ * which is recognised by a signature in its header. Reusing the workspace for
+ * later calls avoids clearing the hash tables again, and keeps them in cache.
+ * A workspace must not be used by more than one call at a time.
+ *
+ * With the binary tree match finder, the tree tables are cleared for every call.
+ *
+ * \param a_pOutData: Pointer to destination buffer for compressed data.
+ * \param a_outBufferSize: Size, in bytes, of the destination buffer.
+ * \param a_pInData: Pointer to source buffer of data to be compressed.
+ * \param a_inLen: Size, in bytes, of source data.
+ * \param pConfig: Compression parameters.
+ * \param pWorkspace: Workspace of lzs_compress_workspace_size() bytes, aligned for uint32_t.
+ *
+ * \return size_t: Number of bytes of compressed data written to the destination buffer.
+ */
+size_t lzs_compress_config_ws(uint8_t * a_pOutData, size_t a_outBufferSize, const uint8_t * a_pInData, size_t a_inLen,
+                              const LzsCompressConfig_t * pConfig, void * pWorkspace)
+{
+    const uint8_t     * inPtr;
+    const uint8_t     * hashPtr;            // First input position that isn't yet in the hash tables
+    LzsMatchFinder_t    finder;
+    LzsTreeFinder_t     tree;
+    LzsTreeFinder_t   * pTree = NULL;
+    LzsCompressConfig_t config;
+    LzsBitWriter_t      writer;
+    size_t              historyLen;
+    size_t              inRemaining;        // Count of remaining bytes of input
+    size_t              length;
+    uint_fast8_t        matchMax;
+    uint_fast16_t       best_offset = 0;
+    uint_fast8_t        best_length;
+    uint_fast16_t       next_offset = 0;
+    uint_fast8_t        next_length;
+    uint_fast8_t        step;
+    uint_fast8_t        lazyLiterals = 0;
+    uint_fast16_t       literalRun = 0;     // Number of literals in a row
+
+
+    config = *pConfig;
+    lzs_compress_config_check(&config, LZS_HASH_BITS_MAX);
+
+    if (config.matchFinder == LZS_MATCH_FINDER_BINARY_TREE)
+    {
+        lzs_tree_init(&tree, pWorkspace, &config, a_pInData, a_inLen,
+                      config.optimal ? LZS_OPTIMAL_NICE_LENGTH : config.searchLength);
+        pTree = &tree;
+    }
+    else
+    {
+        finder.hashTable = (uint16_t *)pWorkspace + LZS_WORKSPACE_HEADER_LEN;
+        finder.historyHash = finder.hashTable + (1u << config.hashBits);
+        finder.hash2Table = finder.historyHash + LZS_MAX_HISTORY_SIZE;
+        finder.inBase = a_pInData;
+        finder.inEnd = a_pInData + a_inLen;
+        finder.hashEpoch = lzs_workspace_epoch(pWorkspace, config.hashBits);
+        finder.hashType = config.hashType;
+        finder.hashBits = config.hashBits;
+        finder.hashLength = hashTypeLength[config.hashType];
+    }
+
+    if (config.optimal)
+    {
+        return lzs_compress_optimal(a_pOutData, a_outBufferSize, a_pInData, a_inLen, &config,
+                                    pTree ? NULL : &finder, pTree,
+                                    (LzsOptimalTables_t *)((uint8_t *)pWorkspace +
+                                        LZS_OPTIMAL_WORKSPACE_SIZE(lzs_finder_workspace_size(&config)) - LZS_OPTIMAL_WORKSPACE_LEN));
+    }
+
+    historyLen = 0;
+    inPtr = a_pInData;
+    hashPtr = a_pInData;
+    inRemaining = a_inLen;
+    lzs_bits_init(&writer, a_pOutData, a_outBufferSize);
+
+    while (inRemaining)
+    {
+        /* Look for a match in history */
+        best_length = 0;
+        matchMax = LZSMIN(inRemaining, config.searchLength);
+        if (lazyLiterals)
+        {
+            lazyLiterals--;
         }
+        else if (matchMax >= MIN_LENGTH && lzs_literal_skip(literalRun, config.incompressibleRun))
+        {
+            // The input looks incompressible. Leave this position out of the
+            // hash tables. The binary trees must hold every position, so they
+            // still get it before the next search.
+            if (!pTree)
+            {
+                hashPtr = lzs_hash_update(&finder, hashPtr, inPtr) + 1u;
+            }
+        }
+        else if (matchMax >= MIN_LENGTH)
+        {
+            if (pTree)
+            {
+                best_length = lzs_tree_search(pTree, inPtr, &best_offset);
+            }
+            else
+            {
+                hashPtr = lzs_hash_update(&finder, hashPtr, inPtr);
+                best_length = lzs_search(&finder, inPtr, historyLen, matchMax, &config, &best_offset);
+            }
 
+            /* Lazy matching: if a better match starts at one of the next
+             * lazySteps bytes, output literals up to it, and decide again
+             * at that byte. */
+            for (step = 1u;
+                 step <= config.lazySteps && best_length >= MIN_LENGTH && best_length < config.lazyLength &&
+                    inRemaining >= step + MIN_LENGTH;
+                 step++)
+            {
+                if (pTree)
+                {
+                    next_length = lzs_tree_search(pTree, inPtr + step, &next_offset);
+                }
+                else
+                {
+                    hashPtr = lzs_hash_update(&finder, hashPtr, inPtr + step);
+                    next_length = lzs_search(&finder, inPtr + step, LZSMIN(historyLen + step, LZS_MAX_HISTORY_SIZE),
+                                             LZSMIN(inRemaining - step, config.searchLength), &config, &next_offset);
+                }
+                if (lzs_lazy_is_better(best_offset, best_length, step, next_offset, next_length))
+                {
+                    lazyLiterals = step - 1u;
+                    best_length = 0;
+                    break;
+                }
+            }
+        }
+        /* Output */
+        if (best_length < MIN_LENGTH)
+        {
+            /* Byte-literal */
+            /* Leading 0 bit indicates offset/length token.
+             * Following 8 bits are byte-literal. */
+            LZS_DEBUG(("Literal %c (%02X)\n", isprint(*inPtr) ? *inPtr : '?', *inPtr));
+            if (!lzs_bits_put(&writer, *inPtr, LITERAL_BITS))
+            {
+                return writer.outCount;
+            }
+            length = 1u;
+        }
+        else
+        {
+            LZS_DEBUG(("Best offset %"PRIuFAST16" length %"PRIuFAST8"\n", best_offset, best_length));
+            length = best_length;
+            if (length >= MAX_SHORT_LENGTH)
+            {
+                /* The match is encoded with extended lengths, so follow it as far
+                 * as it goes. The match-length kernel compares whole words at a
+                 * time, so long runs cost little more than a memory scan. */
+                length = MAX_SHORT_LENGTH + lzs_match_len(inPtr + MAX_SHORT_LENGTH, inPtr + MAX_SHORT_LENGTH - best_offset,
+                                                          inRemaining - MAX_SHORT_LENGTH);
+            }
+            if (!lzs_bits_put_match(&writer, best_offset, length))
+            {
+                return writer.outCount;
+            }
+        }
+        literalRun = lzs_literal_run(literalRun, config.incompressibleRun, best_length < MIN_LENGTH);
+        // 'length' contains number of input bytes encoded.
+        // Update inPtr and inRemaining accordingly. The hash tables are
+        // brought up to date before the next search.
+        inPtr += length;
         inRemaining -= length;
-
         historyLen = LZSMIN(historyLen + length, LZS_MAX_HISTORY_SIZE);
     }
     /* Make end marker, which is like a short offset with value 0, padded out
      * with 0 to 7 extra zeros to reach a byte boundary. That is,
      * 0b110000000 */
-    bitFieldQueue <<= (2u + SHORT_OFFSET_BITS + 7u);
-    bitFieldQueueLen += (2u + SHORT_OFFSET_BITS + 7u);
-    bitFieldQueue |= (3u << (SHORT_OFFSET_BITS + 7u));
-    /* Copy output bits to output buffer */
-    while (bitFieldQueueLen >= 8u)
+    if (lzs_bits_put(&writer, 3u << (SHORT_OFFSET_BITS + 7u), 2u + SHORT_OFFSET_BITS + 7u))
     {
-        if (outCount >= a_outBufferSize)
-        {
-            return outCount;
-        }
-        *outPtr++ = (bitFieldQueue >> (bitFieldQueueLen - 8u));
-        bitFieldQueueLen -= 8u;
-        outCount++;
+        lzs_bits_flush(&writer);
+    }
+    return writer.outCount;
+}
+
+/**
+ * \brief Single-call compression, with custom compression parameters
+ *
+ * No state is kept between calls. Compression is expected to complete in a single call.
+ * It will stop if/when it reaches the end of either the input or the output buffer.
+ *
+ * The hash tables are on the stack, and their size is limited to INPUT_HASH_BITS,
+ * so this uses LZS_WORKSPACE_SIZE(INPUT_HASH_BITS) bytes of stack for them. The
+ * binary tree match finder needs a much larger workspace, so hash chains are
+ * used instead, and optimal parsing needs more again for its tables, so lazy
+ * matching is used instead; use lzs_compress_config_ws() for either.
+ *
+ * \param a_pOutData: Pointer to destination buffer for compressed data.
+ * \param a_outBufferSize: Size, in bytes, of the destination buffer.
+ * \param a_pInData: Pointer to source buffer of data to be compressed.
+ * \param a_inLen: Size, in bytes, of source data.
+ * \param pConfig: Compression parameters.
+ *
+ * \return size_t: Number of bytes of compressed data written to the destination buffer.
+ */
+size_t lzs_compress_config(uint8_t * a_pOutData, size_t a_outBufferSize, const uint8_t * a_pInData, size_t a_inLen,
+                           const LzsCompressConfig_t * pConfig)
+{
+    uint16_t            workspace[LZS_WORKSPACE_SIZE(INPUT_HASH_BITS) / sizeof(uint16_t)];
+    LzsCompressConfig_t config;
+
+    config = *pConfig;
+    lzs_compress_config_check(&config, INPUT_HASH_BITS);
+    config.matchFinder = LZS_MATCH_FINDER_HASH_CHAIN;
+    config.optimal = 0;
+    // The stack may hold a workspace from an earlier call, which may since have been overwritten.
+    ((LzsWorkspaceHeader_t *)workspace)->signature[0] = 0;
+    return lzs_compress_config_ws(a_pOutData, a_outBufferSize, a_pInData, a_inLen, &config, workspace);
+}
+
+/**
+ * \brief Single-call compression, at a given compression level
+ *
+ * No state is kept between calls. Compression is expected to complete in a single call.
+ * It will stop if/when it reaches the end of either the input or the output buffer.
+ *
+ * \param a_pOutData: Pointer to destination buffer for compressed data.
+ * \param a_outBufferSize: Size, in bytes, of the destination buffer.
+ * \param a_pInData: Pointer to source buffer of data to be compressed.
+ * \param a_inLen: Size, in bytes, of source data.
+ * \param level: Compression level, from LZS_COMPRESS_LEVEL_FASTEST to LZS_COMPRESS_LEVEL_MAX.
+ *
+ * \return size_t: Number of bytes of compressed data written to the destination buffer.
+ */
+size_t lzs_compress_level(uint8_t * a_pOutData, size_t a_outBufferSize, const uint8_t * a_pInData, size_t a_inLen, unsigned int level)
+{
+    LzsCompressConfig_t config;
+
+    lzs_compress_level_config(&config, level);
+    return lzs_compress_config(a_pOutData, a_outBufferSize, a_pInData, a_inLen, &config);
+}
+
+/**
+ * \brief Single-call compression
+ *
+ * No state is kept between calls. Compression is expected to complete in a single call.
+ * It will stop if/when it reaches the end of either the input or the output buffer.
+ *
+ * This uses compression level LZS_COMPRESS_LEVEL_DEFAULT.
+ *
+ * \param a_pOutData: Pointer to destination buffer for compressed data.
+ * \param a_outBufferSize: Size, in bytes, of the destination buffer.
+ * \param a_pInData: Pointer to source buffer of data to be compressed.
+ * \param a_inLen: Size, in bytes, of source data.
+ *
+ * \return size_t: Number of bytes of compressed data written to the destination buffer.
+ */
+size_t lzs_compress(uint8_t * a_pOutData, size_t a_outBufferSize, const uint8_t * a_pInData, size_t a_inLen)
+{
+    return lzs_compress_config(a_pOutData, a_outBufferSize, a_pInData, a_inLen, &levelConfig[LZS_COMPRESS_LEVEL_DEFAULT]);
+}
+
+/**
+ * \brief Single-call compression, using a caller-provided workspace
+ *
+ * This gives the same output as lzs_compress(), but the hash tables are in the
+ * workspace rather than on the stack. See lzs_compress_config_ws().
+ *
+ * \param a_pOutData: Pointer to destination buffer for compressed data.
+ * \param a_outBufferSize: Size, in bytes, of the destination buffer.
+ * \param a_pInData: Pointer to source buffer of data to be compressed.
+ * \param a_inLen: Size, in bytes, of source data.
+ * \param pWorkspace: Workspace of lzs_workspace_size() bytes, aligned for uint16_t.
+ *
+ * \return size_t: Number of bytes of compressed data written to the destination buffer.
+ */
+size_t lzs_compress_ws(uint8_t * a_pOutData, size_t a_outBufferSize, const uint8_t * a_pInData, size_t a_inLen, void * pWorkspace)
+{
+    return lzs_compress_config_ws(a_pOutData, a_outBufferSize, a_pInData, a_inLen, &levelConfig[LZS_COMPRESS_LEVEL_DEFAULT], pWorkspace);
+}
+
+/**
+ * \brief Single-call compression of many independent messages
+ *
+ * Each message is compressed as by lzs_compress_config_ws(), with its own end
+ * marker, and doesn't refer to the others. So each can be decompressed on its
+ * own, for example one packet of a datagram protocol. The same workspace is
+ * used for all the messages, so the hash tables stay in the cache, and they are
+ * only cleared once every 16 messages, rather than for each message as by
+ * lzs_compress().
+ *
+ * \param pOut: Array of count output buffers. On exit, the length of each is the
+ *              length of the compressed message.
+ * \param pIn: Array of count messages to compress.
+ * \param count: Number of messages.
+ * \param pConfig: Compression parameters.
+ * \param pWorkspace: Workspace of lzs_compress_workspace_size() bytes, aligned for uint32_t.
+ *
+ * \return size_t: Total number of bytes of compressed data written to the output buffers.
+ */
+size_t lzs_compress_batch(LzsBuffer_t * pOut, const LzsConstBuffer_t * pIn, size_t count,
+                          const LzsCompressConfig_t * pConfig, void * pWorkspace)
+{
+    size_t              outCount = 0;
+    size_t              i;
+
+    for (i = 0; i < count; i++)
+    {
+        pOut[i].len = lzs_compress_config_ws(pOut[i].ptr, pOut[i].len, pIn[i].ptr, pIn[i].len, pConfig, pWorkspace);
+        outCount += pOut[i].len;
     }
     return outCount;
 }
@@ -472,7 +2146,10 @@ size_t lzs_compress(uint8_t * a_pOutData, size_t a_outBufferSize, const uint8_t
  * This does not initialise the hash tables. The algorithm can still operate
  * correctly regardless of what uninitialised data might be in the hash tables,
  * but execution time would vary depending on the contents of the data in the
- * hash tables.
+ * hash tables. To reuse a context that has been fully initialised, use
+ * `lzs_compress_reset()` instead, which is deterministic.
+ *
+ * Compression level LZS_COMPRESS_LEVEL_DEFAULT is used.
  *
  * \param pParams: Pointer to struct to store incremental compression state.
  */
@@ -480,14 +2157,21 @@ void lzs_compress_init_quick(LzsCompressParameters_t * pParams)
 {
     pParams->status = LZS_C_STATUS_NONE;
 
+    pParams->config = levelConfig[LZS_COMPRESS_LEVEL_DEFAULT];
     pParams->lookAheadLen = 0;
+    pParams->lookAheadHashedLen = 0;
+    pParams->lazyLiterals = 0;
+    pParams->literalRun = 0;
     pParams->bitFieldQueue = 0;
     pParams->bitFieldQueueLen = 0;
     pParams->state = COMPRESS_NORMAL;
     pParams->historyLatestIdx = 0;
     pParams->historyLookAheadIdx = 0;
     pParams->historyLen = 0;
+    pParams->historyUnhashedLen = 0;
+    pParams->hashEpoch = 0;
     pParams->offset = 0;
+    pParams->workBudget = 0;
 }
 
 /**
@@ -496,6 +2180,8 @@ void lzs_compress_init_quick(LzsCompressParameters_t * pParams)
  * This fully initialises the hash tables, for deterministic operation.
  * However, it is slower to run, because initialising large tables takes time.
  *
+ * Compression level LZS_COMPRESS_LEVEL_DEFAULT is used.
+ *
  * \param pParams: Pointer to struct to store incremental compression state.
  */
 void lzs_compress_init_full(LzsCompressParameters_t * pParams)
@@ -512,81 +2198,255 @@ void lzs_compress_init_full(LzsCompressParameters_t * pParams)
         pParams->historyHash[temp16] = (uint16_t)-1;
     }
 
+    for (temp16 = 0; temp16 < ARRAY_ENTRIES(pParams->hash2Table); temp16++)
+    {
+        pParams->hash2Table[temp16] = (uint16_t)-1;
+    }
+
     lzs_compress_init_quick(pParams);
 }
 
 /**
- * \brief Incremental compression
+ * \brief Reset incremental compression for a new, independent stream, keeping the compression parameters
  *
- * State is kept between calls, so compression can be done gradually, and flexibly
- * depending on the application's needs for input/output buffer handling.
+ * The context must have been initialised by `lzs_compress_init_full()`,
+ * `lzs_compress_init_level()` or `lzs_compress_init_config()`. The output is
+ * the same as after those, but the hash tables are invalidated by changing the
+ * hash epoch rather than by clearing them. They are only cleared once every
+ * 16 resets, when the epochs run out. pParams->workBudget is kept.
  *
- * It will stop if/when it reaches the end of either the input or the output buffer.
- * It will also stop if/when it generates an end marker, as specified by `add_end_marker` parameter.
- * Setting `add_end_marker` to `true` doesn't guarantee an end marker will be appended; it depends
- * on whether there is enough output buffer space to complete compression of all the input data,
- * and then add the end marker. After the call, check pParams->status and whether the
- * LZS_C_STATUS_END_MARKER flag was set. If not, it is necessary to call the function again with
- * enough free space in the output buffer for any remaining compressed data followed by the end
- * marker.
+ * \param pParams: Pointer to struct to store incremental compression state.
+ */
+void lzs_compress_reset(LzsCompressParameters_t * pParams)
+{
+    LzsCompressConfig_t config;
+    size_t              workBudget;
+    uint_fast16_t       hashEpoch;
+
+    config = pParams->config;
+    workBudget = pParams->workBudget;
+    hashEpoch = pParams->hashEpoch;
+    if (hashEpoch == LZS_HASH_EPOCH_LAST)
+    {
+        lzs_compress_init_full(pParams);
+    }
+    else
+    {
+        lzs_compress_init_quick(pParams);
+        pParams->hashEpoch = hashEpoch + LZS_HASH_EPOCH_INC;
+    }
+    pParams->config = config;
+    pParams->workBudget = workBudget;
+}
+
+/**
+ * \brief Set a preset dictionary for incremental compression
+ *
+ * The dictionary is used as history that precedes the input, so that matches
+ * can refer to it from the first input byte. Only the last LZS_MAX_HISTORY_SIZE
+ * bytes of a longer dictionary can be referred to, so only those are used. The
+ * output must be decompressed with the same dictionary, set by
+ * lzs_decompress_set_dictionary(). The output format is unchanged.
+ *
+ * This must be called after the context is initialised or reset, or after a
+ * full flush, before any input is given. The dictionary is copied, and is
+ * added to the hash tables before the first search.
  *
  * \param pParams: Pointer to struct to store incremental compression state.
- * \param add_end_marker: true to append an end-marker to output after all input & output data is processed.
+ * \param pDictionary: Dictionary data, typically samples of data like the input.
+ * \param dictionaryLen: Length of the dictionary, in bytes.
+ */
+void lzs_compress_set_dictionary(LzsCompressParameters_t * pParams, const uint8_t * pDictionary, size_t dictionaryLen)
+{
+    if (dictionaryLen > LZS_MAX_HISTORY_SIZE)
+    {
+        pDictionary += dictionaryLen - LZS_MAX_HISTORY_SIZE;
+        dictionaryLen = LZS_MAX_HISTORY_SIZE;
+    }
+    memcpy(pParams->historyBuffer, pDictionary, dictionaryLen);
+    pParams->historyLatestIdx = dictionaryLen;
+    pParams->historyLookAheadIdx = dictionaryLen;
+    pParams->historyLen = dictionaryLen;
+    pParams->historyUnhashedLen = dictionaryLen;
+}
+
+/**
+ * \brief Build a preset dictionary, with its hash tables, to attach to incremental compression contexts
  *
- * Before calling this function, these state variables must be set appropriately:
+ * The hash tables are built for the hash type and size of pConfig, and can
+ * only be attached to contexts with the same ones. Only the last
+ * LZS_MAX_HISTORY_SIZE bytes of longer data are used.
  *
- *     - pParams->inPtr     point to the source data.
- *     - pParams->inLength  set to the length of the source data (bytes).
- *     - pParams->outPtr    point to the output buffer to store compressed data.
- *     - pParams->outLength set to the length of the output buffer (bytes).
+ * \param pDictionary: Dictionary to build.
+ * \param pData: Dictionary data, typically samples of data like the input.
+ * \param dataLen: Length of the dictionary data, in bytes.
+ * \param pConfig: Compression parameters of the contexts that the dictionary is for.
+ */
+void lzs_dictionary_init(LzsDictionary_t * pDictionary, const uint8_t * pData, size_t dataLen, const LzsCompressConfig_t * pConfig)
+{
+    LzsCompressConfig_t config;
+    uint_fast8_t        hashLength;
+    uint_fast16_t       historyIdx;
+
+    config = *pConfig;
+    lzs_compress_config_check(&config, INPUT_HASH_BITS);
+    hashLength = hashTypeLength[config.hashType];
+    if (dataLen > LZS_MAX_HISTORY_SIZE)
+    {
+        pData += dataLen - LZS_MAX_HISTORY_SIZE;
+        dataLen = LZS_MAX_HISTORY_SIZE;
+    }
+    memcpy(pDictionary->data, pData, dataLen);
+    memset(pDictionary->hashTable, 0xFF, sizeof(pDictionary->hashTable));
+    memset(pDictionary->hash2Table, 0xFF, sizeof(pDictionary->hash2Table));
+    pDictionary->len = dataLen;
+    pDictionary->hashType = config.hashType;
+    pDictionary->hashBits = config.hashBits;
+
+    // Positions near the end need bytes of the input to hash, so they are
+    // left for the context to add, as for lzs_compress_set_dictionary().
+    pDictionary->hashedLen = (dataLen >= hashLength) ? dataLen - hashLength + 1u : 0;
+    for (historyIdx = 0; historyIdx < pDictionary->hashedLen; historyIdx++)
+    {
+        lzs_hash_insert(pDictionary->hashTable, pDictionary->historyHash,
+                        inputs_hash(&pDictionary->data[historyIdx], config.hashType, config.hashBits), historyIdx, 0);
+        if (hashLength > MIN_LENGTH)
+        {
+            pDictionary->hash2Table[inputs_hash2(&pDictionary->data[historyIdx])] = historyIdx;
+        }
+    }
+}
+
+/**
+ * \brief Attach a prebuilt preset dictionary to incremental compression
  *
- * After calling this function:
+ * This is as lzs_compress_set_dictionary(), but the dictionary's hash tables
+ * are copied rather than built. The context's hash epoch is set back to the
+ * one the tables were built with; all entries of the main and 2-byte hash
+ * tables are replaced, so older entries can't become valid again. The
+ * dictionary is only read, so it can be shared by contexts in many threads.
  *
- *     - pParams->status    LzsCompressStatus_t flags indicate various exit status of the function.
- *     - pParams->inPtr     points to just after the source data that was read.
- *     - pParams->inLength  is decremented by the length of the source data that was read (bytes).
- *     - pParams->outPtr    points to just after the compressed output data that was written to the output buffer.
- *     - pParams->outLength is decremented by the length of the output data that was written to the buffer (bytes).
+ * If the dictionary was built for a different hash type or size than the
+ * context uses, its hash tables can't be used, and the data is set as by
+ * lzs_compress_set_dictionary() instead.
+ *
+ * \param pParams: Pointer to struct to store incremental compression state.
+ * \param pDictionary: Dictionary built by lzs_dictionary_init().
+ */
+void lzs_compress_attach_dictionary(LzsCompressParameters_t * pParams, const LzsDictionary_t * pDictionary)
+{
+    if (pDictionary->hashType != pParams->config.hashType || pDictionary->hashBits != pParams->config.hashBits)
+    {
+        lzs_compress_set_dictionary(pParams, pDictionary->data, pDictionary->len);
+        return;
+    }
+    memcpy(pParams->historyBuffer, pDictionary->data, pDictionary->len);
+    memcpy(pParams->historyHash, pDictionary->historyHash, sizeof(uint16_t) * pDictionary->hashedLen);
+    memcpy(pParams->hashTable, pDictionary->hashTable, sizeof(uint16_t) << pDictionary->hashBits);
+    memcpy(pParams->hash2Table, pDictionary->hash2Table, sizeof(pParams->hash2Table));
+    pParams->hashEpoch = 0;
+    pParams->historyLatestIdx = pDictionary->len;
+    pParams->historyLookAheadIdx = pDictionary->len;
+    pParams->historyLen = pDictionary->len;
+    pParams->historyUnhashedLen = pDictionary->len - pDictionary->hashedLen;
+}
+
+/**
+ * \brief Initialise incremental compression, including hash tables, with custom compression parameters
+ *
+ * The hash table size is limited to INPUT_HASH_BITS.
+ *
+ * \param pParams: Pointer to struct to store incremental compression state.
+ * \param pConfig: Compression parameters.
+ */
+void lzs_compress_init_config(LzsCompressParameters_t * pParams, const LzsCompressConfig_t * pConfig)
+{
+    lzs_compress_init_full(pParams);
+    pParams->config = *pConfig;
+    lzs_compress_config_check(&pParams->config, INPUT_HASH_BITS);
+}
+
+/**
+ * \brief Initialise incremental compression, including hash tables, at a given compression level
+ *
+ * \param pParams: Pointer to struct to store incremental compression state.
+ * \param level: Compression level, from LZS_COMPRESS_LEVEL_FASTEST to LZS_COMPRESS_LEVEL_MAX.
+ */
+void lzs_compress_init_level(LzsCompressParameters_t * pParams, unsigned int level)
+{
+    LzsCompressConfig_t config;
+
+    lzs_compress_level_config(&config, level);
+    lzs_compress_init_config(pParams, &config);
+}
+
+/**
+ * \brief Incremental compression, with a flush mode
+ *
+ * Parameters are as for lzs_compress_flush(), and flush can also be
+ * LZS_FLUSH_NONE. See lzs_compress_incremental() for details.
  *
  * \return size_t: Number of bytes of compressed data written to the destination buffer.
  */
-size_t lzs_compress_incremental(LzsCompressParameters_t * pParams, bool add_end_marker)
+static size_t lzs_compress_incremental_flush(LzsCompressParameters_t * pParams, unsigned int flush)
 {
+    const uint8_t     * pWindow;            // History window: historyBuffer[], or the input buffer on the bulk input path
+    const uint8_t     * inStart;            // Input pointer on entry
     size_t              outCount;           // Count of output bytes that have been generated
-    lzs_input_hash_t    inputHash;
-    uint_fast16_t       historyReadIdx;
-    uint_fast16_t       offset;
+    uint_fast16_t       delta;
     uint_fast8_t        matchMax;
     uint_fast8_t        length;
-    uint_fast16_t       best_offset;
+    uint_fast16_t       best_offset = 0;
     uint_fast8_t        best_length;
-    uint_fast16_t       temp16;
+    uint_fast16_t       next_offset = 0;
+    uint_fast8_t        next_length;
+    uint_fast8_t        step;
     uint_fast8_t        temp8;
+    size_t              bytes;
+    size_t              work;               // Work done in this call, to compare with pParams->workBudget
+    bool                add_end_marker;
+    bool                skip;               // The position was left out of the hash tables
 
 
     pParams->status = LZS_C_STATUS_NONE;
+    if (pParams->state == COMPRESS_END_MARKER)
+    {
+        // Finish writing the end marker of an earlier call, before anything else.
+        return lzs_inc_end_marker_write(pParams);
+    }
+    add_end_marker = (flush != LZS_FLUSH_NONE);
     outCount = 0;
+    pWindow = pParams->historyBuffer;
+    inStart = pParams->inPtr;
+    work = 0;
 
     for (;;)
     {
         length = 0;
-        // Write data from the bit field queue to output
-        while (pParams->bitFieldQueueLen >= 8u)
+        skip = false;
+        if (pParams->workBudget != 0 && work >= pParams->workBudget)
+        {
+            // Stop, with the state intact, once the budget is used up.
+            pParams->status |= LZS_C_STATUS_BUDGET_EXHAUSTED;
+        }
+        // Write data from the bit field queue to output, once it is half full,
+        // and at the end of the input or before returning
+        if (pParams->bitFieldQueueLen >= BIT_WRITER_FLUSH_BITS || pParams->status != LZS_C_STATUS_NONE ||
+            pParams->inLength == 0)
         {
-            // Check if we have space in the output buffer
-            if (pParams->outLength == 0)
+            bytes = lzs_bits_write(pParams->outPtr, pParams->outLength, pParams->bitFieldQueue, pParams->bitFieldQueueLen);
+            pParams->outPtr += bytes;
+            pParams->outLength -= bytes;
+            pParams->bitFieldQueueLen -= 8u * bytes;
+            outCount += bytes;
+            if (pParams->bitFieldQueueLen >= 8u)
             {
                 // We're out of space in the output buffer.
-                // Set status, exit this inner copying loop, but maintain the current state.
+                // Set status, but maintain the current state.
                 pParams->status |= LZS_C_STATUS_NO_OUTPUT_BUFFER_SPACE;
-                break;
             }
-            *pParams->outPtr++ = (pParams->bitFieldQueue >> (pParams->bitFieldQueueLen - 8u));
-            pParams->outLength--;
-            pParams->bitFieldQueueLen -= 8u;
-            ++outCount;
         }
-        if (pParams->bitFieldQueueLen > BIT_QUEUE_BITS)
+        if (pParams->bitFieldQueueLen > BIT_WRITER_FLUSH_BITS + 24u)
         {
             // It is an error if we ever get here.
             LZS_ASSERT(0);
@@ -612,33 +2472,54 @@ size_t lzs_compress_incremental(LzsCompressParameters_t * pParams, bool add_end_
         // Try to fill look-ahead buffer in history buffer
         temp8 = LZSMIN(LZS_MAX_LOOK_AHEAD_LEN - pParams->lookAheadLen, pParams->inLength);
         // temp8 holds number of bytes that can be copied from input to look-ahead area of historyBuffer[].
-        // Copy 'temp8' bytes from input into look-ahead area of historyBuffer[].
-        // But before that, update the last entry of the hash tables if needed.
-        if (pParams->lookAheadLen == 0 && pParams->historyLen && temp8)
-        {
-            historyReadIdx = lzs_idx_dec_wrap(pParams->historyLatestIdx, 1u,
-                                                sizeof(pParams->historyBuffer));
-            inputHash = inputs_hash(pParams->historyBuffer[historyReadIdx],
-                                    *pParams->inPtr);
-
-            pParams->historyHash[historyReadIdx] = pParams->hashTable[inputHash];
-            pParams->hashTable[inputHash] = historyReadIdx;
-        }
-        pParams->lookAheadLen += temp8;
-        pParams->inLength -= temp8;
-        // Copy 'temp8' bytes from input into look-ahead area of historyBuffer[].
-        while (temp8--)
+        if (temp8)
         {
-            pParams->historyBuffer[pParams->historyLookAheadIdx] = *pParams->inPtr++;
-            pParams->historyLookAheadIdx = lzs_idx_inc_wrap(pParams->historyLookAheadIdx, 1u,
-                                                            sizeof(pParams->historyBuffer));
+            if (pWindow == pParams->historyBuffer && pParams->inLength >= LZS_BULK_INPUT_MIN &&
+                pParams->historyLatestIdx >= LZS_MAX_HISTORY_SIZE &&
+                (size_t)(pParams->inPtr - inStart) >= LZS_MAX_HISTORY_SIZE + pParams->lookAheadLen)
+            {
+                // The history and look-ahead are all in the input buffer, just
+                // before inPtr. Switch to reading them from there.
+                lzs_inc_slide(pParams);
+                pWindow = pParams->inPtr - pParams->historyLookAheadIdx;
+                LZS_DEBUG(("Bulk input\n"));
+            }
+            if (pParams->historyLookAheadIdx + temp8 > sizeof(pParams->historyBuffer))
+            {
+                delta = lzs_inc_slide(pParams);
+                if (pWindow == pParams->historyBuffer)
+                {
+                    memmove(pParams->historyBuffer, pParams->historyBuffer + delta, pParams->historyLookAheadIdx);
+                }
+                else
+                {
+                    pWindow += delta;
+                }
+            }
+            pParams->lookAheadLen += temp8;
+            pParams->inLength -= temp8;
+            if (pWindow == pParams->historyBuffer)
+            {
+                // Copy 'temp8' bytes from input into look-ahead area of historyBuffer[].
+                while (temp8--)
+                {
+                    pParams->historyBuffer[pParams->historyLookAheadIdx++] = *pParams->inPtr++;
+                }
+            }
+            else
+            {
+                pParams->historyLookAheadIdx += temp8;
+                pParams->inPtr += temp8;
+            }
         }
 
         // Process input data in a state machine
         switch (pParams->state)
         {
             case COMPRESS_NORMAL:
-                matchMax = add_end_marker ? 1u : LZS_SEARCH_MATCH_MAX;
+                // Lazy matching needs lazySteps more bytes of look-ahead.
+                matchMax = pParams->config.searchLength + (pParams->config.lazyLength ? pParams->config.lazySteps : 0);
+                matchMax = add_end_marker ? 1u : matchMax;
                 if (pParams->lookAheadLen < matchMax)
                 {
                     // We don't have enough input data, so we're done for now.
@@ -648,46 +2529,46 @@ size_t lzs_compress_incremental(LzsCompressParameters_t * pParams, bool add_end_
 
                 // Look for a match in history.
                 best_length = 0;
-                matchMax = LZSMIN(pParams->lookAheadLen, LZS_SEARCH_MATCH_MAX);
-                if (matchMax >= 2u)
+                matchMax = LZSMIN(pParams->lookAheadLen, pParams->config.searchLength);
+                if (pParams->lazyLiterals)
+                {
+                    pParams->lazyLiterals--;
+                }
+                else if (matchMax >= MIN_LENGTH && lzs_literal_skip(pParams->literalRun, pParams->config.incompressibleRun))
+                {
+                    // The input looks incompressible. Leave this position out of the hash tables.
+                    work += pParams->historyUnhashedLen + 1u;
+                    lzs_inc_hash_update(pParams, pWindow, 0);
+                    skip = true;
+                }
+                else if (matchMax >= MIN_LENGTH)
                 {
-                    inputHash = inputs_hash_inc(pParams);
-                    historyReadIdx = pParams->hashTable[inputHash];
-                    if (historyReadIdx < ARRAY_ENTRIES(pParams->historyBuffer))
+                    work += pParams->historyUnhashedLen + pParams->config.chainMax;
+                    lzs_inc_hash_update(pParams, pWindow, 0);
+                    best_length = lzs_inc_search(pParams, pWindow, pParams->historyLatestIdx, pParams->historyLen,
+                                                 pParams->lookAheadLen, matchMax, &best_offset);
+
+                    /* Lazy matching: if a better match starts at one of the next
+                     * lazySteps bytes, output literals up to it, and decide again
+                     * at that byte. */
+                    for (step = 1u;
+                         step <= pParams->config.lazySteps && best_length >= MIN_LENGTH &&
+                            best_length < pParams->config.lazyLength && pParams->lookAheadLen >= step + MIN_LENGTH;
+                         step++)
                     {
-                        // Calculate offset from historyReadIdx.
-                        offset = lzs_idx_delta2_wrap(pParams->historyLatestIdx, historyReadIdx,
-                                                     ARRAY_ENTRIES(pParams->historyHash));
-
-                        for ( ; offset <= pParams->historyLen; )
+                        work += 1u + pParams->config.chainMax;
+                        lzs_inc_hash_update(pParams, pWindow, step);
+                        next_length = lzs_inc_search(pParams, pWindow,
+                                                     pParams->historyLatestIdx + step,
+                                                     LZSMIN(pParams->historyLen + step, LZS_MAX_HISTORY_SIZE),
+                                                     pParams->lookAheadLen - step,
+                                                     LZSMIN(pParams->lookAheadLen - step, pParams->config.searchLength),
+                                                     &next_offset);
+                        if (lzs_lazy_is_better(best_offset, best_length, step, next_offset, next_length))
                         {
-                            length = lzs_inc_match_len(pParams, offset, matchMax);
-                            if (length > best_length)
-                            {
-                                best_offset = offset;
-                                best_length = length;
-                                if (length >= matchMax)
-                                {
-                                    break;
-                                }
-                            }
-
-                            // Get next offset from historyHash[]
-                            // This involves calculating historyReadIdx to index into it.
-                            historyReadIdx = pParams->historyHash[historyReadIdx];
-                            if (historyReadIdx >= ARRAY_ENTRIES(pParams->historyBuffer))
-                            {
-                                break;
-                            }
-
-                            // Calculate new offset.
-                            temp16 = lzs_idx_delta2_wrap(pParams->historyLatestIdx, historyReadIdx,
-                                                        ARRAY_ENTRIES(pParams->historyHash));
-                            if (temp16 <= offset)
-                            {
-                                break;
-                            }
-                            offset = temp16;
+                            pParams->lazyLiterals = step - 1u;
+                            best_length = 0;
+                            break;
                         }
                     }
                 }
@@ -698,7 +2579,7 @@ size_t lzs_compress_incremental(LzsCompressParameters_t * pParams, bool add_end_
                     /* Leading 0 bit indicates offset/length token.
                      * Following 8 bits are byte-literal. */
                     pParams->bitFieldQueue <<= 9u;
-                    temp8 = pParams->historyBuffer[pParams->historyLatestIdx];
+                    temp8 = pWindow[pParams->historyLatestIdx];
                     pParams->bitFieldQueue |= temp8;
                     pParams->bitFieldQueueLen += 9u;
                     length = 1u;
@@ -745,6 +2626,7 @@ size_t lzs_compress_incremental(LzsCompressParameters_t * pParams, bool add_end_
                         pParams->state = COMPRESS_EXTENDED;
                     }
                 }
+                pParams->literalRun = lzs_literal_run(pParams->literalRun, pParams->config.incompressibleRun, best_length < MIN_LENGTH);
                 break;
             case COMPRESS_EXTENDED:
                 if (add_end_marker == false)
@@ -759,7 +2641,8 @@ size_t lzs_compress_incremental(LzsCompressParameters_t * pParams, bool add_end_
 
                 // Get next length of extended match.
                 matchMax = LZSMIN(pParams->lookAheadLen, MAX_EXTENDED_LENGTH);
-                length = lzs_inc_match_len(pParams, pParams->offset, matchMax);
+                length = lzs_inc_match_len(pWindow, pParams->historyLatestIdx, pParams->offset, matchMax);
+                work += length;
                 LZS_DEBUG(("Extended length %"PRIuFAST8"\n", length));
 
                 /* Encode length */
@@ -774,50 +2657,134 @@ size_t lzs_compress_incremental(LzsCompressParameters_t * pParams, bool add_end_
                 break;
         }
         // 'length' contains number of input bytes encoded.
-        for (temp8 = 0; temp8 < length; temp8++)
+        // They are added to the hash tables before the next search, except any
+        // that were already added for lazy matching, or that are left out.
+        temp8 = LZSMIN(pParams->lookAheadHashedLen, length);
+        pParams->lookAheadHashedLen -= temp8;
+        if (skip)
         {
-            historyReadIdx = lzs_idx_inc_wrap(pParams->historyLatestIdx, 1u,
-                                                sizeof(pParams->historyBuffer));
-            pParams->lookAheadLen--;
-            if (pParams->lookAheadLen)
-            {
-                inputHash = inputs_hash(pParams->historyBuffer[pParams->historyLatestIdx],
-                                        pParams->historyBuffer[historyReadIdx]);
-
-                pParams->historyHash[pParams->historyLatestIdx] = pParams->hashTable[inputHash];
-                pParams->hashTable[inputHash] = pParams->historyLatestIdx;
-            }
-            pParams->historyLatestIdx = historyReadIdx;
+            temp8 = length;
         }
+        pParams->historyUnhashedLen = LZSMIN((uint_fast16_t)(pParams->historyUnhashedLen + length - temp8), LZS_MAX_HISTORY_SIZE);
+        pParams->historyLatestIdx += length;
+        pParams->lookAheadLen -= length;
 
         pParams->historyLen = LZSMIN(pParams->historyLen + length, LZS_MAX_HISTORY_SIZE);
     }
 
+    if (lzs_literal_skip(pParams->literalRun, pParams->config.incompressibleRun) ||
+        (pParams->config.incompressibleRun != 0 && pParams->literalRun >= pParams->config.incompressibleRun))
+    {
+        pParams->status |= LZS_C_STATUS_INCOMPRESSIBLE;
+    }
+
+    if (pWindow != pParams->historyBuffer)
+    {
+        // Copy the window out of the input buffer, for the next call.
+        pWindow += lzs_inc_slide(pParams);
+        memcpy(pParams->historyBuffer, pWindow, pParams->historyLookAheadIdx);
+    }
+
     if (add_end_marker &&
         pParams->inLength == 0 &&
         pParams->state == COMPRESS_NORMAL &&
         pParams->lookAheadLen == 0 &&
-        pParams->bitFieldQueueLen < 8u &&
-        // TODO: The following imposes a minimum output buffer size of 3. Can this be improved?
-        pParams->outLength >= (pParams->bitFieldQueueLen + 2u + SHORT_OFFSET_BITS + 7u) / 8u)
-    {
-        /* Make end marker, which is like a short offset with value 0, padded out
-         * with 0 to 7 extra zeros to reach a byte boundary. That is,
-         * 0b110000000 */
-        pParams->bitFieldQueue <<= (2u + SHORT_OFFSET_BITS + 7u);
-        pParams->bitFieldQueueLen += (2u + SHORT_OFFSET_BITS + 7u);
-        pParams->bitFieldQueue |= (3u << (SHORT_OFFSET_BITS + 7u));
-        /* Copy output bits to output buffer */
-        while (pParams->bitFieldQueueLen >= 8u)
-        {
-            *pParams->outPtr++ = (pParams->bitFieldQueue >> (pParams->bitFieldQueueLen - 8u));
-            pParams->outLength--;
-            pParams->bitFieldQueueLen -= 8u;
-            ++outCount;
-        }
-        pParams->bitFieldQueueLen = 0;
-        pParams->status |= LZS_C_STATUS_END_MARKER;
+        pParams->bitFieldQueueLen < 8u)
+    {
+        outCount += lzs_inc_end_marker(pParams, flush);
     }
 
     return outCount;
 }
+
+/**
+ * \brief Incremental compression
+ *
+ * State is kept between calls, so compression can be done gradually, and flexibly
+ * depending on the application's needs for input/output buffer handling.
+ *
+ * Once enough input has been read in one call to hold the whole history, and
+ * at least LZS_BULK_INPUT_MIN bytes of input remain, the input buffer is used as
+ * the history window in place, rather than being copied into the history buffer.
+ * The window is copied into the history buffer once before returning, so large
+ * input buffers avoid most of the copying.
+ *
+ * It will stop if/when it reaches the end of either the input or the output buffer.
+ * It will also stop if/when it generates an end marker, as specified by `add_end_marker` parameter.
+ * Setting `add_end_marker` to `true` doesn't guarantee an end marker will be appended; it depends
+ * on whether there is enough output buffer space to complete compression of all the input data,
+ * and then add the end marker. After the call, check pParams->status and whether the
+ * LZS_C_STATUS_END_MARKER flag was set. If not, it is necessary to call the function again with
+ * more free space in the output buffer. Once the end marker has been started, the next calls
+ * write the rest of it before reading any more input, so any output buffer size makes progress.
+ *
+ * If pParams->workBudget is non-zero, it will also stop once that much work has
+ * been done, and set LZS_C_STATUS_BUDGET_EXHAUSTED. Work is counted as one unit
+ * for each position added to the hash tables, chainMax units for each match
+ * search, one unit for each literal output without a search, and one unit for
+ * each byte of an extended match length. So the time
+ * of a call is bounded regardless of the data, for example to interleave
+ * compression with other work in an event loop. The state is kept, and the next
+ * call continues from where it stopped. The output is the same as without a
+ * budget.
+ *
+ * The history is kept after an end marker, so compression can continue, and
+ * lzs_decompress_incremental() continues to decompress after it. This is the
+ * same as lzs_compress_flush() with LZS_FLUSH_SYNC.
+ *
+ * \param pParams: Pointer to struct to store incremental compression state.
+ * \param add_end_marker: true to append an end-marker to output after all input & output data is processed.
+ *
+ * Before calling this function, these state variables must be set appropriately:
+ *
+ *     - pParams->inPtr     point to the source data.
+ *     - pParams->inLength  set to the length of the source data (bytes).
+ *     - pParams->outPtr    point to the output buffer to store compressed data.
+ *     - pParams->outLength set to the length of the output buffer (bytes).
+ *
+ * After calling this function:
+ *
+ *     - pParams->status    LzsCompressStatus_t flags indicate various exit status of the function.
+ *     - pParams->inPtr     points to just after the source data that was read.
+ *     - pParams->inLength  is decremented by the length of the source data that was read (bytes).
+ *     - pParams->outPtr    points to just after the compressed output data that was written to the output buffer.
+ *     - pParams->outLength is decremented by the length of the output data that was written to the buffer (bytes).
+ *
+ * \return size_t: Number of bytes of compressed data written to the destination buffer.
+ */
+size_t lzs_compress_incremental(LzsCompressParameters_t * pParams, bool add_end_marker)
+{
+    return lzs_compress_incremental_flush(pParams, add_end_marker ? LZS_FLUSH_SYNC : LZS_FLUSH_NONE);
+}
+
+/**
+ * \brief Incremental compression of all the given input, followed by an end marker
+ *
+ * This is as lzs_compress_incremental() with `add_end_marker` set to `true`.
+ * The end marker ends on a byte boundary, so all the output so far can be sent
+ * and decompressed straight away, for example for a message of an interactive
+ * protocol.
+ *
+ * With LZS_FLUSH_SYNC, the history is kept, so later data can still refer to
+ * data before the end marker, and lzs_decompress_incremental() continues to
+ * decompress it with the same state.
+ *
+ * With LZS_FLUSH_FULL as well, the history is reset after the end marker, as by
+ * lzs_compress_reset(). Later data doesn't refer to data before the end marker,
+ * so it can also be decompressed by a newly initialised decompressor, for
+ * example after some output has been lost. This costs compression ratio.
+ *
+ * As for lzs_compress_incremental(), check pParams->status for
+ * LZS_C_STATUS_END_MARKER after the call, and if it isn't set, call the
+ * function again with more free space in the output buffer.
+ *
+ * \param pParams: Pointer to struct to store incremental compression state.
+ * \param flush: LZS_FLUSH_SYNC, or LZS_FLUSH_SYNC | LZS_FLUSH_FULL. LZS_FLUSH_FULL alone
+ *               is the same as LZS_FLUSH_SYNC | LZS_FLUSH_FULL.
+ *
+ * \return size_t: Number of bytes of compressed data written to the destination buffer.
+ */
+size_t lzs_compress_flush(LzsCompressParameters_t * pParams, unsigned int flush)
+{
+    return lzs_compress_incremental_flush(pParams, flush | LZS_FLUSH_SYNC);
+}
@@ -47,6 +47,7 @@
 #include "lzs-common.h"
 
 #include <stdint.h>
+#include <string.h>
 
 //#include <inttypes.h>
 //#include <ctype.h>
@@ -62,6 +63,36 @@
 // Choose which method to use
 #define LENGTH_DECODE_METHOD        LENGTH_DECODE_METHOD_TABLE
 
+// Number of bits, following the token-type bit of an offset/length token, that
+// are looked up in tokenDecodeTable[]. That is enough for a short offset token:
+// offset-type bit, 7-bit offset, and 2-bit or 4-bit length.
+#define TOKEN_DECODE_BITS           (1u + SHORT_OFFSET_BITS + LENGTH_MAX_BIT_WIDTH)
+#define TOKEN_DECODE_SIZE           (1u << TOKEN_DECODE_BITS)
+
+// Fields of a tokenDecodeTable[] entry
+#define TOKEN_WIDTH_MASK            0x0Fu   // Number of bits of the token, or 0 if it must be decoded bit field by bit field
+#define TOKEN_LENGTH_SHIFT          4u      // Match length
+#define TOKEN_LENGTH_MASK           0x0Fu
+#define TOKEN_OFFSET_SHIFT          8u      // Short offset
+
+// Output space needed to copy a match with 8-byte copies
+#define MATCH_COPY_WILD_LEN         16u
+
+// tokenDecodeTable[] entry for the TOKEN_DECODE_BITS bits x.
+// Long offsets and the end marker are left to the bit-field decoder.
+#define TOKEN_SHORT_LENGTH(c)       (((c) < 0xCu) ? (((c) >> 2u) + 2u) : ((c) - 0xCu + 5u))
+#define TOKEN_SHORT_WIDTH(c)        (((c) < 0xCu) ? (2u + SHORT_OFFSET_BITS + 2u) : (2u + SHORT_OFFSET_BITS + 4u))
+#define TOKEN_ENTRY(x)                                                                                  \
+    (((((x) & 0x800u) == 0) || ((((x) >> 4u) & SHORT_OFFSET_MAX) == 0)) ? 0 :                           \
+     (((((x) >> 4u) & SHORT_OFFSET_MAX) << TOKEN_OFFSET_SHIFT) |                                        \
+      (TOKEN_SHORT_LENGTH((x) & 0xFu) << TOKEN_LENGTH_SHIFT) | TOKEN_SHORT_WIDTH((x) & 0xFu)))
+#define TOKEN_ENTRIES_4(x)          TOKEN_ENTRY(x), TOKEN_ENTRY((x) + 1u), TOKEN_ENTRY((x) + 2u), TOKEN_ENTRY((x) + 3u)
+#define TOKEN_ENTRIES_16(x)         TOKEN_ENTRIES_4(x), TOKEN_ENTRIES_4((x) + 4u), TOKEN_ENTRIES_4((x) + 8u), TOKEN_ENTRIES_4((x) + 12u)
+#define TOKEN_ENTRIES_64(x)         TOKEN_ENTRIES_16(x), TOKEN_ENTRIES_16((x) + 16u), TOKEN_ENTRIES_16((x) + 32u), TOKEN_ENTRIES_16((x) + 48u)
+#define TOKEN_ENTRIES_256(x)        TOKEN_ENTRIES_64(x), TOKEN_ENTRIES_64((x) + 64u), TOKEN_ENTRIES_64((x) + 128u), TOKEN_ENTRIES_64((x) + 192u)
+#define TOKEN_ENTRIES_1024(x)       TOKEN_ENTRIES_256(x), TOKEN_ENTRIES_256((x) + 256u), TOKEN_ENTRIES_256((x) + 512u), TOKEN_ENTRIES_256((x) + 768u)
+#define TOKEN_ENTRIES_4096(x)       TOKEN_ENTRIES_1024(x), TOKEN_ENTRIES_1024((x) + 1024u), TOKEN_ENTRIES_1024((x) + 2048u), TOKEN_ENTRIES_1024((x) + 3072u)
+
 //#define LZS_DEBUG(X)    printf X
 #define LZS_DEBUG(X)
 
@@ -120,6 +151,20 @@ static const uint8_t lengthDecodeTable[(1u << LENGTH_MAX_BIT_WIDTH)] =
 };
 #endif
 
+/* Decode of an offset/length token with a short offset, from the
+ * TOKEN_DECODE_BITS bits following its token-type bit, in one look-up.
+ * See TOKEN_ENTRY() for the fields of each entry. */
+static const uint16_t tokenDecodeTable[TOKEN_DECODE_SIZE] =
+{
+    TOKEN_ENTRIES_4096(0u),
+};
+
+/* For a match offset of less than 8, the smallest multiple of the offset that
+ * is at least 8. */
+static const uint8_t matchCopyPatternLen[8] =
+{
+    0, 8u, 8u, 9u, 8u, 10u, 12u, 14u
+};
 
 static const uint_fast8_t StateBitMinimumWidth[NUM_DECOMPRESS_STATES] =
 {
@@ -135,6 +180,151 @@ static const uint_fast8_t StateBitMinimumWidth[NUM_DECOMPRESS_STATES] =
 };
 
 
+/*****************************************************************************
+ * Inline Functions
+ ****************************************************************************/
+
+/**
+ * \brief Copy a match from earlier in the output buffer
+ *
+ * The source and destination may overlap, when the offset is less than the
+ * length, so the bytes are copied as if one at a time in order. Bytes before
+ * the start of the output buffer are written as zeros, to avoid an information
+ * leak. So is all of a match with the invalid offset 0.
+ *
+ * If there are at least MATCH_COPY_WILD_LEN bytes of space in the output
+ * buffer, the match is copied with 8-byte copies, which may also write junk
+ * to the space after it.
+ *
+ * \param outPtr: Pointer to the output position.
+ * \param pOutStart: Pointer to the start of the output buffer.
+ * \param outSpace: Space in the output buffer, from the output position.
+ * \param offset: Reverse offset of the match, from the output position.
+ * \param length: Number of bytes to copy, at most MAX_EXTENDED_LENGTH. There must be space for them in the output buffer.
+ */
+static inline void lzs_history_copy(uint8_t * outPtr, const uint8_t * pOutStart, size_t outSpace, uint_fast16_t offset, uint_fast8_t length)
+{
+    const uint8_t     * inPtr;
+    size_t              count;
+    uint_fast8_t        i;
+
+
+    if (offset == 0)
+    {
+        // An offset of 0 is invalid. Write zeros, as for an offset before the start of the output.
+        memset(outPtr, 0, length);
+        return;
+    }
+    count = (size_t)(outPtr - pOutStart);
+    if (count < offset)
+    {
+        // Check offset is within range of valid history.
+        // If it's not, then write zeros. Avoid information leak.
+        count = LZSMIN(offset - count, length);
+        memset(outPtr, 0, count);
+        outPtr += count;
+        outSpace -= count;
+        length -= count;
+        if (length == 0)
+        {
+            return;
+        }
+    }
+    inPtr = outPtr - offset;
+    if (offset == 1u)
+    {
+        // Run of one byte value
+        memset(outPtr, *inPtr, length);
+    }
+    else if (outSpace < MATCH_COPY_WILD_LEN)
+    {
+        // Near the end of the output buffer: copy exactly.
+        for (i = 0; i < length; i++)
+        {
+            outPtr[i] = inPtr[i];
+        }
+    }
+    else if (offset >= 8u)
+    {
+        // Each 8-byte copy reads only bytes that are already written.
+        memcpy(outPtr, inPtr, 8u);
+        memcpy(outPtr + 8u, inPtr + 8u, 8u);
+    }
+    else
+    {
+        // Expand the repeating pattern to 8 bytes, then copy the next 8 bytes
+        // from the whole number of pattern repeats that is at least 8 bytes back.
+        for (i = 0; i < 8u; i++)
+        {
+            outPtr[i] = inPtr[i];
+        }
+        memcpy(outPtr + 8u, outPtr + 8u - matchCopyPatternLen[offset], 8u);
+    }
+}
+
+/**
+ * \brief Copy a match from the history buffer, to the history buffer and the output
+ *
+ * The match is copied in pieces that are contiguous in the history buffer,
+ * and no longer than the offset, so each piece reads only bytes that are
+ * already written. Bytes before the start of the history are written as zeros,
+ * to avoid an information leak. So is all of a match with the invalid offset 0.
+ *
+ * \param pParams: Pointer to struct of incremental decompression state.
+ * \param count: Number of bytes to copy. There must be space for them in the output buffer.
+ */
+static void lzs_history_ring_copy(LzsDecompressParameters_t * pParams, size_t count)
+{
+    uint_fast16_t       offset;
+    size_t              chunk;
+    uint8_t           * pLatest;
+
+
+    offset = pParams->offset;
+    while (count != 0)
+    {
+        pLatest = &pParams->historyBuffer[pParams->historyLatestIdx];
+        chunk = LZSMIN(count, sizeof(pParams->historyBuffer) - pParams->historyLatestIdx);
+        if (offset == 0)
+        {
+            // An offset of 0 is invalid. Write zeros, as for an offset beyond the history.
+            memset(pLatest, 0, chunk);
+        }
+        else if (offset > pParams->historyLen)
+        {
+            // Check offset is within range of valid history.
+            // If it's not, then write zeros. Avoid information leak.
+            chunk = LZSMIN(chunk, offset - pParams->historyLen);
+            memset(pLatest, 0, chunk);
+        }
+        else if (offset == 1u)
+        {
+            // Run of one byte value
+            memset(pLatest, pParams->historyBuffer[pParams->historyReadIdx], chunk);
+        }
+        else
+        {
+            chunk = LZSMIN(chunk, sizeof(pParams->historyBuffer) - pParams->historyReadIdx);
+            chunk = LZSMIN(chunk, offset);
+            memmove(pLatest, &pParams->historyBuffer[pParams->historyReadIdx], chunk);
+        }
+
+        // Write to output
+        memcpy(pParams->outPtr, pLatest, chunk);
+        pParams->outPtr += chunk;
+        pParams->outLength -= chunk;
+        pParams->length -= chunk;
+        count -= chunk;
+
+        pParams->historyReadIdx = lzs_idx_inc_wrap(pParams->historyReadIdx, chunk,
+                                                    sizeof(pParams->historyBuffer));
+        pParams->historyLatestIdx = lzs_idx_inc_wrap(pParams->historyLatestIdx, chunk,
+                                                    sizeof(pParams->historyBuffer));
+        pParams->historyLen = LZSMIN(pParams->historyLen + chunk, LZS_MAX_HISTORY_SIZE);
+    }
+}
+
+
 /*****************************************************************************
  * Functions
  ****************************************************************************/
@@ -146,6 +336,8 @@ static const uint_fast8_t StateBitMinimumWidth[NUM_DECOMPRESS_STATES] =
  * It will stop if/when it reaches the end of either the input or the output buffer,
  * or when it reaches an end-marker.
  *
+ * Space in the destination buffer after the decompressed data may be overwritten.
+ *
  * \param a_pOutData: Pointer to destination buffer for decompressed data.
  * \param a_outBufferSize: Size, in bytes, of the destination buffer.
  * \param a_pInData: Pointer to source buffer of compressed data.
@@ -159,10 +351,12 @@ size_t lzs_decompress(uint8_t * a_pOutData, size_t a_outBufferSize, const uint8_
     uint8_t           * outPtr;
     size_t              inRemaining;        // Count of remaining bytes of input
     size_t              outCount;           // Count of output bytes that have been generated
-    uint32_t            bitFieldQueue;      // Code assumes bits will disappear past MS-bit 31 when shifted left.
+    uint64_t            bitFieldQueue;      // Code assumes bits will disappear past MS-bit 63 when shifted left.
     uint_fast8_t        bitFieldQueueLen;
     uint_fast16_t       offset = 0;
     uint_fast8_t        length;
+    uint_fast16_t       token;
+    size_t              count;
     uint8_t             temp8;
     SimpleDecompressState_t state;
 
@@ -178,12 +372,13 @@ size_t lzs_decompress(uint8_t * a_pOutData, size_t a_outBufferSize, const uint8_
     for (;;)
     {
         // Load input data into the bit field queue
-        while ((inRemaining > 0) && (bitFieldQueueLen <= BIT_QUEUE_BITS - 8u))
+        if (bitFieldQueueLen < BIT_READER_REFILL_BITS)
         {
-            bitFieldQueue |= (*inPtr++ << (BIT_QUEUE_BITS - 8u - bitFieldQueueLen));
-            bitFieldQueueLen += 8u;
-            //LZS_DEBUG(("Load queue: %04X\n", bitFieldQueue));
-            inRemaining--;
+            count = lzs_bits_read(inPtr, inRemaining, &bitFieldQueue, bitFieldQueueLen);
+            inPtr += count;
+            inRemaining -= count;
+            bitFieldQueueLen += 8u * count;
+            //LZS_DEBUG(("Load queue: %016"PRIX64"\n", bitFieldQueue));
         }
         // Check if we've reached the end of our input data
         if (bitFieldQueueLen == 0)
@@ -205,41 +400,71 @@ size_t lzs_decompress(uint8_t * a_pOutData, size_t a_outBufferSize, const uint8_
         switch (state)
         {
             case DECOMPRESS_NORMAL:
-                // Get token-type bit
-                //      0 means literal byte
-                //      1 means offset/length token
-
-                // We don't need to check bitFieldQueueLen here because
-                // we already checked above that there is at least 1 bit.
-                temp8 = (bitFieldQueue & (1u << (BIT_QUEUE_BITS - 1u))) ? 1u : 0;
-                bitFieldQueue <<= 1u;
-                bitFieldQueueLen--;
-                if (temp8 == 0)
+                // A literal is a 0 token-type bit then the byte value, so it
+                // is decoded with one shift.
+                if ((bitFieldQueue & (UINT64_C(1) << (BIT_QUEUE_BITS - 1u))) == 0 && bitFieldQueueLen >= LITERAL_BITS)
                 {
-                    // Literal
-                    if (bitFieldQueueLen < 8u)
-                    {
-                        goto finish;
-                    }
-                    temp8 = (uint8_t) (bitFieldQueue >> (BIT_QUEUE_BITS - 8u));
-                    bitFieldQueue <<= 8u;
-                    bitFieldQueueLen -= 8u;
-                    LZS_DEBUG(("Literal %c (%02X)\n", isprint(temp8) ? temp8 : '?', temp8));
-
-                    // Write to output
                     // Not necessary to check for space, because that was done at the top of the main loop.
-                    *outPtr++ = temp8;
+                    *outPtr++ = (uint8_t) (bitFieldQueue >> (BIT_QUEUE_BITS - LITERAL_BITS));
+                    bitFieldQueue <<= LITERAL_BITS;
+                    bitFieldQueueLen -= LITERAL_BITS;
                     outCount++;
+                    break;
+                }
+                // An offset/length token with a short offset is decoded with one table look-up.
+                token = tokenDecodeTable[(bitFieldQueue >> (BIT_QUEUE_BITS - 1u - TOKEN_DECODE_BITS)) & (TOKEN_DECODE_SIZE - 1u)];
+                temp8 = token & TOKEN_WIDTH_MASK;
+                if (temp8 != 0 && temp8 <= bitFieldQueueLen)
+                {
+                    bitFieldQueue <<= temp8;
+                    bitFieldQueueLen -= temp8;
+                    length = (token >> TOKEN_LENGTH_SHIFT) & TOKEN_LENGTH_MASK;
+                    offset = token >> TOKEN_OFFSET_SHIFT;
+                    if (length == MAX_SHORT_LENGTH)
+                    {
+                        // We must go into extended length decode mode
+                        state = DECOMPRESS_EXTENDED;
+                    }
                 }
                 else
                 {
+                    // Long offset, end marker, or the end of the input: decode bit field by bit field.
+
+                    // Get token-type bit
+                    //      0 means literal byte
+                    //      1 means offset/length token
+
+                    // We don't need to check bitFieldQueueLen here because
+                    // we already checked above that there is at least 1 bit.
+                    temp8 = (bitFieldQueue & (UINT64_C(1) << (BIT_QUEUE_BITS - 1u))) ? 1u : 0;
+                    bitFieldQueue <<= 1u;
+                    bitFieldQueueLen--;
+                    if (temp8 == 0)
+                    {
+                        // Literal
+                        if (bitFieldQueueLen < 8u)
+                        {
+                            goto finish;
+                        }
+                        temp8 = (uint8_t) (bitFieldQueue >> (BIT_QUEUE_BITS - 8u));
+                        bitFieldQueue <<= 8u;
+                        bitFieldQueueLen -= 8u;
+                        LZS_DEBUG(("Literal %c (%02X)\n", isprint(temp8) ? temp8 : '?', temp8));
+
+                        // Write to output
+                        // Not necessary to check for space, because that was done at the top of the main loop.
+                        *outPtr++ = temp8;
+                        outCount++;
+                        break;
+                    }
+
                     // Offset+length token
                     // Decode offset
                     if (bitFieldQueueLen < 1u)
                     {
                         goto finish;
                     }
-                    temp8 = (bitFieldQueue & (1u << (BIT_QUEUE_BITS - 1u))) ? 1u : 0;
+                    temp8 = (bitFieldQueue & (UINT64_C(1) << (BIT_QUEUE_BITS - 1u))) ? 1u : 0;
                     bitFieldQueue <<= 1u;
                     bitFieldQueueLen--;
                     if (temp8)
@@ -263,6 +488,7 @@ size_t lzs_decompress(uint8_t * a_pOutData, size_t a_outBufferSize, const uint8_
                             temp8 = bitFieldQueueLen % 8u;
                             bitFieldQueue <<= temp8;
                             bitFieldQueueLen -= temp8;
+                            break;
 #endif
                         }
                     }
@@ -277,132 +503,109 @@ size_t lzs_decompress(uint8_t * a_pOutData, size_t a_outBufferSize, const uint8_
                         bitFieldQueue <<= LONG_OFFSET_BITS;
                         bitFieldQueueLen -= LONG_OFFSET_BITS;
                     }
-                    if (offset != 0)
-                    {
-                        // Decode length and copy characters
+                    // Decode length
 #if LENGTH_DECODE_METHOD == LENGTH_DECODE_METHOD_CODE
-                        /* Length is encoded as:
-                         *  0b00 --> 2
-                         *  0b01 --> 3
-                         *  0b10 --> 4
-                         *  0b1100 --> 5
-                         *  0b1101 --> 6
-                         *  0b1110 --> 7
-                         *  0b1111 xxxx --> 8 (extended)
-                         */
-                        // Get 4 bits
-                        temp8 = (uint8_t) (bitFieldQueue >> (BIT_QUEUE_BITS - 4u));
-                        if (temp8 < 0xC)    // 0xC is 0b1100
-                        {
-                            // Length of 2, 3 or 4, encoded in 2 bits
-                            if (bitFieldQueueLen < 2u)
-                            {
-                                goto finish;
-                            }
-                            length = (temp8 >> 2u) + 2u;
-                            bitFieldQueue <<= 2u;
-                            bitFieldQueueLen -= 2u;
-                        }
-                        else
+                    /* Length is encoded as:
+                     *  0b00 --> 2
+                     *  0b01 --> 3
+                     *  0b10 --> 4
+                     *  0b1100 --> 5
+                     *  0b1101 --> 6
+                     *  0b1110 --> 7
+                     *  0b1111 xxxx --> 8 (extended)
+                     */
+                    // Get 4 bits
+                    temp8 = (uint8_t) (bitFieldQueue >> (BIT_QUEUE_BITS - 4u));
+                    if (temp8 < 0xC)    // 0xC is 0b1100
+                    {
+                        // Length of 2, 3 or 4, encoded in 2 bits
+                        if (bitFieldQueueLen < 2u)
                         {
-                            // Length (encoded in 4 bits) of 5, 6, 7, or (8 + extended)
-                            if (bitFieldQueueLen < 4u)
-                            {
-                                goto finish;
-                            }
-                            length = (temp8 - 0xC + 5u);
-                            bitFieldQueue <<= 4u;
-                            bitFieldQueueLen -= 4u;
-                            if (length == 8u)
-                            {
-                                // We must go into extended length decode mode
-                                state = DECOMPRESS_EXTENDED;
-                            }
+                            goto finish;
                         }
-#endif
-#if LENGTH_DECODE_METHOD == LENGTH_DECODE_METHOD_TABLE
-                        // Get 4 bits, then look up decode data
-                        temp8 = lengthDecodeTable[
-                                                  (uint8_t) (bitFieldQueue >> (BIT_QUEUE_BITS - LENGTH_MAX_BIT_WIDTH))
-                                                 ];
-                        // Length value is in upper nibble
-                        length = temp8 >> 4u;
-                        // Number of bits for this length token is in the lower nibble
-                        temp8 &= 0xF;
-                        if (bitFieldQueueLen < temp8)
+                        length = (temp8 >> 2u) + 2u;
+                        bitFieldQueue <<= 2u;
+                        bitFieldQueueLen -= 2u;
+                    }
+                    else
+                    {
+                        // Length (encoded in 4 bits) of 5, 6, 7, or (8 + extended)
+                        if (bitFieldQueueLen < 4u)
                         {
                             goto finish;
                         }
-                        bitFieldQueue <<= temp8;
-                        bitFieldQueueLen -= temp8;
-                        if (length == MAX_SHORT_LENGTH)
+                        length = (temp8 - 0xC + 5u);
+                        bitFieldQueue <<= 4u;
+                        bitFieldQueueLen -= 4u;
+                        if (length == 8u)
                         {
                             // We must go into extended length decode mode
                             state = DECOMPRESS_EXTENDED;
                         }
+                    }
 #endif
-                        LZS_DEBUG(("(%"PRIuFAST16", %"PRIuFAST8")\n", offset, length));
-                        // Now copy (offset, length) bytes
-                        for (temp8 = 0; temp8 < length; temp8++)
-                        {
-                            // Check offset is within range of valid history.
-                            // If it's not, then write zeros. Avoid information leak.
-                            if (outPtr - offset >= a_pOutData)
-                            {
-                                *outPtr = *(outPtr - offset);
-                            }
-                            else
-                            {
-                                *outPtr = 0;
-                            }
-                            ++outPtr;
-                            ++outCount;
-
-                            if (outCount >= a_outBufferSize)
-                            {
-                                goto finish;
-                            }
-                        }
+#if LENGTH_DECODE_METHOD == LENGTH_DECODE_METHOD_TABLE
+                    // Get 4 bits, then look up decode data
+                    temp8 = lengthDecodeTable[
+                                              (uint8_t) (bitFieldQueue >> (BIT_QUEUE_BITS - LENGTH_MAX_BIT_WIDTH))
+                                             ];
+                    // Length value is in upper nibble
+                    length = temp8 >> 4u;
+                    // Number of bits for this length token is in the lower nibble
+                    temp8 &= 0xF;
+                    if (bitFieldQueueLen < temp8)
+                    {
+                        goto finish;
+                    }
+                    bitFieldQueue <<= temp8;
+                    bitFieldQueueLen -= temp8;
+                    if (length == MAX_SHORT_LENGTH)
+                    {
+                        // We must go into extended length decode mode
+                        state = DECOMPRESS_EXTENDED;
                     }
+#endif
                 }
-                break;
-
-            case DECOMPRESS_EXTENDED:
-                // Extended length token
-                // Get 4 bits
-                if (bitFieldQueueLen < LENGTH_MAX_BIT_WIDTH)
+                LZS_DEBUG(("(%"PRIuFAST16", %"PRIuFAST8")\n", offset, length));
+                // Now copy (offset, length) bytes
+                length = LZSMIN(length, a_outBufferSize - outCount);
+                lzs_history_copy(outPtr, a_pOutData, a_outBufferSize - outCount, offset, length);
+                outPtr += length;
+                outCount += length;
+                if (outCount >= a_outBufferSize)
                 {
                     goto finish;
                 }
-                length = (uint8_t) (bitFieldQueue >> (BIT_QUEUE_BITS - LENGTH_MAX_BIT_WIDTH));
-                bitFieldQueue <<= LENGTH_MAX_BIT_WIDTH;
-                bitFieldQueueLen -= LENGTH_MAX_BIT_WIDTH;
-                // Now copy (offset, length) bytes
-                for (temp8 = 0; temp8 < length; temp8++)
+                break;
+
+            case DECOMPRESS_EXTENDED:
+                // Extended length tokens.
+                // Decode all that are in the bit queue, so a long run doesn't go around the main loop for each.
+                do
                 {
-                    // Check offset is within range of valid history.
-                    // If it's not, then write zeros. Avoid information leak.
-                    if (outPtr - offset >= a_pOutData)
+                    // Get 4 bits
+                    if (bitFieldQueueLen < LENGTH_MAX_BIT_WIDTH)
                     {
-                        *outPtr = *(outPtr - offset);
+                        goto finish;
                     }
-                    else
+                    length = (uint8_t) (bitFieldQueue >> (BIT_QUEUE_BITS - LENGTH_MAX_BIT_WIDTH));
+                    bitFieldQueue <<= LENGTH_MAX_BIT_WIDTH;
+                    bitFieldQueueLen -= LENGTH_MAX_BIT_WIDTH;
+                    if (length != MAX_EXTENDED_LENGTH)
                     {
-                        *outPtr = 0;
+                        // We're finished with extended length decode mode; go back to normal
+                        state = DECOMPRESS_NORMAL;
                     }
-                    ++outPtr;
-                    ++outCount;
-
+                    // Now copy (offset, length) bytes
+                    length = LZSMIN(length, a_outBufferSize - outCount);
+                    lzs_history_copy(outPtr, a_pOutData, a_outBufferSize - outCount, offset, length);
+                    outPtr += length;
+                    outCount += length;
                     if (outCount >= a_outBufferSize)
                     {
                         goto finish;
                     }
-                }
-                if (length != MAX_EXTENDED_LENGTH)
-                {
-                    // We're finished with extended length decode mode; go back to normal
-                    state = DECOMPRESS_NORMAL;
-                }
+                } while (state == DECOMPRESS_EXTENDED && bitFieldQueueLen >= LENGTH_MAX_BIT_WIDTH);
                 break;
         }
     }
@@ -411,6 +614,32 @@ finish:
     return outCount;
 }
 
+/**
+ * \brief Single-call decompression of many independent messages
+ *
+ * Each message is decompressed as by lzs_decompress(). This is the counterpart
+ * of lzs_compress_batch().
+ *
+ * \param pOut: Array of count output buffers. On exit, the length of each is the
+ *              length of the decompressed message.
+ * \param pIn: Array of count compressed messages.
+ * \param count: Number of messages.
+ *
+ * \return size_t: Total number of bytes of decompressed data written to the output buffers.
+ */
+size_t lzs_decompress_batch(LzsBuffer_t * pOut, const LzsConstBuffer_t * pIn, size_t count)
+{
+    size_t              outCount = 0;
+    size_t              i;
+
+    for (i = 0; i < count; i++)
+    {
+        pOut[i].len = lzs_decompress(pOut[i].ptr, pOut[i].len, pIn[i].ptr, pIn[i].len);
+        outCount += pOut[i].len;
+    }
+    return outCount;
+}
+
 
 /**
  * \brief Initialise incremental decompression
@@ -427,6 +656,31 @@ void lzs_decompress_init(LzsDecompressParameters_t * pParams)
     pParams->historyLen = 0;
 }
 
+/**
+ * \brief Set a preset dictionary for incremental decompression
+ *
+ * This must be the same dictionary that was set for compression, by
+ * lzs_compress_set_dictionary(). Only the last LZS_MAX_HISTORY_SIZE bytes of
+ * a longer dictionary are used.
+ *
+ * This must be called after lzs_decompress_init(), before any input is given.
+ *
+ * \param pParams: Pointer to struct to store incremental decompression state.
+ * \param pDictionary: Dictionary data.
+ * \param dictionaryLen: Length of the dictionary, in bytes.
+ */
+void lzs_decompress_set_dictionary(LzsDecompressParameters_t * pParams, const uint8_t * pDictionary, size_t dictionaryLen)
+{
+    if (dictionaryLen > LZS_DECOMPRESS_HISTORY_SIZE)
+    {
+        pDictionary += dictionaryLen - LZS_DECOMPRESS_HISTORY_SIZE;
+        dictionaryLen = LZS_DECOMPRESS_HISTORY_SIZE;
+    }
+    memcpy(pParams->historyBuffer, pDictionary, dictionaryLen);
+    pParams->historyLatestIdx = lzs_idx_inc_wrap(0, dictionaryLen, sizeof(pParams->historyBuffer));
+    pParams->historyLen = dictionaryLen;
+}
+
 
 /**
  * \brief Incremental decompression
@@ -460,6 +714,7 @@ size_t lzs_decompress_incremental(LzsDecompressParameters_t * pParams)
 {
     size_t              outCount;           // Count of output bytes that have been generated
     uint_fast16_t       offset;
+    size_t              count;
     uint_fast8_t        temp8;
 
 
@@ -469,12 +724,13 @@ size_t lzs_decompress_incremental(LzsDecompressParameters_t * pParams)
     for (;;)
     {
         // Load input data into the bit field queue
-        while ((pParams->inLength > 0) && (pParams->bitFieldQueueLen <= BIT_QUEUE_BITS - 8u))
+        if (pParams->bitFieldQueueLen < BIT_READER_REFILL_BITS)
         {
-            pParams->bitFieldQueue |= (*pParams->inPtr++ << (BIT_QUEUE_BITS - 8u - pParams->bitFieldQueueLen));
-            pParams->bitFieldQueueLen += 8u;
-            //LZS_DEBUG(("Load queue: %04X\n", pParams->bitFieldQueue));
-            pParams->inLength--;
+            count = lzs_bits_read(pParams->inPtr, pParams->inLength, &pParams->bitFieldQueue, pParams->bitFieldQueueLen);
+            pParams->inPtr += count;
+            pParams->inLength -= count;
+            pParams->bitFieldQueueLen += 8u * count;
+            //LZS_DEBUG(("Load queue: %016"PRIX64"\n", pParams->bitFieldQueue));
         }
         // Check if we've reached the end of our input data
         if (pParams->bitFieldQueueLen == 0)
@@ -506,7 +762,7 @@ size_t lzs_decompress_incremental(LzsDecompressParameters_t * pParams)
         {
             case DECOMPRESS_GET_TOKEN_TYPE:
                 // Get token-type bit
-                if (pParams->bitFieldQueue & (1u << (BIT_QUEUE_BITS - 1u)))
+                if (pParams->bitFieldQueue & (UINT64_C(1) << (BIT_QUEUE_BITS - 1u)))
                 {
                     pParams->state = DECOMPRESS_GET_OFFSET_TYPE;
                 }
@@ -550,7 +806,7 @@ size_t lzs_decompress_incremental(LzsDecompressParameters_t * pParams)
             case DECOMPRESS_GET_OFFSET_TYPE:
                 // Offset+length token
                 // Decode offset
-                temp8 = (pParams->bitFieldQueue & (1u << (BIT_QUEUE_BITS - 1u))) ? 1u : 0;
+                temp8 = (pParams->bitFieldQueue & (UINT64_C(1) << (BIT_QUEUE_BITS - 1u))) ? 1u : 0;
                 pParams->bitFieldQueue <<= 1u;
                 pParams->bitFieldQueueLen--;
                 pParams->state = temp8 ? DECOMPRESS_GET_OFFSET_SHORT : DECOMPRESS_GET_OFFSET_LONG;
@@ -662,51 +918,19 @@ size_t lzs_decompress_incremental(LzsDecompressParameters_t * pParams)
             case DECOMPRESS_COPY_EXTENDED_DATA:
                 // Copy (offset, length) bytes.
                 // Offset has already been used to calculate pParams->historyReadIdx.
-                offset = pParams->offset;
-                for (;;)
+                count = LZSMIN(pParams->length, pParams->outLength);
+                lzs_history_ring_copy(pParams, count);
+                outCount += count;
+                if (pParams->length == 0)
                 {
-                    if (pParams->length == 0)
-                    {
-                        // We're finished copying. Change state, and exit this inner copying loop.
-                        pParams->state++;   // Goes to either DECOMPRESS_GET_TOKEN_TYPE or DECOMPRESS_GET_EXTENDED_LENGTH
-                        break;
-                    }
-                    // Check if we have space in the output buffer
-                    if (pParams->outLength == 0)
-                    {
-                        // We're out of space in the output buffer.
-                        // Set status, exit this inner copying loop, but maintain the current state.
-                        pParams->status |= LZS_D_STATUS_NO_OUTPUT_BUFFER_SPACE;
-                        break;
-                    }
-
-                    // Get byte from history.
-                    // Check offset is within range of valid history.
-                    // If it's not, then write zeros. Avoid information leak.
-                    if (offset <= pParams->historyLen)
-                    {
-                        temp8 = pParams->historyBuffer[pParams->historyReadIdx];
-                    }
-                    else
-                    {
-                        temp8 = 0;
-                    }
-
-                    pParams->historyReadIdx = lzs_idx_inc_wrap(pParams->historyReadIdx, 1u,
-                                                                sizeof(pParams->historyBuffer));
-
-                    // Write to output
-                    *pParams->outPtr++ = temp8;
-                    pParams->outLength--;
-                    pParams->length--;
-                    ++outCount;
-
-                    // Write to history
-                    pParams->historyBuffer[pParams->historyLatestIdx] = temp8;
-
-                    pParams->historyLatestIdx = lzs_idx_inc_wrap(pParams->historyLatestIdx, 1u,
-                                                                sizeof(pParams->historyBuffer));
-                    pParams->historyLen = LZSMIN(pParams->historyLen + 1u, LZS_MAX_HISTORY_SIZE);
+                    // We're finished copying. Change state.
+                    pParams->state++;   // Goes to either DECOMPRESS_GET_TOKEN_TYPE or DECOMPRESS_GET_EXTENDED_LENGTH
+                }
+                else
+                {
+                    // We're out of space in the output buffer.
+                    // Set status, but maintain the current state.
+                    pParams->status |= LZS_D_STATUS_NO_OUTPUT_BUFFER_SPACE;
                 }
                 break;
 
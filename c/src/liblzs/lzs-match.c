@@ -0,0 +1,561 @@
+/*****************************************************************************
+ *
+ * \file
+ *
+ * \brief LZS Compression match-length and byte-pair scan kernels
+ *
+ * Counting the length of a match between the look-ahead data and a candidate
+ * position in the history is the innermost operation of the compressors.
+ * Several implementations are provided, and the fastest one supported by the
+ * CPU is selected the first time a match length is counted.
+ *
+ * The simple compressor has no hash tables, so it finds its candidates by
+ * scanning the history for the first two look-ahead bytes. A scan kernel of the
+ * same kind is selected along with the match-length kernel.
+ *
+ * This code is licensed according to the MIT license as follows:
+ * ----------------------------------------------------------------------------
+ * Copyright (c) 2017 Craig McQueen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ * ----------------------------------------------------------------------------
+ ****************************************************************************/
+
+
+/*****************************************************************************
+ * Includes
+ ****************************************************************************/
+
+#include "lzs.h"
+#include "lzs-common.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#if LZS_MATCH_HAVE_X86
+#include <immintrin.h>
+#endif
+
+
+/*****************************************************************************
+ * Defines
+ ****************************************************************************/
+
+#if defined(__GNUC__) && defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+#define LZS_MATCH_WORD64_CTZ        1
+#elif defined(__GNUC__) && defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+#define LZS_MATCH_WORD64_CLZ        1
+#endif
+
+
+/*****************************************************************************
+ * Local function prototypes
+ ****************************************************************************/
+
+static size_t lzs_match_len_resolve(const uint8_t * aPtr, const uint8_t * bPtr, size_t matchMax);
+static size_t lzs_pair_scan_resolve(const uint8_t * pData, size_t count, uint8_t first, uint8_t second);
+
+
+/*****************************************************************************
+ * Variables
+ ****************************************************************************/
+
+/*
+ * Initially these point to resolvers, which replace them with the selected
+ * kernels on the first call. Writing the pointers is idempotent, so concurrent
+ * first calls from several threads are harmless.
+ */
+LzsMatchLenFunc_t   lzs_match_len_func = lzs_match_len_resolve;
+LzsPairScanFunc_t   lzs_pair_scan_func = lzs_pair_scan_resolve;
+
+static LzsMatchKernel_t lzs_match_kernel = LZS_MATCH_KERNEL_AUTO;
+
+
+/*****************************************************************************
+ * Kernels
+ ****************************************************************************/
+
+/**
+ * \brief Count the length of a match, comparing one byte at a time
+ *
+ * This is the portable reference implementation.
+ *
+ * \param aPtr: Pointer to 1st data block.
+ * \param bPtr: Pointer to 2nd data block.
+ * \param matchMax: Maximum match length to count.
+ *
+ * \return size_t: Length of consecutive matching bytes between the two data blocks.
+ */
+static size_t lzs_match_len_byte(const uint8_t * aPtr, const uint8_t * bPtr, size_t matchMax)
+{
+    size_t          len;
+
+
+    for (len = 0; len < matchMax; len++)
+    {
+        if (aPtr[len] != bPtr[len])
+        {
+            break;
+        }
+    }
+    return len;
+}
+
+/**
+ * \brief Count the length of a match, comparing 8 bytes at a time
+ *
+ * The first mismatching byte of a 64-bit word is found from the XOR of the two
+ * words, by counting trailing (little-endian) or leading (big-endian) zero bits.
+ * Data beyond `matchMax` is never read.
+ *
+ * \param aPtr: Pointer to 1st data block.
+ * \param bPtr: Pointer to 2nd data block.
+ * \param matchMax: Maximum match length to count.
+ *
+ * \return size_t: Length of consecutive matching bytes between the two data blocks.
+ */
+static size_t lzs_match_len_word64(const uint8_t * aPtr, const uint8_t * bPtr, size_t matchMax)
+{
+    size_t          len;
+    uint64_t        aWord;
+    uint64_t        bWord;
+    uint64_t        diff;
+
+
+    for (len = 0; len + 8u <= matchMax; len += 8u)
+    {
+        memcpy(&aWord, aPtr + len, sizeof(aWord));
+        memcpy(&bWord, bPtr + len, sizeof(bWord));
+        diff = aWord ^ bWord;
+        if (diff != 0)
+        {
+#if LZS_MATCH_WORD64_CTZ
+            return len + ((size_t)__builtin_ctzll(diff) >> 3u);
+#elif LZS_MATCH_WORD64_CLZ
+            return len + ((size_t)__builtin_clzll(diff) >> 3u);
+#else
+            break;
+#endif
+        }
+    }
+    return len + lzs_match_len_byte(aPtr + len, bPtr + len, matchMax - len);
+}
+
+/**
+ * \brief Find the last position where a pair of bytes starts, checking one position at a time
+ *
+ * This is the portable reference implementation.
+ *
+ * \param pData: Pointer to data block, of `count + 1` bytes.
+ * \param count: Number of positions to scan.
+ * \param first: Value of the first byte of the pair.
+ * \param second: Value of the second byte of the pair.
+ *
+ * \return size_t: Position of the last match of the pair, or `count` if there is none.
+ */
+static size_t lzs_pair_scan_byte(const uint8_t * pData, size_t count, uint8_t first, uint8_t second)
+{
+    size_t          i;
+
+
+    for (i = count; i-- > 0; )
+    {
+        if (pData[i] == first && pData[i + 1u] == second)
+        {
+            return i;
+        }
+    }
+    return count;
+}
+
+/**
+ * \brief Find the last position where a pair of bytes starts, checking 8 positions at a time
+ *
+ * Two overlapping 64-bit words are compared against the two bytes repeated,
+ * and the compare results are combined into a mask with the top bit of each
+ * byte set at positions where the pair starts. The mask has no false positives,
+ * so the last hit is found by counting leading (little-endian) or trailing
+ * (big-endian) zero bits.
+ *
+ * \param pData: Pointer to data block, of `count + 1` bytes.
+ * \param count: Number of positions to scan.
+ * \param first: Value of the first byte of the pair.
+ * \param second: Value of the second byte of the pair.
+ *
+ * \return size_t: Position of the last match of the pair, or `count` if there is none.
+ */
+static size_t lzs_pair_scan_word64(const uint8_t * pData, size_t count, uint8_t first, uint8_t second)
+{
+#if LZS_MATCH_WORD64_CTZ || LZS_MATCH_WORD64_CLZ
+    const uint64_t  lowBits = UINT64_C(0x7F7F7F7F7F7F7F7F);
+    const uint64_t  firstWord = UINT64_C(0x0101010101010101) * first;
+    const uint64_t  secondWord = UINT64_C(0x0101010101010101) * second;
+    size_t          i;
+    size_t          pos;
+    uint64_t        aWord;
+    uint64_t        bWord;
+    uint64_t        diff;
+    uint64_t        mask;
+
+
+    for (i = count; i >= 8u; i -= 8u)
+    {
+        memcpy(&aWord, pData + i - 8u, sizeof(aWord));
+        memcpy(&bWord, pData + i - 7u, sizeof(bWord));
+        diff = (aWord ^ firstWord) | (bWord ^ secondWord);
+        // Top bit of each byte is set if, and only if, that byte of diff is 0.
+        mask = ~(((diff & lowBits) + lowBits) | diff | lowBits);
+        if (mask != 0)
+        {
+#if LZS_MATCH_WORD64_CTZ
+            return i - 8u + ((size_t)(63 - __builtin_clzll(mask)) >> 3u);
+#else
+            return i - 1u - ((size_t)__builtin_ctzll(mask) >> 3u);
+#endif
+        }
+    }
+    // Fewer than 8 positions remain.
+    pos = lzs_pair_scan_byte(pData, i, first, second);
+    return (pos < i) ? pos : count;
+#else
+    return lzs_pair_scan_byte(pData, count, first, second);
+#endif
+}
+
+#if LZS_MATCH_HAVE_X86
+
+/**
+ * \brief Count the length of a match, comparing 16 bytes at a time with SSE2
+ *
+ * Tails shorter than 16 bytes are handled by the 64-bit kernel, so data beyond
+ * `matchMax` is never read.
+ *
+ * \param aPtr: Pointer to 1st data block.
+ * \param bPtr: Pointer to 2nd data block.
+ * \param matchMax: Maximum match length to count.
+ *
+ * \return size_t: Length of consecutive matching bytes between the two data blocks.
+ */
+__attribute__((target("sse2")))
+static size_t lzs_match_len_sse2(const uint8_t * aPtr, const uint8_t * bPtr, size_t matchMax)
+{
+    size_t          len;
+    __m128i         aVec;
+    __m128i         bVec;
+    unsigned int    mask;
+
+
+    for (len = 0; len + 16u <= matchMax; len += 16u)
+    {
+        aVec = _mm_loadu_si128((const __m128i *)(aPtr + len));
+        bVec = _mm_loadu_si128((const __m128i *)(bPtr + len));
+        mask = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(aVec, bVec)) ^ 0xFFFFu;
+        if (mask != 0)
+        {
+            return len + (size_t)__builtin_ctz(mask);
+        }
+    }
+    return len + lzs_match_len_word64(aPtr + len, bPtr + len, matchMax - len);
+}
+
+/**
+ * \brief Count the length of a match, comparing 32 bytes at a time with AVX2
+ *
+ * Tails shorter than 32 bytes are handled by the 64-bit kernel, so data beyond
+ * `matchMax` is never read.
+ *
+ * \param aPtr: Pointer to 1st data block.
+ * \param bPtr: Pointer to 2nd data block.
+ * \param matchMax: Maximum match length to count.
+ *
+ * \return size_t: Length of consecutive matching bytes between the two data blocks.
+ */
+__attribute__((target("avx2")))
+static size_t lzs_match_len_avx2(const uint8_t * aPtr, const uint8_t * bPtr, size_t matchMax)
+{
+    size_t          len;
+    __m256i         aVec;
+    __m256i         bVec;
+    uint32_t        mask;
+
+
+    for (len = 0; len + 32u <= matchMax; len += 32u)
+    {
+        aVec = _mm256_loadu_si256((const __m256i *)(aPtr + len));
+        bVec = _mm256_loadu_si256((const __m256i *)(bPtr + len));
+        mask = ~(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(aVec, bVec));
+        if (mask != 0)
+        {
+            return len + (size_t)__builtin_ctz(mask);
+        }
+    }
+    return len + lzs_match_len_word64(aPtr + len, bPtr + len, matchMax - len);
+}
+
+/**
+ * \brief Find the last position where a pair of bytes starts, checking 16 positions at a time with SSE2
+ *
+ * Fewer than 16 remaining positions are handled by the 64-bit kernel.
+ *
+ * \param pData: Pointer to data block, of `count + 1` bytes.
+ * \param count: Number of positions to scan.
+ * \param first: Value of the first byte of the pair.
+ * \param second: Value of the second byte of the pair.
+ *
+ * \return size_t: Position of the last match of the pair, or `count` if there is none.
+ */
+__attribute__((target("sse2")))
+static size_t lzs_pair_scan_sse2(const uint8_t * pData, size_t count, uint8_t first, uint8_t second)
+{
+    const __m128i   firstVec = _mm_set1_epi8((char)first);
+    const __m128i   secondVec = _mm_set1_epi8((char)second);
+    size_t          i;
+    size_t          pos;
+    __m128i         aVec;
+    __m128i         bVec;
+    unsigned int    mask;
+
+
+    for (i = count; i >= 16u; i -= 16u)
+    {
+        aVec = _mm_loadu_si128((const __m128i *)(pData + i - 16u));
+        bVec = _mm_loadu_si128((const __m128i *)(pData + i - 15u));
+        mask = (unsigned int)_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(aVec, firstVec),
+                                                             _mm_cmpeq_epi8(bVec, secondVec)));
+        if (mask != 0)
+        {
+            return i - 16u + (size_t)(31 - __builtin_clz(mask));
+        }
+    }
+    pos = lzs_pair_scan_word64(pData, i, first, second);
+    return (pos < i) ? pos : count;
+}
+
+/**
+ * \brief Find the last position where a pair of bytes starts, checking 32 positions at a time with AVX2
+ *
+ * Fewer than 32 remaining positions are handled by the 64-bit kernel.
+ *
+ * \param pData: Pointer to data block, of `count + 1` bytes.
+ * \param count: Number of positions to scan.
+ * \param first: Value of the first byte of the pair.
+ * \param second: Value of the second byte of the pair.
+ *
+ * \return size_t: Position of the last match of the pair, or `count` if there is none.
+ */
+__attribute__((target("avx2")))
+static size_t lzs_pair_scan_avx2(const uint8_t * pData, size_t count, uint8_t first, uint8_t second)
+{
+    const __m256i   firstVec = _mm256_set1_epi8((char)first);
+    const __m256i   secondVec = _mm256_set1_epi8((char)second);
+    size_t          i;
+    size_t          pos;
+    __m256i         aVec;
+    __m256i         bVec;
+    uint32_t        mask;
+
+
+    for (i = count; i >= 32u; i -= 32u)
+    {
+        aVec = _mm256_loadu_si256((const __m256i *)(pData + i - 32u));
+        bVec = _mm256_loadu_si256((const __m256i *)(pData + i - 31u));
+        mask = (uint32_t)_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(aVec, firstVec),
+                                                               _mm256_cmpeq_epi8(bVec, secondVec)));
+        if (mask != 0)
+        {
+            return i - 32u + (size_t)(31 - __builtin_clz(mask));
+        }
+    }
+    pos = lzs_pair_scan_word64(pData, i, first, second);
+    return (pos < i) ? pos : count;
+}
+
+#endif // LZS_MATCH_HAVE_X86
+
+
+/*****************************************************************************
+ * Local Functions
+ ****************************************************************************/
+
+/**
+ * \brief Check whether a match-length kernel can run on this CPU
+ *
+ * \param kernel: Kernel to check.
+ *
+ * \return bool: true if the kernel is supported.
+ */
+static bool lzs_match_kernel_supported(LzsMatchKernel_t kernel)
+{
+    switch (kernel)
+    {
+        case LZS_MATCH_KERNEL_AUTO:
+        case LZS_MATCH_KERNEL_BYTE:
+        case LZS_MATCH_KERNEL_WORD64:
+            return true;
+#if LZS_MATCH_HAVE_X86
+        case LZS_MATCH_KERNEL_SSE2:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("sse2");
+        case LZS_MATCH_KERNEL_AVX2:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2");
+#endif
+        default:
+            return false;
+    }
+}
+
+/**
+ * \brief Return the kernel function for a (supported) match-length kernel
+ *
+ * LZS_MATCH_KERNEL_AUTO is resolved to the best kernel supported by the CPU.
+ *
+ * \param pKernel: Pointer to the kernel to look up. Updated if it is LZS_MATCH_KERNEL_AUTO.
+ *
+ * \return LzsMatchLenFunc_t: Kernel function.
+ */
+static LzsMatchLenFunc_t lzs_match_kernel_func(LzsMatchKernel_t * pKernel)
+{
+    if (*pKernel == LZS_MATCH_KERNEL_AUTO)
+    {
+        if (lzs_match_kernel_supported(LZS_MATCH_KERNEL_AVX2))
+        {
+            *pKernel = LZS_MATCH_KERNEL_AVX2;
+        }
+        else if (lzs_match_kernel_supported(LZS_MATCH_KERNEL_SSE2))
+        {
+            *pKernel = LZS_MATCH_KERNEL_SSE2;
+        }
+        else
+        {
+            *pKernel = LZS_MATCH_KERNEL_WORD64;
+        }
+    }
+    switch (*pKernel)
+    {
+        case LZS_MATCH_KERNEL_WORD64:
+            return lzs_match_len_word64;
+#if LZS_MATCH_HAVE_X86
+        case LZS_MATCH_KERNEL_SSE2:
+            return lzs_match_len_sse2;
+        case LZS_MATCH_KERNEL_AVX2:
+            return lzs_match_len_avx2;
+#endif
+        default:
+            return lzs_match_len_byte;
+    }
+}
+
+/**
+ * \brief Return the byte-pair scan function that goes with a match-length kernel
+ *
+ * \param kernel: Kernel to look up. Must not be LZS_MATCH_KERNEL_AUTO.
+ *
+ * \return LzsPairScanFunc_t: Scan function.
+ */
+static LzsPairScanFunc_t lzs_pair_scan_kernel_func(LzsMatchKernel_t kernel)
+{
+    switch (kernel)
+    {
+        case LZS_MATCH_KERNEL_WORD64:
+            return lzs_pair_scan_word64;
+#if LZS_MATCH_HAVE_X86
+        case LZS_MATCH_KERNEL_SSE2:
+            return lzs_pair_scan_sse2;
+        case LZS_MATCH_KERNEL_AVX2:
+            return lzs_pair_scan_avx2;
+#endif
+        default:
+            return lzs_pair_scan_byte;
+    }
+}
+
+/**
+ * \brief Select the match-length kernel on first use, then count a match
+ *
+ * \param aPtr: Pointer to 1st data block.
+ * \param bPtr: Pointer to 2nd data block.
+ * \param matchMax: Maximum match length to count.
+ *
+ * \return size_t: Length of consecutive matching bytes between the two data blocks.
+ */
+static size_t lzs_match_len_resolve(const uint8_t * aPtr, const uint8_t * bPtr, size_t matchMax)
+{
+    lzs_match_kernel_select(LZS_MATCH_KERNEL_AUTO);
+    return lzs_match_len_func(aPtr, bPtr, matchMax);
+}
+
+/**
+ * \brief Select the match-length kernel on first use, then scan for a byte pair
+ *
+ * \param pData: Pointer to data block, of `count + 1` bytes.
+ * \param count: Number of positions to scan.
+ * \param first: Value of the first byte of the pair.
+ * \param second: Value of the second byte of the pair.
+ *
+ * \return size_t: Position of the last match of the pair, or `count` if there is none.
+ */
+static size_t lzs_pair_scan_resolve(const uint8_t * pData, size_t count, uint8_t first, uint8_t second)
+{
+    lzs_match_kernel_select(LZS_MATCH_KERNEL_AUTO);
+    return lzs_pair_scan_func(pData, count, first, second);
+}
+
+
+/*****************************************************************************
+ * Functions
+ ****************************************************************************/
+
+/**
+ * \brief Select the match-length kernel used by all compressors
+ *
+ * The byte-pair scan kernel used by the simple compressor is selected with it.
+ * Normally the kernel is selected automatically, and there is no need to call
+ * this. It is useful for benchmarking and testing the individual kernels.
+ * It should not be called while compression is in progress in another thread.
+ *
+ * \param kernel: Kernel to use, or LZS_MATCH_KERNEL_AUTO for the best one supported by the CPU.
+ *
+ * \return bool: true if successful; false if the kernel is not supported on this CPU.
+ */
+bool lzs_match_kernel_select(LzsMatchKernel_t kernel)
+{
+    if (!lzs_match_kernel_supported(kernel))
+    {
+        return false;
+    }
+    lzs_match_len_func = lzs_match_kernel_func(&kernel);
+    lzs_pair_scan_func = lzs_pair_scan_kernel_func(kernel);
+    lzs_match_kernel = kernel;
+    return true;
+}
+
+/**
+ * \brief Get the match-length kernel used by all compressors
+ *
+ * \return LzsMatchKernel_t: The selected kernel, never LZS_MATCH_KERNEL_AUTO.
+ */
+LzsMatchKernel_t lzs_match_kernel_get(void)
+{
+    if (lzs_match_kernel == LZS_MATCH_KERNEL_AUTO)
+    {
+        lzs_match_kernel_select(LZS_MATCH_KERNEL_AUTO);
+    }
+    return lzs_match_kernel;
+}
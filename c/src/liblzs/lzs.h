@@ -63,9 +63,39 @@
 // Implementation detail: the history buffer also stores look-ahead data.
 #define LZS_COMPRESS_HISTORY_SIZE   (LZS_MAX_HISTORY_SIZE + LZS_MAX_LOOK_AHEAD_LEN)
 
+// Size of the linear history window for incremental compression, with hash
+// chains. History and look-ahead are stored at increasing positions, and slid
+// back to the start of the window when they reach its end.
+#define LZS_COMPRESS_WINDOW_SIZE    (2u * LZS_MAX_HISTORY_SIZE)
+
 #define LZS_DECOMPRESS_HISTORY_SIZE LZS_MAX_HISTORY_SIZE
 
-#define INPUT_HASH_SIZE             (1u << 12u)
+// Hash table size for incremental compression, and the default for single-call compression.
+#define INPUT_HASH_BITS             12u
+#define INPUT_HASH_SIZE             (1u << INPUT_HASH_BITS)
+
+// Size of the 2-byte hash table that is used alongside 3-byte and 4-byte hashing.
+#define INPUT_HASH2_BITS            10u
+#define INPUT_HASH2_SIZE            (1u << INPUT_HASH2_BITS)
+
+// Hash table of the compact incremental compressor: (1 << LZS_COMPACT_HASH_BITS)
+// buckets, each of the latest LZS_COMPACT_HASH_WAYS positions with the same hash.
+#define LZS_COMPACT_HASH_BITS       8u
+#define LZS_COMPACT_HASH_WAYS       4u
+
+// Hash table of the lite compressors: (1 << LZS_LITE_HASH_BITS) entries, each
+// the latest position with the same hash of its first two bytes.
+#define LZS_LITE_HASH_BITS          8u
+
+// Number of uint16_t at the start of a compression workspace, before the hash tables.
+#define LZS_WORKSPACE_HEADER_LEN    4u
+
+// Number of nodes of the binary tree match finder: a power of two that covers the history.
+#define LZS_TREE_WINDOW_SIZE        2048u
+
+// Number of bytes of workspace for the tables of optimal parsing, which follow the
+// match finder's tables.
+#define LZS_OPTIMAL_WORKSPACE_LEN   (14u * 1024u)
 
 
 /*****************************************************************************
@@ -80,6 +110,41 @@
 // size X. Worst case is 16 times original size.
 #define LZS_DECOMPRESSED_MAX(X)     ((X) * 16u)
 
+// Compression levels. Higher levels search harder for matches, so are slower
+// but usually give smaller output.
+// LZS_COMPRESS_LEVEL_MAX uses optimal parsing with the binary tree match finder
+// for single-call compression with a workspace, which is much slower. Without a
+// workspace, and for incremental compression, it is treated as
+// LZS_COMPRESS_LEVEL_BEST.
+// Levels 1 to 4 also search fewer positions while the input looks incompressible
+// (incompressibleRun).
+#define LZS_COMPRESS_LEVEL_FASTEST  1u
+#define LZS_COMPRESS_LEVEL_DEFAULT  6u
+#define LZS_COMPRESS_LEVEL_BEST     9u
+#define LZS_COMPRESS_LEVEL_MAX      10u
+
+// Range of hash table sizes, as log2 of the number of entries. Sizes above
+// INPUT_HASH_BITS need a workspace; see lzs_compress_workspace_size().
+#define LZS_HASH_BITS_MIN           8u
+#define LZS_HASH_BITS_MAX           16u
+
+// Size in bytes of the workspace for lzs_compress_config_ws(), for a hash table
+// of (1 << hashBits) entries. lzs_compress_ws() needs LZS_WORKSPACE_SIZE(INPUT_HASH_BITS).
+#define LZS_WORKSPACE_SIZE(hashBits)    \
+    ((LZS_WORKSPACE_HEADER_LEN + (1u << (hashBits)) + LZS_MAX_HISTORY_SIZE + INPUT_HASH2_SIZE) * sizeof(uint16_t))
+
+// Size in bytes of the workspace for lzs_compress_config_ws() with the binary tree
+// match finder, for a hash table of (1 << hashBits) entries.
+#define LZS_TREE_WORKSPACE_SIZE(hashBits)   \
+    (LZS_WORKSPACE_HEADER_LEN * sizeof(uint16_t) +  \
+     ((1u << (hashBits)) + INPUT_HASH2_SIZE + 2u * LZS_TREE_WINDOW_SIZE) * sizeof(uint32_t))
+
+// Size in bytes of the workspace for lzs_compress_config_ws() with optimal parsing,
+// given finderSize, the size for the match finder: LZS_WORKSPACE_SIZE() or
+// LZS_TREE_WORKSPACE_SIZE().
+#define LZS_OPTIMAL_WORKSPACE_SIZE(finderSize)  \
+    (((finderSize) + 3u) / 4u * 4u + LZS_OPTIMAL_WORKSPACE_LEN)
+
 
 /*****************************************************************************
  * Typedefs
@@ -95,9 +160,66 @@ typedef enum
     LZS_C_STATUS_INPUT_FINISHED         = 0x02, // All available input has been read.
     LZS_C_STATUS_END_MARKER             = 0x04, // The output contains an end-marker.
     LZS_C_STATUS_NO_OUTPUT_BUFFER_SPACE = 0x08, // There is no more space left in the output buffer.
-    LZS_C_STATUS_ERROR                  = 0x10  // An error occurred in the compression.
+    LZS_C_STATUS_ERROR                  = 0x10, // An error occurred in the compression.
+    LZS_C_STATUS_BUDGET_EXHAUSTED       = 0x20, // The work budget of the call was used up. Call again to continue.
+    LZS_C_STATUS_INCOMPRESSIBLE         = 0x40  // The recent input looked incompressible, so only some positions are being searched for matches.
 } LzsCompressStatus_t;
 
+typedef enum
+{
+    LZS_FLUSH_NONE                      = 0x00,
+    LZS_FLUSH_SYNC                      = 0x01, // End marker after all input; the history is kept.
+    LZS_FLUSH_FULL                      = 0x02  // End marker after all input, then the history is reset.
+} LzsFlush_t;
+
+typedef enum
+{
+    LZS_HASH_LEGACY,                    // 2 bytes, (a << 4) ^ b, as in earlier versions
+    LZS_HASH_2BYTE,                     // 2 bytes, multiplicative, or exact if hashBits is 16
+    LZS_HASH_3BYTE,                     // 3 bytes, multiplicative
+    LZS_HASH_4BYTE,                     // 4 bytes, multiplicative. Shortest hash chains, for fast levels.
+
+    NUM_LZS_HASH_TYPES
+} LzsHashType_t;
+
+typedef enum
+{
+    LZS_MATCH_FINDER_HASH_CHAIN,        // Hash chains of the history, latest first
+    LZS_MATCH_FINDER_BINARY_TREE,       // Binary trees of the history, sorted by content. Single-call compression only.
+
+    NUM_LZS_MATCH_FINDERS
+} LzsMatchFinderType_t;
+
+typedef struct
+{
+    uint16_t            chainMax;           // Maximum number of hash chain candidates to check for each input position (1 or more)
+    uint8_t             niceLength;         // Stop searching when a match of this length is found
+    uint8_t             searchLength;       // Maximum match length to search for, from 2 to LZS_MAX_LOOK_AHEAD_LEN
+    uint8_t             lazyLength;         // Check the following input positions for a better match when the best match is shorter than this. 0 to disable.
+    uint8_t             lazySteps;          // Number of following input positions to check: 1 for lazy, 2 for two-step lazy matching
+    uint8_t             optimal;            // Non-zero to use optimal parsing in single-call compression with a workspace. Ignored by incremental compression.
+    uint8_t             hashType;           // LzsHashType_t. Matches shorter than the hashed length are found in a 2-byte hash table.
+    uint8_t             hashBits;           // Hash table size, as log2 of the number of entries. 0 for INPUT_HASH_BITS.
+    uint8_t             matchFinder;        // LzsMatchFinderType_t. chainMax limits the tree nodes visited. Incremental compression uses hash chains.
+    uint8_t             incompressibleRun;  // After this many literals in a row, only search some positions, until a match is found. 0 to disable. Ignored by optimal parsing.
+} LzsCompressConfig_t;
+
+typedef struct
+{
+    /*
+     * These are private members, set by lzs_dictionary_init(), and should not be changed.
+     * A dictionary can be attached to any number of contexts, concurrently.
+     */
+    uint8_t             data[LZS_MAX_HISTORY_SIZE];
+    uint16_t            historyHash[LZS_MAX_HISTORY_SIZE];
+    uint16_t            hashTable[INPUT_HASH_SIZE];
+    uint16_t            hash2Table[INPUT_HASH2_SIZE];
+    uint16_t            len;
+    uint16_t            hashedLen;          // Number of leading positions that are in the hash tables
+    uint8_t             hashType;           // LzsHashType_t that the hash tables were built for
+    uint8_t             hashBits;           // Hash table size that the hash tables were built for
+} LzsDictionary_t;
+
 typedef struct
 {
     /*
@@ -109,6 +231,7 @@ typedef struct
     uint8_t           * outPtr;             // On entry, point to output data buffer. On exit, points to one past the last output data byte
     size_t              inLength;           // On entry, set this to the length of the input data. On exit, it is the length of unprocessed data
     size_t              outLength;          // On entry, set this to the space in the output buffer. On exit, decremented by the number of output bytes generated
+    size_t              workBudget;         // Maximum work for each call, in hash insertions and match candidates checked. 0 (set by init) for no limit
 
    /*
     * status is one or more flags of LzsCompressStatus_t.
@@ -120,15 +243,22 @@ typedef struct
     /*
      * These are private members, and should not be changed.
      */
-    uint8_t             historyBuffer[LZS_COMPRESS_HISTORY_SIZE];
-    uint16_t            historyHash[LZS_COMPRESS_HISTORY_SIZE];
+    uint8_t             historyBuffer[LZS_COMPRESS_WINDOW_SIZE];
+    uint16_t            historyHash[LZS_COMPRESS_WINDOW_SIZE];
     uint16_t            hashTable[INPUT_HASH_SIZE];
+    uint16_t            hash2Table[INPUT_HASH2_SIZE];
+    LzsCompressConfig_t config;
     uint8_t             lookAheadLen;
-    uint32_t            bitFieldQueue;      // Code assumes bits will disappear past MS-bit 31 when shifted left
+    uint8_t             lookAheadHashedLen; // Number of look-ahead bytes already in the hash tables
+    uint8_t             lazyLiterals;       // Number of literals still to output before a match found by lazy matching
+    uint16_t            literalRun;         // Number of literals in a row, for detecting incompressible input
+    uint64_t            bitFieldQueue;      // Code assumes bits will disappear past MS-bit 63 when shifted left
     uint8_t             bitFieldQueueLen;   // Number of bits in the queue
     uint16_t            historyLatestIdx;
     uint16_t            historyLookAheadIdx;
     uint16_t            historyLen;
+    uint16_t            historyUnhashedLen; // Number of history bytes not yet in the hash tables
+    uint16_t            hashEpoch;          // Tag of valid hash table entries, changed by lzs_compress_reset()
     uint16_t            offset;
     uint8_t             state;              // LzsCompressState_t
 } LzsCompressParameters_t;
@@ -157,7 +287,7 @@ typedef struct
      */
     uint8_t             historyBuffer[LZS_COMPRESS_HISTORY_SIZE];
     uint8_t             lookAheadLen;
-    uint32_t            bitFieldQueue;      // Code assumes bits will disappear past MS-bit 31 when shifted left
+    uint64_t            bitFieldQueue;      // Code assumes bits will disappear past MS-bit 63 when shifted left
     uint8_t             bitFieldQueueLen;   // Number of bits in the queue
     uint16_t            historyLatestIdx;
     uint16_t            historyLookAheadIdx;
@@ -166,6 +296,74 @@ typedef struct
     uint8_t             state;              // LzsCompressState_t
 } LzsSimpleCompressParameters_t;
 
+typedef struct
+{
+    /*
+     * These parameters should be set (as needed) each time prior to calling compress_incremental().
+     * Then, they are updated appropriately by compress_incremental(), according to
+     * what happens during the compression process.
+     */
+    const uint8_t     * inPtr;              // On entry, points to input data. On exit, points to first unprocessed input data
+    uint8_t           * outPtr;             // On entry, point to output data buffer. On exit, points to one past the last output data byte
+    size_t              inLength;           // On entry, set this to the length of the input data. On exit, it is the length of unprocessed data
+    size_t              outLength;          // On entry, set this to the space in the output buffer. On exit, decremented by the number of output bytes generated
+
+   /*
+    * status is one or more flags of LzsCompressStatus_t.
+    * status is updated appropriately by compress_incremental(), according to
+    * what happens during the compression process.
+    */
+    uint8_t             status;
+
+    /*
+     * These are private members, and should not be changed.
+     */
+    uint8_t             historyBuffer[LZS_COMPRESS_HISTORY_SIZE];
+    uint16_t            hashTable[(1u << LZS_COMPACT_HASH_BITS) * LZS_COMPACT_HASH_WAYS];  // Buckets of history indices, latest first
+    uint8_t             lookAheadLen;
+    uint64_t            bitFieldQueue;      // Code assumes bits will disappear past MS-bit 63 when shifted left
+    uint8_t             bitFieldQueueLen;   // Number of bits in the queue
+    uint16_t            historyLatestIdx;
+    uint16_t            historyLookAheadIdx;
+    uint16_t            historyLen;
+    uint16_t            offset;
+    uint8_t             state;              // LzsCompressState_t
+} LzsCompactCompressParameters_t;
+
+typedef struct
+{
+    /*
+     * These parameters should be set (as needed) each time prior to calling compress_incremental().
+     * Then, they are updated appropriately by compress_incremental(), according to
+     * what happens during the compression process.
+     */
+    const uint8_t     * inPtr;              // On entry, points to input data. On exit, points to first unprocessed input data
+    uint8_t           * outPtr;             // On entry, point to output data buffer. On exit, points to one past the last output data byte
+    size_t              inLength;           // On entry, set this to the length of the input data. On exit, it is the length of unprocessed data
+    size_t              outLength;          // On entry, set this to the space in the output buffer. On exit, decremented by the number of output bytes generated
+
+   /*
+    * status is one or more flags of LzsCompressStatus_t.
+    * status is updated appropriately by compress_incremental(), according to
+    * what happens during the compression process.
+    */
+    uint8_t             status;
+
+    /*
+     * These are private members, and should not be changed.
+     */
+    uint8_t             historyBuffer[LZS_COMPRESS_HISTORY_SIZE];
+    uint16_t            hashTable[1u << LZS_LITE_HASH_BITS];   // Latest history index for each hash
+    uint8_t             lookAheadLen;
+    uint64_t            bitFieldQueue;      // Code assumes bits will disappear past MS-bit 63 when shifted left
+    uint8_t             bitFieldQueueLen;   // Number of bits in the queue
+    uint16_t            historyLatestIdx;
+    uint16_t            historyLookAheadIdx;
+    uint16_t            historyLen;
+    uint16_t            offset;
+    uint8_t             state;              // LzsCompressState_t
+} LzsLiteCompressParameters_t;
+
 
 typedef enum
 {
@@ -200,7 +398,7 @@ typedef struct
      * These are private members, and should not be changed.
      */
     uint8_t             historyBuffer[LZS_DECOMPRESS_HISTORY_SIZE];
-    uint32_t            bitFieldQueue;      // Code assumes bits will disappear past MS-bit 31 when shifted left
+    uint64_t            bitFieldQueue;      // Code assumes bits will disappear past MS-bit 63 when shifted left
     uint8_t             bitFieldQueueLen;   // Number of bits in the queue
     uint16_t            historyReadIdx;
     uint16_t            historyLatestIdx;
@@ -210,26 +408,88 @@ typedef struct
     uint8_t             state;              // LzsDecompressState_t
 } LzsDecompressParameters_t;
 
+// One message of input to lzs_compress_batch() or lzs_decompress_batch()
+typedef struct
+{
+    const uint8_t     * ptr;
+    size_t              len;
+} LzsConstBuffer_t;
+
+// Output buffer for one message of lzs_compress_batch() or lzs_decompress_batch()
+typedef struct
+{
+    uint8_t           * ptr;
+    size_t              len;                // On entry, set this to the size of the buffer. On exit, it is the length of the data written
+} LzsBuffer_t;
+
+typedef enum
+{
+    LZS_MATCH_KERNEL_AUTO,              // Best kernel supported by the CPU
+    LZS_MATCH_KERNEL_BYTE,              // Portable, one byte at a time
+    LZS_MATCH_KERNEL_WORD64,            // 64-bit XOR and count of zero bits
+    LZS_MATCH_KERNEL_SSE2,              // x86 SSE2, 16 bytes at a time
+    LZS_MATCH_KERNEL_AVX2,              // x86 AVX2, 32 bytes at a time
+
+    NUM_LZS_MATCH_KERNELS
+} LzsMatchKernel_t;
+
 
 /*****************************************************************************
  * Function prototypes
  ****************************************************************************/
 
 size_t lzs_compress(uint8_t * a_pOutData, size_t a_outBufferSize, const uint8_t * a_pInData, size_t a_inLen);
+size_t lzs_compress_level(uint8_t * a_pOutData, size_t a_outBufferSize, const uint8_t * a_pInData, size_t a_inLen, unsigned int level);
+size_t lzs_compress_ws(uint8_t * a_pOutData, size_t a_outBufferSize, const uint8_t * a_pInData, size_t a_inLen, void * pWorkspace);
+size_t lzs_workspace_size(void);
+// lzs_compress(), lzs_compress_level() and lzs_compress_config() put hash tables of
+// LZS_WORKSPACE_SIZE(INPUT_HASH_BITS) bytes (about 14 KB) on the stack. They use
+// hash chains even if pConfig->matchFinder is LZS_MATCH_FINDER_BINARY_TREE, since
+// the trees need LZS_TREE_WORKSPACE_SIZE() bytes, and lazy matching even if
+// pConfig->optimal is set, since optimal parsing needs LZS_OPTIMAL_WORKSPACE_SIZE()
+// bytes; lzs_compress_config_ws() uses them.
+size_t lzs_compress_config(uint8_t * a_pOutData, size_t a_outBufferSize, const uint8_t * a_pInData, size_t a_inLen,
+                           const LzsCompressConfig_t * pConfig);
+size_t lzs_compress_config_ws(uint8_t * a_pOutData, size_t a_outBufferSize, const uint8_t * a_pInData, size_t a_inLen,
+                              const LzsCompressConfig_t * pConfig, void * pWorkspace);
+size_t lzs_compress_workspace_size(const LzsCompressConfig_t * pConfig);
+size_t lzs_compress_batch(LzsBuffer_t * pOut, const LzsConstBuffer_t * pIn, size_t count,
+                          const LzsCompressConfig_t * pConfig, void * pWorkspace);
+void lzs_compress_level_config(LzsCompressConfig_t * pConfig, unsigned int level);
 
 void lzs_compress_init_quick(LzsCompressParameters_t * pParams);
 void lzs_compress_init_full(LzsCompressParameters_t * pParams);
+void lzs_compress_init_level(LzsCompressParameters_t * pParams, unsigned int level);
+void lzs_compress_init_config(LzsCompressParameters_t * pParams, const LzsCompressConfig_t * pConfig);
+void lzs_compress_reset(LzsCompressParameters_t * pParams);
 size_t lzs_compress_incremental(LzsCompressParameters_t * pParams, bool add_end_marker);
+size_t lzs_compress_flush(LzsCompressParameters_t * pParams, unsigned int flush);
+void lzs_compress_set_dictionary(LzsCompressParameters_t * pParams, const uint8_t * pDictionary, size_t dictionaryLen);
+void lzs_dictionary_init(LzsDictionary_t * pDictionary, const uint8_t * pData, size_t dataLen, const LzsCompressConfig_t * pConfig);
+void lzs_compress_attach_dictionary(LzsCompressParameters_t * pParams, const LzsDictionary_t * pDictionary);
 
 size_t lzs_simple_compress(uint8_t * a_pOutData, size_t a_outBufferSize, const uint8_t * a_pInData, size_t a_inLen);
 
 void lzs_simple_compress_init(LzsSimpleCompressParameters_t * pParams);
 size_t lzs_simple_compress_incremental(LzsSimpleCompressParameters_t * pParams, bool add_end_marker);
 
+void lzs_compact_compress_init(LzsCompactCompressParameters_t * pParams);
+size_t lzs_compact_compress_incremental(LzsCompactCompressParameters_t * pParams, bool add_end_marker);
+
+size_t lzs_lite_compress(uint8_t * a_pOutData, size_t a_outBufferSize, const uint8_t * a_pInData, size_t a_inLen);
+
+void lzs_lite_compress_init(LzsLiteCompressParameters_t * pParams);
+size_t lzs_lite_compress_incremental(LzsLiteCompressParameters_t * pParams, bool add_end_marker);
+
 size_t lzs_decompress(uint8_t * a_pOutData, size_t a_outBufferSize, const uint8_t * a_pInData, size_t a_inLen);
+size_t lzs_decompress_batch(LzsBuffer_t * pOut, const LzsConstBuffer_t * pIn, size_t count);
 
 void lzs_decompress_init(LzsDecompressParameters_t * pParams);
 size_t lzs_decompress_incremental(LzsDecompressParameters_t * pParams);
+void lzs_decompress_set_dictionary(LzsDecompressParameters_t * pParams, const uint8_t * pDictionary, size_t dictionaryLen);
+
+bool lzs_match_kernel_select(LzsMatchKernel_t kernel);
+LzsMatchKernel_t lzs_match_kernel_get(void);
 
 
 /*****************************************************************************
@@ -25,6 +25,8 @@
 #define OUT_BUFFER_EXTRA_LEN    520u
 #define IN_BUFFER_BOUNDED_LEN   10u
 #define OUT_BUFFER_BOUNDED_LEN  10u
+#define MATCH_TEST_MAX_LEN      100u
+#define MATCH_TEST_BUFFER_LEN   200u
 
 
 /*****************************************************************************
@@ -96,6 +98,61 @@ static const uint8_t decompressed_data_1[] =
     "for its instances by defining a __repr__() method.";
 
 
+/*****************************************************************************
+ * Functions
+ ****************************************************************************/
+
+/*
+ * Append bits to a compressed data buffer, most significant bit first.
+ */
+static void put_bits(uint8_t * p_buffer, size_t * p_bit_len, uint32_t value, unsigned int width)
+{
+    while (width)
+    {
+        width--;
+        if (value & (1u << width))
+        {
+            p_buffer[*p_bit_len / 8u] |= 0x80u >> (*p_bit_len % 8u);
+        }
+        (*p_bit_len)++;
+    }
+}
+
+/*
+ * Append an offset/length token to a compressed data buffer.
+ * An offset of 0 is written as a long offset, since a short one is an end marker.
+ */
+static void put_match(uint8_t * p_buffer, size_t * p_bit_len, size_t offset, size_t length)
+{
+    if (offset != 0 && offset < 128u)
+    {
+        put_bits(p_buffer, p_bit_len, 0x3u, 2u);
+        put_bits(p_buffer, p_bit_len, offset, 7u);
+    }
+    else
+    {
+        put_bits(p_buffer, p_bit_len, 0x2u, 2u);
+        put_bits(p_buffer, p_bit_len, offset, 11u);
+    }
+    if (length < 5u)
+    {
+        put_bits(p_buffer, p_bit_len, length - 2u, 2u);
+        return;
+    }
+    if (length < 8u)
+    {
+        put_bits(p_buffer, p_bit_len, 0xCu + length - 5u, 4u);
+        return;
+    }
+    put_bits(p_buffer, p_bit_len, 0xFu, 4u);
+    for (length -= 8u; length >= 15u; length -= 15u)
+    {
+        put_bits(p_buffer, p_bit_len, 0xFu, 4u);
+    }
+    put_bits(p_buffer, p_bit_len, length, 4u);
+}
+
+
 /*****************************************************************************
  * Test functions
  ****************************************************************************/
@@ -289,6 +346,86 @@ static void test_lzs_decompress_incremental_output_bounded(const void * p_compre
     free(p_out_buffer);
 }
 
+/**
+ * \brief Test for lzs_decompress(), with the input truncated at every byte.
+ *
+ * The output must be the start of the complete decompressed data.
+ */
+static void test_lzs_decompress_truncated(const void * p_compressed_data, size_t compressed_len, const void * p_decompressed_data, size_t decompressed_len)
+{
+    uint8_t * p_out_buffer;
+    size_t  out_buffer_len;
+    size_t  out_length;
+    size_t  in_length;
+
+
+    out_buffer_len = decompressed_len + OUT_BUFFER_EXTRA_LEN;
+    p_out_buffer = malloc(out_buffer_len);
+    TEST_ASSERT_NOT_NULL(p_out_buffer);
+
+    for (in_length = 0; in_length <= compressed_len; in_length++)
+    {
+        memset(p_out_buffer, 'A', out_buffer_len);
+
+        out_length = lzs_decompress(p_out_buffer, out_buffer_len, p_compressed_data, in_length);
+
+        TEST_ASSERT_LESS_OR_EQUAL_size_t(decompressed_len, out_length);
+        if (out_length != 0)
+        {
+            TEST_ASSERT_EQUAL_UINT8_ARRAY(p_decompressed_data, p_out_buffer, out_length);
+        }
+    }
+    TEST_ASSERT_EQUAL_size_t(decompressed_len, out_length);
+
+    free(p_out_buffer);
+}
+
+/**
+ * \brief Test for lzs_decompress_incremental(), with the input split in two at every byte.
+ */
+static void test_lzs_decompress_incremental_split(const void * p_compressed_data, size_t compressed_len, const void * p_decompressed_data, size_t decompressed_len)
+{
+    uint8_t * p_out_buffer;
+    size_t  out_buffer_len;
+    LzsDecompressParameters_t   decompress_params;
+    size_t  total_out_length;
+    size_t  split;
+    size_t  part;
+
+
+    out_buffer_len = decompressed_len + OUT_BUFFER_EXTRA_LEN;
+    p_out_buffer = malloc(out_buffer_len);
+    TEST_ASSERT_NOT_NULL(p_out_buffer);
+
+    for (split = 0; split <= compressed_len; split++)
+    {
+        memset(p_out_buffer, 'A', out_buffer_len);
+        total_out_length = 0u;
+
+        lzs_decompress_init(&decompress_params);
+
+        decompress_params.inPtr = p_compressed_data;
+        decompress_params.outPtr = p_out_buffer;
+        // out buffer length is '-1' to allow for string zero termination
+        decompress_params.outLength = out_buffer_len - 1;
+        for (part = 0; part < 2u; part++)
+        {
+            decompress_params.inLength = part ? (compressed_len - split) : split;
+            do
+            {
+                total_out_length += lzs_decompress_incremental(&decompress_params);
+            } while (
+                        (decompress_params.inLength != 0) ||
+                        ((decompress_params.status & LZS_D_STATUS_INPUT_STARVED) == 0)
+                    );
+        }
+        TEST_ASSERT_EQUAL_size_t(decompressed_len, total_out_length);
+        TEST_ASSERT_EQUAL_UINT8_ARRAY(p_decompressed_data, p_out_buffer, total_out_length);
+    }
+
+    free(p_out_buffer);
+}
+
 /**
  * \brief Test decompression functions, using data set of compressed_data_1[].
  */
@@ -308,6 +445,124 @@ void test_compressed_data_1(void)
     test_lzs_decompress_incremental_all(p_compressed_data, compressed_len, p_decompressed_data, decompressed_len);
     test_lzs_decompress_incremental_input_bounded(p_compressed_data, compressed_len, p_decompressed_data, decompressed_len);
     test_lzs_decompress_incremental_output_bounded(p_compressed_data, compressed_len, p_decompressed_data, decompressed_len);
+    test_lzs_decompress_truncated(p_compressed_data, compressed_len, p_decompressed_data, decompressed_len);
+    test_lzs_decompress_incremental_split(p_compressed_data, compressed_len, p_decompressed_data, decompressed_len);
+}
+
+/**
+ * \brief Test match copies, for short offsets, and offsets before the start of the output
+ *
+ * Each case is some literals, then a match, then a literal and an end marker.
+ * Bytes of the match from before the start of the output are zeros, and so
+ * are all bytes of a match with the invalid offset 0.
+ */
+void test_match_copy(void)
+{
+    uint8_t     compressed[MATCH_TEST_BUFFER_LEN];
+    uint8_t     expected[MATCH_TEST_BUFFER_LEN];
+    uint8_t     out_buffer[MATCH_TEST_BUFFER_LEN];
+    LzsDecompressParameters_t   decompress_params;
+    char        msg[100];
+    size_t      bit_len;
+    size_t      expected_len;
+    size_t      out_length;
+    size_t      offset;
+    size_t      length;
+    size_t      literals;
+    size_t      i;
+
+    for (offset = 0; offset <= 20u; offset++)
+    {
+        for (literals = 0; literals <= offset + 1u; literals++)
+        {
+            for (length = 2u; length <= MATCH_TEST_MAX_LEN; length += (length < 40u) ? 1u : 13u)
+            {
+                snprintf(msg, sizeof(msg), "offset %zu, literals %zu, length %zu", offset, literals, length);
+
+                memset(compressed, 0, sizeof(compressed));
+                bit_len = 0;
+                expected_len = 0;
+                for (i = 0; i < literals; i++)
+                {
+                    expected[expected_len++] = (uint8_t)('a' + i);
+                    put_bits(compressed, &bit_len, 'a' + i, 9u);
+                }
+                for (i = 0; i < length; i++, expected_len++)
+                {
+                    expected[expected_len] = (offset != 0 && expected_len >= offset) ? expected[expected_len - offset] : 0;
+                }
+                put_match(compressed, &bit_len, offset, length);
+                expected[expected_len++] = 'Z';
+                put_bits(compressed, &bit_len, 'Z', 9u);
+                put_bits(compressed, &bit_len, 0x180u, 9u);
+
+                // Enough output buffer space for wild copies
+                memset(out_buffer, 'A', sizeof(out_buffer));
+                out_length = lzs_decompress(out_buffer, sizeof(out_buffer), compressed, (bit_len + 7u) / 8u);
+                TEST_ASSERT_EQUAL_size_t_MESSAGE(expected_len, out_length, msg);
+                TEST_ASSERT_EQUAL_UINT8_ARRAY_MESSAGE(expected, out_buffer, expected_len, msg);
+
+                // Output buffer that ends within the match
+                memset(out_buffer, 'A', sizeof(out_buffer));
+                out_length = lzs_decompress(out_buffer, expected_len - 2u, compressed, (bit_len + 7u) / 8u);
+                TEST_ASSERT_EQUAL_size_t_MESSAGE(expected_len - 2u, out_length, msg);
+                TEST_ASSERT_EQUAL_UINT8_ARRAY_MESSAGE(expected, out_buffer, expected_len - 2u, msg);
+                TEST_ASSERT_EQUAL_UINT8_MESSAGE('A', out_buffer[expected_len - 2u], msg);
+
+                // Incremental, a few bytes of output at a time
+                memset(out_buffer, 'A', sizeof(out_buffer));
+                lzs_decompress_init(&decompress_params);
+                decompress_params.inPtr = compressed;
+                decompress_params.inLength = (bit_len + 7u) / 8u;
+                decompress_params.outPtr = out_buffer;
+                out_length = 0;
+                do
+                {
+                    decompress_params.outLength = 7u;
+                    out_length += lzs_decompress_incremental(&decompress_params);
+                } while ((decompress_params.status & LZS_D_STATUS_END_MARKER) == 0);
+                TEST_ASSERT_EQUAL_size_t_MESSAGE(expected_len, out_length, msg);
+                TEST_ASSERT_EQUAL_UINT8_ARRAY_MESSAGE(expected, out_buffer, expected_len, msg);
+            }
+        }
+    }
+}
+
+/**
+ * \brief Test a long offset of 0, followed by truncated input
+ *
+ * Both decompressors must stop at the end of the input, with the match written as zeros.
+ */
+void test_offset_zero(void)
+{
+    // Literal 'A', long offset 0 with length 2, literal 0, then 7 bits of an incomplete token
+    static const uint8_t compressed[] = { 0x20, 0xC0, 0x00, 0x00, 0x00 };
+    static const uint8_t expected[] = { 'A', 0, 0, 0 };
+    uint8_t     out_buffer[MATCH_TEST_BUFFER_LEN];
+    LzsDecompressParameters_t   decompress_params;
+    size_t      out_length;
+    unsigned int calls;
+
+    memset(out_buffer, 'X', sizeof(out_buffer));
+    out_length = lzs_decompress(out_buffer, sizeof(out_buffer), compressed, sizeof(compressed));
+    TEST_ASSERT_EQUAL_size_t(sizeof(expected), out_length);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, out_buffer, out_length);
+
+    memset(out_buffer, 'X', sizeof(out_buffer));
+    lzs_decompress_init(&decompress_params);
+    decompress_params.inPtr = compressed;
+    decompress_params.inLength = sizeof(compressed);
+    decompress_params.outPtr = out_buffer;
+    decompress_params.outLength = sizeof(out_buffer);
+    out_length = lzs_decompress_incremental(&decompress_params);
+    for (calls = 1u; calls < 10u && (decompress_params.status & LZS_D_STATUS_INPUT_STARVED) == 0; calls++)
+    {
+        out_length += lzs_decompress_incremental(&decompress_params);
+    }
+    TEST_ASSERT_EQUAL_UINT8(LZS_D_STATUS_INPUT_STARVED, decompress_params.status);
+    TEST_ASSERT_EQUAL_size_t(0, decompress_params.inLength);
+    TEST_ASSERT_EQUAL_size_t(sizeof(expected), out_length);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, out_buffer, out_length);
 }
 
 void setUp(void)
@@ -326,6 +581,8 @@ int main(int argc, char **argv)
     UNITY_BEGIN();
 
     RUN_TEST(test_compressed_data_1);
+    RUN_TEST(test_match_copy);
+    RUN_TEST(test_offset_zero);
 
     return UNITY_END();
 }
@@ -31,6 +31,16 @@
 #define OFFSET_LONG_BITS        11u
 #define END_MARKER_BITS         9u
 
+#define NUM_COMPRESSORS         7
+
+#define NUM_FLUSH_MODES         2
+
+#define NUM_BATCH_MESSAGES      20u
+
+#define STREAM_DATA_SIZE        5000u
+
+#define LZSMIN_TEST(X,Y)        (((X) < (Y)) ? (X) : (Y))
+
 
 /*****************************************************************************
  * Tables
@@ -86,6 +96,208 @@ static size_t length_bits(size_t repeated_chars)
     }
 }
 
+/*
+ * Fill a buffer with pseudo-random slices of uncompressible_sequence[], so
+ * there are matches of many lengths and offsets.
+ */
+static void make_test_data(uint8_t * p_buffer, size_t len)
+{
+    uint32_t    lcg = 12345u;
+    size_t      pos = 0;
+    size_t      start;
+    size_t      slice;
+
+    while (pos < len)
+    {
+        lcg = lcg * 1103515245u + 12345u;
+        start = (lcg >> 8u) % (sizeof(uncompressible_sequence) - 1u);
+        lcg = lcg * 1103515245u + 12345u;
+        slice = 1u + (lcg >> 8u) % 40u;
+        while (slice-- && pos < len && uncompressible_sequence[start])
+        {
+            p_buffer[pos++] = uncompressible_sequence[start++];
+        }
+    }
+}
+
+/*
+ * Compress with each compressor, giving the input in chunks to the incremental ones.
+ */
+static size_t compress_with(int compressor, uint8_t * p_out, size_t out_size, const uint8_t * p_in, size_t in_len)
+{
+    static LzsCompressParameters_t          compress_params;
+    static LzsSimpleCompressParameters_t    simple_compress_params;
+    static LzsCompactCompressParameters_t   compact_compress_params;
+    static LzsLiteCompressParameters_t      lite_compress_params;
+    size_t  out_length = 0;
+
+    switch (compressor)
+    {
+        case 0:
+            return lzs_compress(p_out, out_size, p_in, in_len);
+        case 1:
+            return lzs_simple_compress(p_out, out_size, p_in, in_len);
+        case 2:
+            lzs_compress_init(&compress_params);
+            compress_params.inPtr = p_in;
+            compress_params.outPtr = p_out;
+            compress_params.outLength = out_size;
+            do
+            {
+                compress_params.inLength = LZSMIN_TEST(in_len - (compress_params.inPtr - p_in), IN_BUFFER_BOUNDED_LEN);
+                out_length += lzs_compress_incremental(&compress_params,
+                                                       compress_params.inPtr + compress_params.inLength == p_in + in_len);
+            } while ((compress_params.status & LZS_C_STATUS_END_MARKER) == 0);
+            return out_length;
+        case 3:
+            lzs_simple_compress_init(&simple_compress_params);
+            simple_compress_params.inPtr = p_in;
+            simple_compress_params.outPtr = p_out;
+            simple_compress_params.outLength = out_size;
+            do
+            {
+                simple_compress_params.inLength = LZSMIN_TEST(in_len - (simple_compress_params.inPtr - p_in), IN_BUFFER_BOUNDED_LEN);
+                out_length += lzs_simple_compress_incremental(&simple_compress_params,
+                                                              simple_compress_params.inPtr + simple_compress_params.inLength == p_in + in_len);
+            } while ((simple_compress_params.status & LZS_C_STATUS_END_MARKER) == 0);
+            return out_length;
+        case 5:
+            return lzs_lite_compress(p_out, out_size, p_in, in_len);
+        case 6:
+            lzs_lite_compress_init(&lite_compress_params);
+            lite_compress_params.inPtr = p_in;
+            lite_compress_params.outPtr = p_out;
+            lite_compress_params.outLength = out_size;
+            do
+            {
+                lite_compress_params.inLength = LZSMIN_TEST(in_len - (lite_compress_params.inPtr - p_in), IN_BUFFER_BOUNDED_LEN);
+                out_length += lzs_lite_compress_incremental(&lite_compress_params,
+                                                            lite_compress_params.inPtr + lite_compress_params.inLength == p_in + in_len);
+            } while ((lite_compress_params.status & LZS_C_STATUS_END_MARKER) == 0);
+            return out_length;
+        case 4:
+            lzs_compact_compress_init(&compact_compress_params);
+            compact_compress_params.inPtr = p_in;
+            compact_compress_params.outPtr = p_out;
+            compact_compress_params.outLength = out_size;
+            do
+            {
+                compact_compress_params.inLength = LZSMIN_TEST(in_len - (compact_compress_params.inPtr - p_in), IN_BUFFER_BOUNDED_LEN);
+                out_length += lzs_compact_compress_incremental(&compact_compress_params,
+                                                               compact_compress_params.inPtr + compact_compress_params.inLength == p_in + in_len);
+            } while ((compact_compress_params.status & LZS_C_STATUS_END_MARKER) == 0);
+            return out_length;
+        default:
+            TEST_FAIL_MESSAGE("Unknown compressor");
+            return 0;
+    }
+}
+
+/*
+ * Compress with the incremental compact (4) or lite (6) compressor of compress_with(),
+ * giving it input and output space in chunks of pseudo-random sizes.
+ */
+static size_t compress_chunked(int compressor, uint8_t * p_out, size_t out_size, const uint8_t * p_in, size_t in_len)
+{
+    static LzsCompactCompressParameters_t   compact_compress_params;
+    static LzsLiteCompressParameters_t      lite_compress_params;
+    const uint8_t * p_in_pos = p_in;
+    uint32_t    lcg = 97531u;
+    size_t      out_length = 0;
+    size_t      in_chunk;
+    size_t      out_chunk;
+    bool        add_end_marker;
+    uint8_t     status;
+
+    if (compressor == 4)
+    {
+        lzs_compact_compress_init(&compact_compress_params);
+    }
+    else
+    {
+        lzs_lite_compress_init(&lite_compress_params);
+    }
+    do
+    {
+        lcg = lcg * 1103515245u + 12345u;
+        in_chunk = LZSMIN_TEST(in_len - (p_in_pos - p_in), (lcg >> 8u) % 300u);
+        out_chunk = LZSMIN_TEST(out_size - out_length, (lcg >> 20u) % 100u);
+        add_end_marker = (p_in_pos + in_chunk == p_in + in_len);
+        if (compressor == 4)
+        {
+            compact_compress_params.inPtr = p_in_pos;
+            compact_compress_params.inLength = in_chunk;
+            compact_compress_params.outPtr = p_out + out_length;
+            compact_compress_params.outLength = out_chunk;
+            out_length += lzs_compact_compress_incremental(&compact_compress_params, add_end_marker);
+            p_in_pos = compact_compress_params.inPtr;
+            status = compact_compress_params.status;
+        }
+        else
+        {
+            lite_compress_params.inPtr = p_in_pos;
+            lite_compress_params.inLength = in_chunk;
+            lite_compress_params.outPtr = p_out + out_length;
+            lite_compress_params.outLength = out_chunk;
+            out_length += lzs_lite_compress_incremental(&lite_compress_params, add_end_marker);
+            p_in_pos = lite_compress_params.inPtr;
+            status = lite_compress_params.status;
+        }
+    } while ((status & LZS_C_STATUS_END_MARKER) == 0);
+    return out_length;
+}
+
+/*
+ * Make the data for the i'th of a series of independent streams, in a buffer of
+ * STREAM_DATA_SIZE bytes. The first two streams are made so that a stale "ABCD"
+ * hash table entry from the first would give a 2-byte match at a different
+ * offset in the second. Later streams are different parts of make_test_data().
+ */
+static const uint8_t * make_stream_data(int i, uint8_t * p_buffer, size_t * p_len)
+{
+    size_t  len = 0;
+
+    if (i >= 2)
+    {
+        if (i == 2)
+        {
+            make_test_data(p_buffer, STREAM_DATA_SIZE);
+        }
+        *p_len = STREAM_DATA_SIZE / 2u - (i * 41) % 1000u;
+        return p_buffer + (i * 337) % (STREAM_DATA_SIZE / 2u);
+    }
+    memcpy(p_buffer, i ? "ABXY" : "ABCD", 4u);
+    memcpy(p_buffer + 4u, uncompressible_sequence + 100u, 30u);
+    len = 34u;
+    if (i)
+    {
+        memcpy(p_buffer + len, "ABPQ", 4u);
+        memcpy(p_buffer + len + 4u, uncompressible_sequence + 200u, 30u);
+        memcpy(p_buffer + len + 34u, "ABCD", 4u);
+        len += 38u;
+    }
+    *p_len = len;
+    return p_buffer;
+}
+
+/*
+ * Compress a whole stream with a context that has been initialised or reset.
+ */
+static size_t compress_stream(LzsCompressParameters_t * p_params, uint8_t * p_out, size_t out_size, const uint8_t * p_in, size_t in_len)
+{
+    size_t  out_length = 0;
+
+    p_params->inPtr = p_in;
+    p_params->inLength = in_len;
+    p_params->outPtr = p_out;
+    p_params->outLength = out_size;
+    do
+    {
+        out_length += lzs_compress_incremental(p_params, true);
+    } while ((p_params->status & LZS_C_STATUS_END_MARKER) == 0);
+    return out_length;
+}
+
 /*****************************************************************************
  * Test functions
  ****************************************************************************/
@@ -166,6 +378,1006 @@ static void test_repeated_byte(void)
     }
 }
 
+static void test_match_kernels(void)
+{
+    char    msg[100];
+    uint8_t data_buffer[3000];
+    uint8_t reference_buffer[LZS_COMPRESSED_MAX(3000)];
+    uint8_t compress_buffer[LZS_COMPRESSED_MAX(3000)];
+    uint8_t decompress_buffer[3000];
+    size_t  reference_len;
+    size_t  compress_len;
+    size_t  decompress_len;
+    int     compressor;
+    int     kernel;
+
+    make_test_data(data_buffer, sizeof(data_buffer));
+
+    for (compressor = 0; compressor < NUM_COMPRESSORS; compressor++)
+    {
+        TEST_ASSERT_TRUE(lzs_match_kernel_select(LZS_MATCH_KERNEL_BYTE));
+        reference_len = compress_with(compressor, reference_buffer, sizeof(reference_buffer), data_buffer, sizeof(data_buffer));
+
+        for (kernel = LZS_MATCH_KERNEL_AUTO; kernel < NUM_LZS_MATCH_KERNELS; kernel++)
+        {
+            if (!lzs_match_kernel_select((LzsMatchKernel_t)kernel))
+            {
+                continue;
+            }
+            snprintf(msg, sizeof(msg), "compressor %d, kernel %d", compressor, kernel);
+            memset(compress_buffer, 'C', sizeof(compress_buffer));
+            memset(decompress_buffer, 'D', sizeof(decompress_buffer));
+
+            // All kernels must give identical compressed output
+            compress_len = compress_with(compressor, compress_buffer, sizeof(compress_buffer), data_buffer, sizeof(data_buffer));
+            TEST_ASSERT_EQUAL_size_t_MESSAGE(reference_len, compress_len, msg);
+            TEST_ASSERT_EQUAL_UINT8_ARRAY_MESSAGE(reference_buffer, compress_buffer, compress_len, msg);
+
+            decompress_len = lzs_decompress(decompress_buffer, sizeof(decompress_buffer), compress_buffer, compress_len);
+            TEST_ASSERT_EQUAL_size_t_MESSAGE(sizeof(data_buffer), decompress_len, msg);
+            TEST_ASSERT_EQUAL_UINT8_ARRAY_MESSAGE(data_buffer, decompress_buffer, decompress_len, msg);
+        }
+    }
+    TEST_ASSERT_TRUE(lzs_match_kernel_select(LZS_MATCH_KERNEL_AUTO));
+    TEST_ASSERT_NOT_EQUAL(LZS_MATCH_KERNEL_AUTO, lzs_match_kernel_get());
+}
+
+static void test_levels(void)
+{
+    static LzsCompressParameters_t  compress_params;
+    char    msg[100];
+    uint8_t data_buffer[5000];
+    uint8_t reference_buffer[LZS_COMPRESSED_MAX(5000)];
+    uint8_t compress_buffer[LZS_COMPRESSED_MAX(5000)];
+    uint8_t decompress_buffer[5000];
+    size_t  reference_len;
+    size_t  compress_len;
+    size_t  decompress_len;
+    size_t  fastest_len = 0;
+    size_t  best_len = 0;
+    unsigned int level;
+
+    make_test_data(data_buffer, sizeof(data_buffer));
+
+    // The default level gives the same output as lzs_compress()
+    reference_len = lzs_compress(reference_buffer, sizeof(reference_buffer), data_buffer, sizeof(data_buffer));
+    compress_len = lzs_compress_level(compress_buffer, sizeof(compress_buffer), data_buffer, sizeof(data_buffer), LZS_COMPRESS_LEVEL_DEFAULT);
+    TEST_ASSERT_EQUAL_size_t(reference_len, compress_len);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(reference_buffer, compress_buffer, compress_len);
+
+    for (level = 0; level <= LZS_COMPRESS_LEVEL_MAX + 1u; level++)
+    {
+        snprintf(msg, sizeof(msg), "level %u", level);
+        memset(compress_buffer, 'C', sizeof(compress_buffer));
+        memset(decompress_buffer, 'D', sizeof(decompress_buffer));
+
+        reference_len = lzs_compress_level(reference_buffer, sizeof(reference_buffer), data_buffer, sizeof(data_buffer), level);
+        decompress_len = lzs_decompress(decompress_buffer, sizeof(decompress_buffer), reference_buffer, reference_len);
+        TEST_ASSERT_EQUAL_size_t_MESSAGE(sizeof(data_buffer), decompress_len, msg);
+        TEST_ASSERT_EQUAL_UINT8_ARRAY_MESSAGE(data_buffer, decompress_buffer, decompress_len, msg);
+        if (level == LZS_COMPRESS_LEVEL_FASTEST)
+        {
+            fastest_len = reference_len;
+        }
+
+        if (level > LZS_COMPRESS_LEVEL_BEST)
+        {
+            // Without a workspace, optimal parsing isn't used, so it's the same as the best level
+            TEST_ASSERT_EQUAL_size_t_MESSAGE(best_len, reference_len, msg);
+            continue;
+        }
+        best_len = reference_len;
+
+        // Incremental compression at the same level gives the same output
+        lzs_compress_init_level(&compress_params, level);
+        compress_params.inPtr = data_buffer;
+        compress_params.outPtr = compress_buffer;
+        compress_params.outLength = sizeof(compress_buffer);
+        compress_len = 0;
+        do
+        {
+            compress_params.inLength = LZSMIN_TEST(sizeof(data_buffer) - (compress_params.inPtr - data_buffer), IN_BUFFER_BOUNDED_LEN);
+            compress_len += lzs_compress_incremental(&compress_params,
+                                                     compress_params.inPtr + compress_params.inLength == data_buffer + sizeof(data_buffer));
+        } while ((compress_params.status & LZS_C_STATUS_END_MARKER) == 0);
+        TEST_ASSERT_EQUAL_size_t_MESSAGE(reference_len, compress_len, msg);
+        TEST_ASSERT_EQUAL_UINT8_ARRAY_MESSAGE(reference_buffer, compress_buffer, compress_len, msg);
+    }
+    // Best level does at least as well as the fastest
+    TEST_ASSERT_TRUE(best_len <= fastest_len);
+}
+
+static void test_optimal(void)
+{
+    static const size_t data_lens[] = { 0, 1, 2, 3, 100, 1023, 1024, 1025, 3000, 5000 };
+    static uint32_t workspace[LZS_OPTIMAL_WORKSPACE_SIZE(LZS_TREE_WORKSPACE_SIZE(INPUT_HASH_BITS)) / sizeof(uint32_t)];
+    char    msg[100];
+    uint8_t data_buffer[5000];
+    uint8_t reference_buffer[LZS_COMPRESSED_MAX(5000)];
+    uint8_t compress_buffer[LZS_COMPRESSED_MAX(5000)];
+    uint8_t decompress_buffer[5000];
+    size_t  reference_len;
+    size_t  compress_len;
+    size_t  decompress_len;
+    size_t  data_len;
+    size_t  i;
+    LzsCompressConfig_t config;
+    int     data_type;
+
+    lzs_compress_level_config(&config, LZS_COMPRESS_LEVEL_MAX);
+    TEST_ASSERT_EQUAL_size_t(sizeof(workspace), lzs_compress_workspace_size(&config));
+
+    for (data_type = 0; data_type < 3; data_type++)
+    {
+        switch (data_type)
+        {
+            case 0:
+                memset(data_buffer, 'X', sizeof(data_buffer));
+                break;
+            case 1:
+                make_test_data(data_buffer, sizeof(data_buffer));
+                break;
+            default:
+                for (i = 0; i < sizeof(data_buffer); i++)
+                {
+                    data_buffer[i] = uncompressible_sequence[i % (sizeof(uncompressible_sequence) - 1u)];
+                }
+                break;
+        }
+        for (i = 0; i < sizeof(data_lens) / sizeof(data_lens[0]); i++)
+        {
+            data_len = data_lens[i];
+            snprintf(msg, sizeof(msg), "data type %d, data_len = %zu", data_type, data_len);
+            memset(compress_buffer, 'C', sizeof(compress_buffer));
+            memset(decompress_buffer, 'D', sizeof(decompress_buffer));
+
+            reference_len = lzs_compress_level(reference_buffer, sizeof(reference_buffer), data_buffer, data_len, LZS_COMPRESS_LEVEL_BEST);
+            compress_len = lzs_compress_config_ws(compress_buffer, sizeof(compress_buffer), data_buffer, data_len, &config, workspace);
+            TEST_ASSERT_TRUE_MESSAGE(compress_len <= reference_len, msg);
+
+            decompress_len = lzs_decompress(decompress_buffer, sizeof(decompress_buffer), compress_buffer, compress_len);
+            TEST_ASSERT_EQUAL_size_t_MESSAGE(data_len, decompress_len, msg);
+            if (data_len)
+                TEST_ASSERT_EQUAL_UINT8_ARRAY_MESSAGE(data_buffer, decompress_buffer, data_len, msg);
+        }
+    }
+}
+
+static void test_hash_types(void)
+{
+    static const size_t data_lens[] = { 0, 1, 2, 3, 4, 5, 100, 1025, 5000 };
+    static const uint8_t hash_bits[] = { LZS_HASH_BITS_MIN, INPUT_HASH_BITS, LZS_HASH_BITS_MAX };
+    static LzsCompressParameters_t  compress_params;
+    static uint32_t workspace[LZS_OPTIMAL_WORKSPACE_SIZE(LZS_WORKSPACE_SIZE(LZS_HASH_BITS_MAX)) / sizeof(uint32_t)];
+    char    msg[100];
+    uint8_t data_buffer[5000];
+    uint8_t reference_buffer[LZS_COMPRESSED_MAX(5000)];
+    uint8_t compress_buffer[LZS_COMPRESSED_MAX(5000)];
+    uint8_t decompress_buffer[5000];
+    size_t  reference_len;
+    size_t  compress_len;
+    size_t  decompress_len;
+    size_t  data_len;
+    size_t  i;
+    size_t  b;
+    LzsCompressConfig_t config;
+    int     hash_type;
+    int     optimal;
+
+    make_test_data(data_buffer, sizeof(data_buffer));
+
+    for (hash_type = 0; hash_type < NUM_LZS_HASH_TYPES; hash_type++)
+    {
+        for (b = 0; b < sizeof(hash_bits); b++)
+        {
+            for (optimal = 0; optimal < 2; optimal++)
+            {
+                lzs_compress_level_config(&config, LZS_COMPRESS_LEVEL_FASTEST + 2u * optimal);
+                config.hashType = hash_type;
+                config.hashBits = hash_bits[b];
+                config.optimal = optimal;
+                TEST_ASSERT_TRUE(lzs_compress_workspace_size(&config) <= sizeof(workspace));
+
+                for (i = 0; i < sizeof(data_lens) / sizeof(data_lens[0]); i++)
+                {
+                    data_len = data_lens[i];
+                    snprintf(msg, sizeof(msg), "hash type %d, bits %u, optimal %d, data_len = %zu", hash_type, hash_bits[b], optimal, data_len);
+                    memset(compress_buffer, 'C', sizeof(compress_buffer));
+                    memset(decompress_buffer, 'D', sizeof(decompress_buffer));
+
+                    reference_len = lzs_compress_config_ws(reference_buffer, sizeof(reference_buffer), data_buffer, data_len,
+                                                           &config, workspace);
+                    decompress_len = lzs_decompress(decompress_buffer, sizeof(decompress_buffer), reference_buffer, reference_len);
+                    TEST_ASSERT_EQUAL_size_t_MESSAGE(data_len, decompress_len, msg);
+                    if (data_len)
+                        TEST_ASSERT_EQUAL_UINT8_ARRAY_MESSAGE(data_buffer, decompress_buffer, data_len, msg);
+                    if (hash_bits[b] > INPUT_HASH_BITS || optimal)
+                    {
+                        continue;
+                    }
+
+                    // Hash table sizes that fit on the stack give the same output without a workspace
+                    compress_len = lzs_compress_config(compress_buffer, sizeof(compress_buffer), data_buffer, data_len, &config);
+                    TEST_ASSERT_EQUAL_size_t_MESSAGE(reference_len, compress_len, msg);
+                    TEST_ASSERT_EQUAL_UINT8_ARRAY_MESSAGE(reference_buffer, compress_buffer, compress_len, msg);
+
+                    // ... and with incremental compression
+                    lzs_compress_init_config(&compress_params, &config);
+                    compress_params.inPtr = data_buffer;
+                    compress_params.outPtr = compress_buffer;
+                    compress_params.outLength = sizeof(compress_buffer);
+                    compress_len = 0;
+                    do
+                    {
+                        compress_params.inLength = LZSMIN_TEST(data_len - (compress_params.inPtr - data_buffer), IN_BUFFER_BOUNDED_LEN);
+                        compress_len += lzs_compress_incremental(&compress_params,
+                                                                 compress_params.inPtr + compress_params.inLength == data_buffer + data_len);
+                    } while ((compress_params.status & LZS_C_STATUS_END_MARKER) == 0);
+                    TEST_ASSERT_EQUAL_size_t_MESSAGE(reference_len, compress_len, msg);
+                    TEST_ASSERT_EQUAL_UINT8_ARRAY_MESSAGE(reference_buffer, compress_buffer, compress_len, msg);
+                }
+            }
+        }
+    }
+}
+
+static void test_reset(void)
+{
+    static LzsCompressParameters_t  compress_params;
+    static LzsCompressParameters_t  reference_params;
+    char    msg[100];
+    uint8_t data_buffer[STREAM_DATA_SIZE];
+    uint8_t reference_buffer[LZS_COMPRESSED_MAX(STREAM_DATA_SIZE)];
+    uint8_t compress_buffer[LZS_COMPRESSED_MAX(STREAM_DATA_SIZE)];
+    size_t  reference_len;
+    size_t  compress_len;
+    size_t  data_len;
+    const uint8_t * p_data;
+    unsigned int level;
+    int     i;
+
+    for (level = LZS_COMPRESS_LEVEL_FASTEST; level <= LZS_COMPRESS_LEVEL_DEFAULT; level += LZS_COMPRESS_LEVEL_DEFAULT - LZS_COMPRESS_LEVEL_FASTEST)
+    {
+        lzs_compress_init_level(&compress_params, level);
+        // Enough streams to use up the hash epochs twice
+        for (i = 0; i < 40; i++)
+        {
+            snprintf(msg, sizeof(msg), "level %u, stream %d", level, i);
+            p_data = make_stream_data(i, data_buffer, &data_len);
+
+            // A reset context gives the same output as a fully initialised one
+            lzs_compress_init_level(&reference_params, level);
+            reference_len = compress_stream(&reference_params, reference_buffer, sizeof(reference_buffer), p_data, data_len);
+            if (i)
+            {
+                lzs_compress_reset(&compress_params);
+            }
+            compress_len = compress_stream(&compress_params, compress_buffer, sizeof(compress_buffer), p_data, data_len);
+            TEST_ASSERT_EQUAL_size_t_MESSAGE(reference_len, compress_len, msg);
+            TEST_ASSERT_EQUAL_UINT8_ARRAY_MESSAGE(reference_buffer, compress_buffer, compress_len, msg);
+        }
+    }
+}
+
+static void test_workspace(void)
+{
+    static uint16_t workspace[LZS_WORKSPACE_SIZE(INPUT_HASH_BITS) / sizeof(uint16_t)];
+    char    msg[100];
+    uint8_t data_buffer[STREAM_DATA_SIZE];
+    uint8_t reference_buffer[LZS_COMPRESSED_MAX(STREAM_DATA_SIZE)];
+    uint8_t compress_buffer[LZS_COMPRESSED_MAX(STREAM_DATA_SIZE)];
+    size_t  reference_len;
+    size_t  compress_len;
+    size_t  data_len;
+    const uint8_t * p_data;
+    LzsCompressConfig_t config;
+    int     i;
+
+    TEST_ASSERT_EQUAL_size_t(sizeof(workspace), lzs_workspace_size());
+    lzs_compress_level_config(&config, LZS_COMPRESS_LEVEL_FASTEST);
+    TEST_ASSERT_EQUAL_size_t(sizeof(workspace), lzs_compress_workspace_size(&config));
+
+    // Enough calls to use up the hash epochs twice, alternating between two levels
+    for (i = 0; i < 40; i++)
+    {
+        snprintf(msg, sizeof(msg), "call %d", i);
+        p_data = make_stream_data(i / 2, data_buffer, &data_len);
+
+        // A reused workspace gives the same output as a new one
+        if (i % 2)
+        {
+            reference_len = lzs_compress(reference_buffer, sizeof(reference_buffer), p_data, data_len);
+            compress_len = lzs_compress_ws(compress_buffer, sizeof(compress_buffer), p_data, data_len, workspace);
+        }
+        else
+        {
+            reference_len = lzs_compress_config(reference_buffer, sizeof(reference_buffer), p_data, data_len, &config);
+            compress_len = lzs_compress_config_ws(compress_buffer, sizeof(compress_buffer), p_data, data_len, &config, workspace);
+        }
+        TEST_ASSERT_EQUAL_size_t_MESSAGE(reference_len, compress_len, msg);
+        TEST_ASSERT_EQUAL_UINT8_ARRAY_MESSAGE(reference_buffer, compress_buffer, compress_len, msg);
+    }
+}
+
+static void test_match_finders(void)
+{
+    static const size_t data_lens[] = { 0, 1, 2, 3, 4, 100, 1023, 1025, 3000, 5000 };
+    static const unsigned int levels[] = { LZS_COMPRESS_LEVEL_FASTEST, LZS_COMPRESS_LEVEL_DEFAULT, LZS_COMPRESS_LEVEL_BEST, LZS_COMPRESS_LEVEL_MAX };
+    static uint32_t workspace[LZS_OPTIMAL_WORKSPACE_SIZE(LZS_TREE_WORKSPACE_SIZE(INPUT_HASH_BITS)) / sizeof(uint32_t)];
+    char    msg[100];
+    uint8_t data_buffer[5000];
+    uint8_t reference_buffer[LZS_COMPRESSED_MAX(5000)];
+    uint8_t compress_buffer[LZS_COMPRESSED_MAX(5000)];
+    uint8_t decompress_buffer[5000];
+    size_t  reference_len;
+    size_t  compress_len;
+    size_t  decompress_len;
+    size_t  data_len;
+    size_t  i;
+    size_t  l;
+    LzsCompressConfig_t config;
+    LzsCompressConfig_t chain_config;
+    int     data_type;
+    int     hash_type;
+
+    for (data_type = 0; data_type < 3; data_type++)
+    {
+        switch (data_type)
+        {
+            case 0:
+                memset(data_buffer, 'X', sizeof(data_buffer));
+                break;
+            case 1:
+                make_test_data(data_buffer, sizeof(data_buffer));
+                break;
+            default:
+                for (i = 0; i < sizeof(data_buffer); i++)
+                {
+                    data_buffer[i] = uncompressible_sequence[i % (sizeof(uncompressible_sequence) - 1u)];
+                }
+                break;
+        }
+        for (l = 0; l < sizeof(levels) / sizeof(levels[0]); l++)
+        {
+            for (hash_type = 0; hash_type < NUM_LZS_HASH_TYPES; hash_type++)
+            {
+                lzs_compress_level_config(&config, levels[l]);
+                config.hashType = hash_type;
+                config.matchFinder = LZS_MATCH_FINDER_BINARY_TREE;
+                chain_config = config;
+                chain_config.matchFinder = LZS_MATCH_FINDER_HASH_CHAIN;
+                TEST_ASSERT_EQUAL_size_t(config.optimal ? sizeof(workspace) : LZS_TREE_WORKSPACE_SIZE(INPUT_HASH_BITS),
+                                         lzs_compress_workspace_size(&config));
+
+                for (i = 0; i < sizeof(data_lens) / sizeof(data_lens[0]); i++)
+                {
+                    data_len = data_lens[i];
+                    snprintf(msg, sizeof(msg), "data_type %d, level %u, hash type %d, data_len = %zu", data_type, levels[l], hash_type, data_len);
+                    memset(decompress_buffer, 'D', sizeof(decompress_buffer));
+
+                    reference_len = lzs_compress_config_ws(reference_buffer, sizeof(reference_buffer), data_buffer, data_len,
+                                                           &config, workspace);
+                    decompress_len = lzs_decompress(decompress_buffer, sizeof(decompress_buffer), reference_buffer, reference_len);
+                    TEST_ASSERT_EQUAL_size_t_MESSAGE(data_len, decompress_len, msg);
+                    if (data_len)
+                        TEST_ASSERT_EQUAL_UINT8_ARRAY_MESSAGE(data_buffer, decompress_buffer, data_len, msg);
+
+                    // The same workspace can be used for hash chains in between
+                    compress_len = lzs_compress_config_ws(compress_buffer, sizeof(compress_buffer), data_buffer, data_len,
+                                                          &chain_config, workspace);
+                    decompress_len = lzs_decompress(decompress_buffer, sizeof(decompress_buffer), compress_buffer, compress_len);
+                    TEST_ASSERT_EQUAL_size_t_MESSAGE(data_len, decompress_len, msg);
+                    if (data_len)
+                        TEST_ASSERT_EQUAL_UINT8_ARRAY_MESSAGE(data_buffer, decompress_buffer, data_len, msg);
+
+                    // Without a workspace, hash chains and lazy matching are used instead
+                    if (config.optimal)
+                    {
+                        chain_config.optimal = 0;
+                        compress_len = lzs_compress_config_ws(compress_buffer, sizeof(compress_buffer), data_buffer, data_len,
+                                                              &chain_config, workspace);
+                        chain_config.optimal = 1;
+                    }
+                    memset(reference_buffer, 'R', sizeof(reference_buffer));
+                    reference_len = lzs_compress_config(reference_buffer, sizeof(reference_buffer), data_buffer, data_len, &config);
+                    TEST_ASSERT_EQUAL_size_t_MESSAGE(compress_len, reference_len, msg);
+                    TEST_ASSERT_EQUAL_UINT8_ARRAY_MESSAGE(compress_buffer, reference_buffer, reference_len, msg);
+                }
+            }
+        }
+    }
+}
+
+static void test_long_runs(void)
+{
+    static const size_t run_lens[] = { 3, 8, 9, 22, 23, 24, 37, 38, 39, 100, 2047, 2049, 12345 };
+    static uint8_t data_buffer[40000];
+    static uint8_t reference_buffer[LZS_COMPRESSED_MAX(40000)];
+    static uint8_t compress_buffer[LZS_COMPRESSED_MAX(40000)];
+    static uint8_t decompress_buffer[40000];
+    static uint32_t workspace[LZS_OPTIMAL_WORKSPACE_SIZE(LZS_TREE_WORKSPACE_SIZE(INPUT_HASH_BITS)) / sizeof(uint32_t)];
+    char    msg[100];
+    uint32_t lcg = 54321u;
+    size_t  reference_len;
+    size_t  compress_len;
+    size_t  decompress_len;
+    size_t  out_len;
+    size_t  data_len;
+    size_t  run_len;
+    size_t  period;
+    size_t  i;
+    LzsCompressConfig_t config;
+    unsigned int level;
+
+    // Runs of a repeated byte or short pattern, of various lengths, between
+    // stretches of less compressible data
+    make_test_data(data_buffer, sizeof(data_buffer));
+    data_len = 0;
+    while (data_len < sizeof(data_buffer))
+    {
+        lcg = lcg * 1103515245u + 12345u;
+        period = 1u + (lcg >> 8u) % 8u;
+        run_len = run_lens[(lcg >> 16u) % (sizeof(run_lens) / sizeof(run_lens[0]))];
+        data_len += period + (lcg >> 24u) % 32u;
+        for (i = 0; i < run_len && data_len < sizeof(data_buffer); i++, data_len++)
+        {
+            data_buffer[data_len] = data_buffer[data_len - period];
+        }
+    }
+
+    for (level = LZS_COMPRESS_LEVEL_FASTEST; level <= LZS_COMPRESS_LEVEL_MAX; level++)
+    {
+        snprintf(msg, sizeof(msg), "level %u", level);
+        memset(decompress_buffer, 'D', sizeof(decompress_buffer));
+
+        lzs_compress_level_config(&config, level);
+        reference_len = lzs_compress_config_ws(reference_buffer, sizeof(reference_buffer), data_buffer, sizeof(data_buffer), &config, workspace);
+        decompress_len = lzs_decompress(decompress_buffer, sizeof(decompress_buffer), reference_buffer, reference_len);
+        TEST_ASSERT_EQUAL_size_t_MESSAGE(sizeof(data_buffer), decompress_len, msg);
+        TEST_ASSERT_EQUAL_UINT8_ARRAY_MESSAGE(data_buffer, decompress_buffer, decompress_len, msg);
+
+        // A short output buffer gets a prefix of the full output
+        for (out_len = 0; out_len < reference_len; out_len += 1u + out_len / 3u)
+        {
+            memset(compress_buffer, 'C', sizeof(compress_buffer));
+            compress_len = lzs_compress_config_ws(compress_buffer, out_len, data_buffer, sizeof(data_buffer), &config, workspace);
+            TEST_ASSERT_EQUAL_size_t_MESSAGE(out_len, compress_len, msg);
+            if (compress_len)
+                TEST_ASSERT_EQUAL_UINT8_ARRAY_MESSAGE(reference_buffer, compress_buffer, compress_len, msg);
+            TEST_ASSERT_EQUAL_UINT8_MESSAGE('C', compress_buffer[out_len], msg);
+        }
+
+        // A single run is one literal and one match, however long it is
+        for (i = 0; i < sizeof(run_lens) / sizeof(run_lens[0]); i++)
+        {
+            run_len = run_lens[i] + 1u;
+            memset(compress_buffer, 'X', run_len);
+            compress_len = lzs_compress_config_ws(reference_buffer, sizeof(reference_buffer), compress_buffer, run_len, &config, workspace);
+            TEST_ASSERT_EQUAL_size_t_MESSAGE((LITERAL_CHAR_BITS + 2u + OFFSET_SHORT_BITS + length_bits(run_len - 1u) + END_MARKER_BITS + 7u) / 8u,
+                                             compress_len, msg);
+        }
+    }
+}
+
+static void test_window_slide(void)
+{
+    static LzsCompressParameters_t  compress_params;
+    static uint8_t data_buffer[20000];
+    static uint8_t reference_buffer[LZS_COMPRESSED_MAX(20000)];
+    static uint8_t compress_buffer[LZS_COMPRESSED_MAX(20000)];
+    char    msg[100];
+    uint32_t lcg = 13579u;
+    size_t  reference_len;
+    size_t  compress_len;
+    size_t  in_len;
+    size_t  out_len;
+    size_t  i;
+    unsigned int level;
+    int     data_type;
+
+    // A long stream, given in chunks of various sizes, slides the history
+    // window many times. The output is the same as single-call compression.
+    // Random text over a small alphabet also leaves hash table entries that
+    // are older than the history, which must not be taken for recent ones.
+    for (data_type = 0; data_type < 2; data_type++)
+    {
+        if (data_type == 0)
+        {
+            make_test_data(data_buffer, sizeof(data_buffer));
+        }
+        else
+        {
+            for (i = 0; i < sizeof(data_buffer); i++)
+            {
+                lcg = lcg * 1103515245u + 12345u;
+                data_buffer[i] = " abcde"[(lcg >> 16u) % 6u];
+            }
+        }
+        for (level = LZS_COMPRESS_LEVEL_FASTEST; level <= LZS_COMPRESS_LEVEL_BEST; level++)
+        {
+            snprintf(msg, sizeof(msg), "data type %d, level %u", data_type, level);
+            reference_len = lzs_compress_level(reference_buffer, sizeof(reference_buffer), data_buffer, sizeof(data_buffer), level);
+
+            memset(compress_buffer, 'C', sizeof(compress_buffer));
+            lzs_compress_init_level(&compress_params, level);
+            compress_params.inPtr = data_buffer;
+            compress_params.outPtr = compress_buffer;
+            compress_len = 0;
+            do
+            {
+                lcg = lcg * 1103515245u + 12345u;
+                in_len = (lcg >> 8u) % 300u;
+                out_len = (lcg >> 20u) % 100u;
+                compress_params.inLength = LZSMIN_TEST(sizeof(data_buffer) - (compress_params.inPtr - data_buffer), in_len);
+                compress_params.outLength = LZSMIN_TEST(sizeof(compress_buffer) - compress_len, out_len);
+                compress_len += lzs_compress_incremental(&compress_params,
+                                                         compress_params.inPtr + compress_params.inLength == data_buffer + sizeof(data_buffer));
+            } while ((compress_params.status & LZS_C_STATUS_END_MARKER) == 0);
+            TEST_ASSERT_EQUAL_size_t_MESSAGE(reference_len, compress_len, msg);
+            TEST_ASSERT_EQUAL_UINT8_ARRAY_MESSAGE(reference_buffer, compress_buffer, compress_len, msg);
+        }
+    }
+}
+
+static void test_bulk_input(void)
+{
+    static LzsCompressParameters_t  compress_params;
+    static uint8_t data_buffer[20000];
+    static uint8_t reference_buffer[LZS_COMPRESSED_MAX(20000)];
+    static uint8_t compress_buffer[LZS_COMPRESSED_MAX(20000)];
+    char    msg[100];
+    uint32_t lcg = 24680u;
+    size_t  reference_len;
+    size_t  compress_len;
+    size_t  in_len;
+    size_t  out_len;
+    unsigned int level;
+
+    // Large input chunks are read in place. Small output chunks make the calls
+    // return partway through them, so the window is copied out of the input
+    // buffer at various points. The output is the same as single-call compression.
+    make_test_data(data_buffer, sizeof(data_buffer));
+    for (level = LZS_COMPRESS_LEVEL_FASTEST; level <= LZS_COMPRESS_LEVEL_BEST; level++)
+    {
+        snprintf(msg, sizeof(msg), "level %u", level);
+        reference_len = lzs_compress_level(reference_buffer, sizeof(reference_buffer), data_buffer, sizeof(data_buffer), level);
+
+        memset(compress_buffer, 'C', sizeof(compress_buffer));
+        lzs_compress_init_level(&compress_params, level);
+        compress_params.inPtr = data_buffer;
+        compress_params.outPtr = compress_buffer;
+        compress_len = 0;
+        do
+        {
+            lcg = lcg * 1103515245u + 12345u;
+            in_len = (lcg >> 8u) % 12000u;
+            out_len = (lcg >> 16u) % 3000u;
+            compress_params.inLength = LZSMIN_TEST(sizeof(data_buffer) - (compress_params.inPtr - data_buffer), in_len);
+            compress_params.outLength = LZSMIN_TEST(sizeof(compress_buffer) - compress_len, out_len);
+            compress_len += lzs_compress_incremental(&compress_params,
+                                                     compress_params.inPtr + compress_params.inLength == data_buffer + sizeof(data_buffer));
+        } while ((compress_params.status & LZS_C_STATUS_END_MARKER) == 0);
+        TEST_ASSERT_EQUAL_size_t_MESSAGE(reference_len, compress_len, msg);
+        TEST_ASSERT_EQUAL_UINT8_ARRAY_MESSAGE(reference_buffer, compress_buffer, compress_len, msg);
+
+        // The whole input in one call
+        lzs_compress_init_level(&compress_params, level);
+        compress_params.inPtr = data_buffer;
+        compress_params.inLength = sizeof(data_buffer);
+        compress_params.outPtr = compress_buffer;
+        compress_params.outLength = sizeof(compress_buffer);
+        compress_len = lzs_compress_incremental(&compress_params, true);
+        TEST_ASSERT_TRUE_MESSAGE(compress_params.status & LZS_C_STATUS_END_MARKER, msg);
+        TEST_ASSERT_EQUAL_size_t_MESSAGE(reference_len, compress_len, msg);
+        TEST_ASSERT_EQUAL_UINT8_ARRAY_MESSAGE(reference_buffer, compress_buffer, compress_len, msg);
+    }
+}
+
+static void test_flush(void)
+{
+    static LzsCompressParameters_t      compress_params;
+    static LzsDecompressParameters_t    decompress_params;
+    static const unsigned int flush_modes[NUM_FLUSH_MODES] = { LZS_FLUSH_SYNC, LZS_FLUSH_SYNC | LZS_FLUSH_FULL };
+    char    msg[100];
+    uint8_t data_buffer[STREAM_DATA_SIZE];
+    uint8_t reference_buffer[LZS_COMPRESSED_MAX(STREAM_DATA_SIZE)];
+    uint8_t compress_buffer[LZS_COMPRESSED_MAX(STREAM_DATA_SIZE)];
+    uint8_t decompress_buffer[STREAM_DATA_SIZE];
+    size_t  reference_len;
+    size_t  compress_len;
+    size_t  decompress_len;
+    size_t  data_len;
+    size_t  total_len[NUM_FLUSH_MODES];
+    const uint8_t * p_data;
+    size_t  m;
+    int     i;
+
+    for (m = 0; m < NUM_FLUSH_MODES; m++)
+    {
+        lzs_compress_init_level(&compress_params, LZS_COMPRESS_LEVEL_DEFAULT);
+        lzs_decompress_init(&decompress_params);
+        total_len[m] = 0;
+        for (i = 0; i < 8; i++)
+        {
+            snprintf(msg, sizeof(msg), "flush %u, message %d", flush_modes[m], i);
+            p_data = make_stream_data(i, data_buffer, &data_len);
+
+            // Each message is flushed one output byte at a time
+            compress_params.inPtr = p_data;
+            compress_params.inLength = data_len;
+            compress_len = 0;
+            do
+            {
+                compress_params.outPtr = compress_buffer + compress_len;
+                compress_params.outLength = 1u;
+                compress_len += lzs_compress_flush(&compress_params, flush_modes[m]);
+            } while ((compress_params.status & LZS_C_STATUS_END_MARKER) == 0);
+            TEST_ASSERT_EQUAL_size_t_MESSAGE(0, compress_params.inLength, msg);
+            total_len[m] += compress_len;
+
+            // The message decompresses straight away, continuing the same decompression
+            decompress_params.inPtr = compress_buffer;
+            decompress_params.inLength = compress_len;
+            decompress_params.outPtr = decompress_buffer;
+            decompress_params.outLength = sizeof(decompress_buffer);
+            decompress_len = 0;
+            do
+            {
+                decompress_len += lzs_decompress_incremental(&decompress_params);
+            } while (decompress_params.inLength);
+            TEST_ASSERT_TRUE_MESSAGE(decompress_params.status & LZS_D_STATUS_END_MARKER, msg);
+            TEST_ASSERT_EQUAL_size_t_MESSAGE(data_len, decompress_len, msg);
+            TEST_ASSERT_EQUAL_UINT8_ARRAY_MESSAGE(p_data, decompress_buffer, data_len, msg);
+
+            if (flush_modes[m] & LZS_FLUSH_FULL)
+            {
+                // After a full flush, a message is compressed as if it were the first
+                reference_len = lzs_compress_level(reference_buffer, sizeof(reference_buffer), p_data, data_len, LZS_COMPRESS_LEVEL_DEFAULT);
+                TEST_ASSERT_EQUAL_size_t_MESSAGE(reference_len, compress_len, msg);
+                TEST_ASSERT_EQUAL_UINT8_ARRAY_MESSAGE(reference_buffer, compress_buffer, compress_len, msg);
+            }
+        }
+    }
+    // Messages refer to earlier ones after a sync flush
+    TEST_ASSERT_LESS_THAN_size_t(total_len[1], total_len[0]);
+}
+
+static void test_dictionary(void)
+{
+    static LzsCompressParameters_t      compress_params;
+    static LzsDecompressParameters_t    decompress_params;
+    static const size_t dictionary_lens[] = { 100u, LZS_MAX_HISTORY_SIZE, 3000u };
+    char    msg[100];
+    uint8_t data_buffer[STREAM_DATA_SIZE];
+    uint8_t compress_buffer[LZS_COMPRESSED_MAX(STREAM_DATA_SIZE)];
+    uint8_t decompress_buffer[STREAM_DATA_SIZE];
+    size_t  plain_len;
+    size_t  compress_len;
+    size_t  decompress_len;
+    size_t  data_len = 500u;
+    const uint8_t * p_data;
+    unsigned int level;
+    size_t  d;
+
+    // The dictionary is the data just before a short message. Only the last
+    // LZS_MAX_HISTORY_SIZE bytes of the longest dictionary are used.
+    make_test_data(data_buffer, sizeof(data_buffer));
+    p_data = data_buffer + 3000u;
+    for (level = LZS_COMPRESS_LEVEL_FASTEST; level <= LZS_COMPRESS_LEVEL_BEST; level++)
+    {
+        lzs_compress_init_level(&compress_params, level);
+        plain_len = compress_stream(&compress_params, compress_buffer, sizeof(compress_buffer), p_data, data_len);
+        for (d = 0; d < sizeof(dictionary_lens) / sizeof(dictionary_lens[0]); d++)
+        {
+            snprintf(msg, sizeof(msg), "level %u, dictionary %zu", level, dictionary_lens[d]);
+            lzs_compress_reset(&compress_params);
+            lzs_compress_set_dictionary(&compress_params, p_data - dictionary_lens[d], dictionary_lens[d]);
+            compress_len = compress_stream(&compress_params, compress_buffer, sizeof(compress_buffer), p_data, data_len);
+            TEST_ASSERT_LESS_THAN_size_t_MESSAGE(plain_len, compress_len, msg);
+
+            lzs_decompress_init(&decompress_params);
+            lzs_decompress_set_dictionary(&decompress_params, p_data - dictionary_lens[d], dictionary_lens[d]);
+            decompress_params.inPtr = compress_buffer;
+            decompress_params.inLength = compress_len;
+            decompress_params.outPtr = decompress_buffer;
+            decompress_params.outLength = sizeof(decompress_buffer);
+            decompress_len = lzs_decompress_incremental(&decompress_params);
+            TEST_ASSERT_TRUE_MESSAGE(decompress_params.status & LZS_D_STATUS_END_MARKER, msg);
+            TEST_ASSERT_EQUAL_size_t_MESSAGE(data_len, decompress_len, msg);
+            TEST_ASSERT_EQUAL_UINT8_ARRAY_MESSAGE(p_data, decompress_buffer, data_len, msg);
+        }
+    }
+}
+
+static void test_prebuilt_dictionary(void)
+{
+    static LzsCompressParameters_t  compress_params;
+    static LzsCompressParameters_t  reference_params;
+    static LzsDictionary_t          dictionary;
+    char    msg[100];
+    uint8_t data_buffer[STREAM_DATA_SIZE];
+    uint8_t reference_buffer[LZS_COMPRESSED_MAX(STREAM_DATA_SIZE)];
+    uint8_t compress_buffer[LZS_COMPRESSED_MAX(STREAM_DATA_SIZE)];
+    size_t  reference_len;
+    size_t  compress_len;
+    size_t  data_len;
+    const uint8_t * p_data;
+    LzsCompressConfig_t config;
+    unsigned int level;
+    int     i;
+
+    make_test_data(data_buffer, sizeof(data_buffer));
+    for (level = LZS_COMPRESS_LEVEL_FASTEST; level <= LZS_COMPRESS_LEVEL_BEST; level++)
+    {
+        // The dictionary is built for the default level, so other levels with
+        // other hash tables fall back to hashing the dictionary data.
+        lzs_compress_level_config(&config, LZS_COMPRESS_LEVEL_DEFAULT);
+        lzs_dictionary_init(&dictionary, data_buffer, 2500u, &config);
+        lzs_compress_init_level(&compress_params, level);
+        // Enough messages to use up the hash epochs of the reference twice
+        for (i = 0; i < 40; i++)
+        {
+            snprintf(msg, sizeof(msg), "level %u, message %d", level, i);
+            data_len = 100u + (i * 47) % 500u;
+            p_data = data_buffer + 2500u + (i * 131) % (STREAM_DATA_SIZE - 2500u - data_len);
+
+            // An attached dictionary gives the same output as one that is set
+            lzs_compress_init_level(&reference_params, level);
+            lzs_compress_set_dictionary(&reference_params, data_buffer, 2500u);
+            reference_len = compress_stream(&reference_params, reference_buffer, sizeof(reference_buffer), p_data, data_len);
+            lzs_compress_reset(&compress_params);
+            lzs_compress_attach_dictionary(&compress_params, &dictionary);
+            compress_len = compress_stream(&compress_params, compress_buffer, sizeof(compress_buffer), p_data, data_len);
+            TEST_ASSERT_EQUAL_size_t_MESSAGE(reference_len, compress_len, msg);
+            TEST_ASSERT_EQUAL_UINT8_ARRAY_MESSAGE(reference_buffer, compress_buffer, compress_len, msg);
+
+            // Reset without the dictionary after it
+            if (i % 4 == 3)
+            {
+                lzs_compress_reset(&compress_params);
+                lzs_compress_init_level(&reference_params, level);
+                reference_len = compress_stream(&reference_params, reference_buffer, sizeof(reference_buffer), p_data, data_len);
+                compress_len = compress_stream(&compress_params, compress_buffer, sizeof(compress_buffer), p_data, data_len);
+                TEST_ASSERT_EQUAL_size_t_MESSAGE(reference_len, compress_len, msg);
+                TEST_ASSERT_EQUAL_UINT8_ARRAY_MESSAGE(reference_buffer, compress_buffer, compress_len, msg);
+            }
+        }
+    }
+}
+
+static void test_chunked_streams(void)
+{
+    static const int compressors[] = { 4, 6 };
+    static uint8_t data_buffer[20000];
+    static uint8_t compress_buffer[LZS_COMPRESSED_MAX(20000)];
+    static uint8_t decompress_buffer[20000];
+    char    msg[100];
+    size_t  compress_len;
+    size_t  decompress_len;
+    size_t  i;
+
+    // A long stream, given in chunks of various sizes, wraps the history ring
+    // many times. Stale table entries must not give wrong matches.
+    make_test_data(data_buffer, sizeof(data_buffer));
+    memset(data_buffer + 12000u, 'X', 1000u);
+    for (i = 0; i < sizeof(compressors) / sizeof(compressors[0]); i++)
+    {
+        snprintf(msg, sizeof(msg), "compressor %d", compressors[i]);
+        memset(decompress_buffer, 'D', sizeof(decompress_buffer));
+
+        compress_len = compress_chunked(compressors[i], compress_buffer, sizeof(compress_buffer), data_buffer, sizeof(data_buffer));
+        TEST_ASSERT_LESS_THAN_size_t_MESSAGE(sizeof(data_buffer), compress_len, msg);
+
+        decompress_len = lzs_decompress(decompress_buffer, sizeof(decompress_buffer), compress_buffer, compress_len);
+        TEST_ASSERT_EQUAL_size_t_MESSAGE(sizeof(data_buffer), decompress_len, msg);
+        TEST_ASSERT_EQUAL_UINT8_ARRAY_MESSAGE(data_buffer, decompress_buffer, sizeof(data_buffer), msg);
+    }
+}
+
+static void test_lite(void)
+{
+    static uint8_t data_buffer[20000];
+    static uint8_t compress_buffer[LZS_COMPRESSED_MAX(20000)];
+    static uint8_t decompress_buffer[20000];
+    size_t  compress_len;
+    size_t  decompress_len;
+
+    // The context is smaller than that of the compact compressor.
+    TEST_ASSERT_LESS_THAN_size_t(sizeof(LzsCompactCompressParameters_t), sizeof(LzsLiteCompressParameters_t));
+
+    // Single-call
+    make_test_data(data_buffer, sizeof(data_buffer));
+    memset(data_buffer + 12000u, 'X', 1000u);
+    memset(decompress_buffer, 'D', sizeof(decompress_buffer));
+    compress_len = lzs_lite_compress(compress_buffer, sizeof(compress_buffer), data_buffer, sizeof(data_buffer));
+    TEST_ASSERT_LESS_THAN_size_t(sizeof(data_buffer), compress_len);
+
+    decompress_len = lzs_decompress(decompress_buffer, sizeof(decompress_buffer), compress_buffer, compress_len);
+    TEST_ASSERT_EQUAL_size_t(sizeof(data_buffer), decompress_len);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(data_buffer, decompress_buffer, sizeof(data_buffer));
+}
+
+static void test_work_budget(void)
+{
+    static LzsCompressParameters_t  compress_params;
+    static uint8_t data_buffer[20000];
+    static uint8_t reference_buffer[LZS_COMPRESSED_MAX(20000)];
+    static uint8_t compress_buffer[LZS_COMPRESSED_MAX(20000)];
+    static const size_t budgets[] = { 1u, 100u, 5000u };
+    char    msg[100];
+    size_t  reference_len;
+    size_t  compress_len;
+    size_t  calls;
+    unsigned int level;
+    size_t  b;
+
+    make_test_data(data_buffer, sizeof(data_buffer));
+    memset(data_buffer + 12000u, 'X', 1000u);
+    for (level = LZS_COMPRESS_LEVEL_FASTEST; level <= LZS_COMPRESS_LEVEL_BEST; level++)
+    {
+        lzs_compress_init_level(&compress_params, level);
+        lzs_compress_set_dictionary(&compress_params, data_buffer + 15000u, 3000u);
+        reference_len = compress_stream(&compress_params, reference_buffer, sizeof(reference_buffer), data_buffer, sizeof(data_buffer));
+        for (b = 0; b < sizeof(budgets) / sizeof(budgets[0]); b++)
+        {
+            snprintf(msg, sizeof(msg), "level %u, budget %zu", level, budgets[b]);
+            // The budget is kept by a reset
+            compress_params.workBudget = budgets[b];
+            lzs_compress_reset(&compress_params);
+            lzs_compress_set_dictionary(&compress_params, data_buffer + 15000u, 3000u);
+            compress_params.inPtr = data_buffer;
+            compress_params.inLength = sizeof(data_buffer);
+            compress_params.outPtr = compress_buffer;
+            compress_params.outLength = sizeof(compress_buffer);
+            compress_len = 0;
+            calls = 0;
+            do
+            {
+                compress_len += lzs_compress_incremental(&compress_params, true);
+                calls++;
+                TEST_ASSERT_TRUE_MESSAGE(compress_params.status & (LZS_C_STATUS_BUDGET_EXHAUSTED | LZS_C_STATUS_END_MARKER), msg);
+            } while ((compress_params.status & LZS_C_STATUS_END_MARKER) == 0);
+
+            // The output is the same as without a budget
+            TEST_ASSERT_EQUAL_size_t_MESSAGE(reference_len, compress_len, msg);
+            TEST_ASSERT_EQUAL_UINT8_ARRAY_MESSAGE(reference_buffer, compress_buffer, compress_len, msg);
+            TEST_ASSERT_GREATER_THAN_size_t_MESSAGE(sizeof(data_buffer) / 8u / budgets[b], calls, msg);
+        }
+        compress_params.workBudget = 0;
+    }
+}
+
+static void test_incompressible(void)
+{
+    static LzsCompressParameters_t  compress_params;
+    static uint8_t data_buffer[12000];
+    static uint8_t reference_buffer[LZS_COMPRESSED_MAX(12000)];
+    static uint8_t compress_buffer[LZS_COMPRESSED_MAX(12000)];
+    static uint8_t decompress_buffer[12000];
+    char    msg[100];
+    uint32_t lcg = 13579u;
+    size_t  reference_len;
+    size_t  compress_len;
+    size_t  decompress_len;
+    size_t  i;
+    LzsCompressConfig_t config;
+    unsigned int level;
+
+    // Random data, then compressible data, then random data again
+    make_test_data(data_buffer, sizeof(data_buffer));
+    for (i = 0; i < 4000u; i++)
+    {
+        lcg = lcg * 1103515245u + 12345u;
+        data_buffer[i] = (uint8_t)(lcg >> 16u);
+        data_buffer[i + 8000u] = (uint8_t)(lcg >> 8u);
+    }
+    // The default level searches every position, to give the same output as before
+    lzs_compress_level_config(&config, LZS_COMPRESS_LEVEL_DEFAULT);
+    TEST_ASSERT_EQUAL(0, config.incompressibleRun);
+
+    // Only the fast levels skip positions
+    for (level = LZS_COMPRESS_LEVEL_FASTEST; level <= 4u; level++)
+    {
+        snprintf(msg, sizeof(msg), "level %u", level);
+        lzs_compress_level_config(&config, level);
+        TEST_ASSERT_NOT_EQUAL_MESSAGE(0, config.incompressibleRun, msg);
+        config.incompressibleRun = 0;
+        reference_len = lzs_compress_config(reference_buffer, sizeof(reference_buffer), data_buffer, sizeof(data_buffer), &config);
+
+        // Matches are found again soon after the random data
+        compress_len = lzs_compress_level(compress_buffer, sizeof(compress_buffer), data_buffer, sizeof(data_buffer), level);
+        TEST_ASSERT_LESS_OR_EQUAL_size_t_MESSAGE(reference_len + sizeof(data_buffer) / 100u, compress_len, msg);
+        decompress_len = lzs_decompress(decompress_buffer, sizeof(decompress_buffer), compress_buffer, compress_len);
+        TEST_ASSERT_EQUAL_size_t_MESSAGE(sizeof(data_buffer), decompress_len, msg);
+        TEST_ASSERT_EQUAL_UINT8_ARRAY_MESSAGE(data_buffer, decompress_buffer, sizeof(data_buffer), msg);
+
+        // Incremental compression gives the same output, and reports the random data
+        lzs_compress_init_level(&compress_params, level);
+        compress_params.inPtr = data_buffer;
+        compress_params.inLength = 4000u;
+        compress_params.outPtr = reference_buffer;
+        compress_params.outLength = sizeof(reference_buffer);
+        reference_len = lzs_compress_incremental(&compress_params, false);
+        TEST_ASSERT_TRUE_MESSAGE(compress_params.status & LZS_C_STATUS_INCOMPRESSIBLE, msg);
+        compress_params.inLength = 4000u;
+        reference_len += lzs_compress_incremental(&compress_params, false);
+        TEST_ASSERT_FALSE_MESSAGE(compress_params.status & LZS_C_STATUS_INCOMPRESSIBLE, msg);
+        compress_params.inLength = 4000u;
+        do
+        {
+            reference_len += lzs_compress_incremental(&compress_params, true);
+        } while ((compress_params.status & LZS_C_STATUS_END_MARKER) == 0);
+        TEST_ASSERT_EQUAL_size_t_MESSAGE(compress_len, reference_len, msg);
+        TEST_ASSERT_EQUAL_UINT8_ARRAY_MESSAGE(compress_buffer, reference_buffer, compress_len, msg);
+    }
+}
+
+static void test_batch(void)
+{
+    static uint32_t workspace[LZS_OPTIMAL_WORKSPACE_SIZE(LZS_TREE_WORKSPACE_SIZE(INPUT_HASH_BITS)) / sizeof(uint32_t)];
+    static uint8_t data_buffer[20000];
+    static uint8_t compress_buffer[NUM_BATCH_MESSAGES][LZS_COMPRESSED_MAX(1500)];
+    static uint8_t reference_buffer[LZS_COMPRESSED_MAX(1500)];
+    static uint8_t decompress_buffer[NUM_BATCH_MESSAGES][1500];
+    LzsConstBuffer_t in[NUM_BATCH_MESSAGES];
+    LzsBuffer_t out[NUM_BATCH_MESSAGES];
+    LzsConstBuffer_t compressed[NUM_BATCH_MESSAGES];
+    LzsBuffer_t decompressed[NUM_BATCH_MESSAGES];
+    char    msg[100];
+    size_t  reference_len;
+    size_t  total_len;
+    size_t  compress_total;
+    size_t  data_total;
+    LzsCompressConfig_t config;
+    unsigned int level;
+    size_t  i;
+
+    // Messages of 64 to 1500 bytes, from various parts of the data
+    make_test_data(data_buffer, sizeof(data_buffer));
+    data_total = 0;
+    for (i = 0; i < NUM_BATCH_MESSAGES; i++)
+    {
+        in[i].len = 64u + (i * 337u) % (1500u - 64u + 1u);
+        in[i].ptr = data_buffer + (i * 811u) % (sizeof(data_buffer) - in[i].len);
+        data_total += in[i].len;
+    }
+    for (level = LZS_COMPRESS_LEVEL_FASTEST; level <= LZS_COMPRESS_LEVEL_MAX; level++)
+    {
+        lzs_compress_level_config(&config, level);
+        for (i = 0; i < NUM_BATCH_MESSAGES; i++)
+        {
+            out[i].ptr = compress_buffer[i];
+            out[i].len = sizeof(compress_buffer[i]);
+        }
+        compress_total = lzs_compress_batch(out, in, NUM_BATCH_MESSAGES, &config, workspace);
+
+        // Each message is the same as if it were compressed on its own
+        total_len = 0;
+        for (i = 0; i < NUM_BATCH_MESSAGES; i++)
+        {
+            snprintf(msg, sizeof(msg), "level %u, message %zu", level, i);
+            reference_len = lzs_compress_config_ws(reference_buffer, sizeof(reference_buffer), in[i].ptr, in[i].len, &config, workspace);
+            TEST_ASSERT_EQUAL_size_t_MESSAGE(reference_len, out[i].len, msg);
+            TEST_ASSERT_EQUAL_UINT8_ARRAY_MESSAGE(reference_buffer, compress_buffer[i], reference_len, msg);
+            total_len += out[i].len;
+
+            compressed[i].ptr = out[i].ptr;
+            compressed[i].len = out[i].len;
+            decompressed[i].ptr = decompress_buffer[i];
+            decompressed[i].len = sizeof(decompress_buffer[i]);
+        }
+        TEST_ASSERT_EQUAL_size_t(total_len, compress_total);
+
+        TEST_ASSERT_EQUAL_size_t(data_total, lzs_decompress_batch(decompressed, compressed, NUM_BATCH_MESSAGES));
+        for (i = 0; i < NUM_BATCH_MESSAGES; i++)
+        {
+            snprintf(msg, sizeof(msg), "level %u, message %zu", level, i);
+            TEST_ASSERT_EQUAL_size_t_MESSAGE(in[i].len, decompressed[i].len, msg);
+            TEST_ASSERT_EQUAL_UINT8_ARRAY_MESSAGE(in[i].ptr, decompress_buffer[i], in[i].len, msg);
+        }
+    }
+}
+
 void setUp(void)
 {
 }
@@ -183,6 +1395,24 @@ int main(int argc, char **argv)
 
     RUN_TEST(test_uncompressible);
     RUN_TEST(test_repeated_byte);
+    RUN_TEST(test_match_kernels);
+    RUN_TEST(test_levels);
+    RUN_TEST(test_optimal);
+    RUN_TEST(test_hash_types);
+    RUN_TEST(test_reset);
+    RUN_TEST(test_workspace);
+    RUN_TEST(test_match_finders);
+    RUN_TEST(test_long_runs);
+    RUN_TEST(test_window_slide);
+    RUN_TEST(test_bulk_input);
+    RUN_TEST(test_flush);
+    RUN_TEST(test_dictionary);
+    RUN_TEST(test_prebuilt_dictionary);
+    RUN_TEST(test_chunked_streams);
+    RUN_TEST(test_lite);
+    RUN_TEST(test_work_budget);
+    RUN_TEST(test_incompressible);
+    RUN_TEST(test_batch);
 
     return UNITY_END();
 }
@@ -0,0 +1,1371 @@
+/*****************************************************************************
+ *
+ * \file
+ *
+ * \brief Benchmark of compression and decompression
+ *
+ * Usage:
+ *
+ *     lzs-bench [-s section] [-t seconds] [file ...]
+ *
+ * Without file arguments, a built-in corpus of synthetic data is used. Each
+ * benchmark section prints a table of compression ratio and throughput.
+ *
+ ****************************************************************************/
+
+
+/*****************************************************************************
+ * Includes
+ ****************************************************************************/
+
+#include "lzs.h"
+#include "lzs-common.h"     /* For lzs_match_len_func, to time kernels directly */
+
+#include <stdio.h>
+#include <string.h>         /* For memset() */
+#include <time.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+
+/*****************************************************************************
+ * Defines
+ ****************************************************************************/
+
+#define CORPUS_SIZE                 (256u * 1024u)
+#define CORPUS_MAX_FILES            16u
+#define SIMPLE_CORPUS_SIZE          (32u * 1024u)
+
+#define INCREMENTAL_INPUT_SIZE      4096u
+
+// Size of each independently compressed packet, for the "reset" section
+#define PACKET_SIZE                 1500u
+
+#define BENCH_DEFAULT_SECONDS       0.25
+
+#define ARRAY_ENTRIES(a)            (sizeof(a)/sizeof((a)[0]))
+
+
+/*****************************************************************************
+ * Typedefs
+ ****************************************************************************/
+
+typedef struct
+{
+    const char        * name;
+    uint8_t           * data;
+    size_t              len;
+} BenchCorpus_t;
+
+typedef size_t (*BenchCompressFunc_t)(uint8_t * a_pOutData, size_t a_outBufferSize, const uint8_t * a_pInData, size_t a_inLen);
+
+typedef struct
+{
+    const char        * name;
+    BenchCompressFunc_t func;
+    size_t              maxInput;           // Limit on input size for slow compressors, or 0
+} BenchCompressor_t;
+
+typedef struct
+{
+    const char        * name;
+    void              (*func)(void);
+} BenchSection_t;
+
+
+/*****************************************************************************
+ * Variables
+ ****************************************************************************/
+
+static BenchCorpus_t    corpus[CORPUS_MAX_FILES];
+static size_t           corpusCount;
+static double           benchSeconds = BENCH_DEFAULT_SECONDS;
+static uint32_t         randomState = 0x12345678u;
+static unsigned int     benchLevel = LZS_COMPRESS_LEVEL_DEFAULT;
+static size_t           benchChunkSize = INCREMENTAL_INPUT_SIZE;
+static size_t           benchWorkBudget;
+static LzsCompressConfig_t  benchConfig;
+// Large enough for either match finder with optimal parsing, since the binary trees need the most
+static uint32_t         benchWorkspace[LZS_OPTIMAL_WORKSPACE_SIZE(LZS_TREE_WORKSPACE_SIZE(LZS_HASH_BITS_MAX)) / sizeof(uint32_t)];
+
+static LzsCompressParameters_t          compressParams;
+static LzsSimpleCompressParameters_t    simpleCompressParams;
+static LzsCompactCompressParameters_t   compactCompressParams;
+static LzsLiteCompressParameters_t      liteCompressParams;
+static LzsDecompressParameters_t        decompressParams;
+
+static const char * const kernelNames[NUM_LZS_MATCH_KERNELS] =
+{
+    "auto",
+    "byte",
+    "word64",
+    "sse2",
+    "avx2",
+};
+
+static const char * const words[] =
+{
+    "the", "of", "and", "a", "to", "in", "is", "you", "that", "it",
+    "he", "was", "for", "on", "are", "as", "with", "his", "they", "at",
+    "be", "this", "have", "from", "or", "one", "had", "by", "word", "but",
+    "not", "what", "all", "were", "we", "when", "your", "can", "said", "there",
+    "compression", "history", "window", "offset", "length", "token", "buffer", "data",
+    "representation", "object", "function", "string", "value", "instance", "method", "return",
+};
+
+
+/*****************************************************************************
+ * Support functions
+ ****************************************************************************/
+
+static uint32_t bench_random(void)
+{
+    // xorshift32
+    randomState ^= randomState << 13u;
+    randomState ^= randomState >> 17u;
+    randomState ^= randomState << 5u;
+    return randomState;
+}
+
+static double bench_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static uint8_t * bench_malloc(size_t size)
+{
+    uint8_t * p;
+
+    p = (uint8_t *)malloc(size ? size : 1u);
+    if (p == NULL)
+    {
+        perror("malloc");
+        exit(2);
+    }
+    return p;
+}
+
+static size_t bench_append(uint8_t * p, size_t len, size_t maxLen, const char * s)
+{
+    while (*s && len < maxLen)
+    {
+        p[len++] = (uint8_t)*s++;
+    }
+    return len;
+}
+
+static void corpus_add(const char * name, uint8_t * data, size_t len)
+{
+    if (corpusCount < ARRAY_ENTRIES(corpus))
+    {
+        corpus[corpusCount].name = name;
+        corpus[corpusCount].data = data;
+        corpus[corpusCount].len = len;
+        corpusCount++;
+    }
+}
+
+/*
+ * English-like text, with a skewed word distribution.
+ */
+static void corpus_make_text(void)
+{
+    uint8_t   * p = bench_malloc(CORPUS_SIZE);
+    size_t      len = 0;
+    uint32_t    r;
+    bool        capital = true;
+
+    while (len < CORPUS_SIZE)
+    {
+        r = bench_random();
+        // Squaring a uniform value skews towards the start of the word list
+        r = ((r & 0xFFFFu) * (r & 0xFFFFu)) >> 16u;
+        r = (r * ARRAY_ENTRIES(words)) >> 16u;
+        if (capital && len < CORPUS_SIZE)
+        {
+            p[len++] = (uint8_t)(words[r][0] - 'a' + 'A');
+            len = bench_append(p, len, CORPUS_SIZE, words[r] + 1);
+        }
+        else
+        {
+            len = bench_append(p, len, CORPUS_SIZE, words[r]);
+        }
+        capital = false;
+        r = bench_random() % 16u;
+        if (r == 0)
+        {
+            len = bench_append(p, len, CORPUS_SIZE, ". ");
+            capital = true;
+        }
+        else if (r == 1)
+        {
+            len = bench_append(p, len, CORPUS_SIZE, ", ");
+        }
+        else if (r == 2)
+        {
+            len = bench_append(p, len, CORPUS_SIZE, ".\n");
+            capital = true;
+        }
+        else
+        {
+            len = bench_append(p, len, CORPUS_SIZE, " ");
+        }
+    }
+    corpus_add("text", p, len);
+}
+
+/*
+ * Server log lines, from a handful of templates with varying fields.
+ */
+static void corpus_make_log(void)
+{
+    static const char * const levels[] = { "INFO", "INFO", "INFO", "DEBUG", "WARN", "ERROR" };
+    static const char * const paths[] = { "/api/v1/items", "/api/v1/users", "/static/app.js", "/health", "/api/v2/orders" };
+    uint8_t   * p = bench_malloc(CORPUS_SIZE);
+    size_t      len = 0;
+    char        line[200];
+    unsigned    seconds = 0;
+
+    while (len < CORPUS_SIZE)
+    {
+        seconds += bench_random() % 3u;
+        snprintf(line, sizeof(line),
+                 "2017-06-%02u %02u:%02u:%02u.%03u %-5s [worker-%u] 10.0.%u.%u GET %s/%u status=%u bytes=%u dur_ms=%u\n",
+                 1u + seconds / 86400u, (seconds / 3600u) % 24u, (seconds / 60u) % 60u, seconds % 60u,
+                 (unsigned)(bench_random() % 1000u),
+                 levels[bench_random() % ARRAY_ENTRIES(levels)],
+                 (unsigned)(bench_random() % 8u),
+                 (unsigned)(bench_random() % 4u), (unsigned)(bench_random() % 256u),
+                 paths[bench_random() % ARRAY_ENTRIES(paths)],
+                 (unsigned)(bench_random() % 5000u),
+                 (bench_random() % 10u) ? 200u : 404u,
+                 (unsigned)(bench_random() % 20000u),
+                 (unsigned)(bench_random() % 200u));
+        len = bench_append(p, len, CORPUS_SIZE, line);
+    }
+    corpus_add("log", p, len);
+}
+
+/*
+ * Small templated JSON records.
+ */
+static void corpus_make_json(void)
+{
+    static const char * const events[] = { "login", "logout", "purchase", "view", "search" };
+    uint8_t   * p = bench_malloc(CORPUS_SIZE);
+    size_t      len = 0;
+    char        record[240];
+
+    while (len < CORPUS_SIZE)
+    {
+        snprintf(record, sizeof(record),
+                 "{\"id\":%u,\"user\":\"user%u\",\"event\":\"%s\",\"ok\":%s,\"ts\":%u,\"session\":{\"region\":\"eu-%u\",\"seq\":%u}}\n",
+                 (unsigned)(bench_random() % 1000000u),
+                 (unsigned)(bench_random() % 500u),
+                 events[bench_random() % ARRAY_ENTRIES(events)],
+                 (bench_random() % 8u) ? "true" : "false",
+                 (unsigned)(1497000000u + bench_random() % 100000u),
+                 (unsigned)(bench_random() % 4u),
+                 (unsigned)(bench_random() % 100u));
+        len = bench_append(p, len, CORPUS_SIZE, record);
+    }
+    corpus_add("json", p, len);
+}
+
+/*
+ * Binary table of little-endian 32-bit records with slowly changing fields.
+ */
+static void corpus_make_binary(void)
+{
+    uint8_t   * p = bench_malloc(CORPUS_SIZE);
+    size_t      len;
+    uint32_t    value = 0x10000u;
+    uint32_t    flags = 0;
+
+    for (len = 0; len + 8u <= CORPUS_SIZE; len += 8u)
+    {
+        value += bench_random() % 64u;
+        if ((bench_random() % 32u) == 0)
+        {
+            flags = bench_random() & 0x0F0Fu;
+        }
+        p[len + 0] = (uint8_t)value;
+        p[len + 1] = (uint8_t)(value >> 8u);
+        p[len + 2] = (uint8_t)(value >> 16u);
+        p[len + 3] = (uint8_t)(value >> 24u);
+        p[len + 4] = (uint8_t)flags;
+        p[len + 5] = (uint8_t)(flags >> 8u);
+        p[len + 6] = 0;
+        p[len + 7] = 0;
+    }
+    corpus_add("binary", p, len);
+}
+
+/*
+ * Mostly zero-filled pages, as in a disk image.
+ */
+static void corpus_make_zeros(void)
+{
+    uint8_t   * p = bench_malloc(CORPUS_SIZE);
+    size_t      len;
+    size_t      i;
+
+    memset(p, 0, CORPUS_SIZE);
+    for (len = 0; len < CORPUS_SIZE; len += 4096u)
+    {
+        if ((bench_random() % 4u) == 0)
+        {
+            for (i = 0; i < 64u; i++)
+            {
+                p[len + i] = (uint8_t)bench_random();
+            }
+        }
+    }
+    corpus_add("zeros", p, CORPUS_SIZE);
+}
+
+/*
+ * Incompressible data.
+ */
+static void corpus_make_random(void)
+{
+    uint8_t   * p = bench_malloc(CORPUS_SIZE);
+    size_t      len;
+
+    for (len = 0; len < CORPUS_SIZE; len++)
+    {
+        p[len] = (uint8_t)(bench_random() >> 8u);
+    }
+    corpus_add("random", p, CORPUS_SIZE);
+}
+
+static void corpus_load_file(const char * name)
+{
+    int         fd;
+    struct stat stbuf;
+    uint8_t   * p;
+    ssize_t     read_len;
+
+    fd = open(name, O_RDONLY);
+    if (fd < 0 || fstat(fd, &stbuf) != 0 || !S_ISREG(stbuf.st_mode))
+    {
+        perror(name);
+        exit(1);
+    }
+    p = bench_malloc(stbuf.st_size);
+    read_len = read(fd, p, stbuf.st_size);
+    if (read_len != stbuf.st_size)
+    {
+        perror("read");
+        exit(1);
+    }
+    close(fd);
+    corpus_add(name, p, stbuf.st_size);
+}
+
+/*
+ * Single-call compression at compression level benchLevel.
+ */
+static size_t bench_compress_level(uint8_t * a_pOutData, size_t a_outBufferSize, const uint8_t * a_pInData, size_t a_inLen)
+{
+    return lzs_compress_level(a_pOutData, a_outBufferSize, a_pInData, a_inLen, benchLevel);
+}
+
+/*
+ * Single-call compression with compression parameters benchConfig.
+ */
+static size_t bench_compress_config(uint8_t * a_pOutData, size_t a_outBufferSize, const uint8_t * a_pInData, size_t a_inLen)
+{
+    return lzs_compress_config(a_pOutData, a_outBufferSize, a_pInData, a_inLen, &benchConfig);
+}
+
+/*
+ * Single-call compression with compression parameters benchConfig, using benchWorkspace.
+ */
+static size_t bench_compress_config_ws(uint8_t * a_pOutData, size_t a_outBufferSize, const uint8_t * a_pInData, size_t a_inLen)
+{
+    return lzs_compress_config_ws(a_pOutData, a_outBufferSize, a_pInData, a_inLen, &benchConfig, benchWorkspace);
+}
+
+/*
+ * Incremental compression at compression level benchLevel, with input given in chunks of benchChunkSize.
+ */
+static size_t bench_compress_incremental(uint8_t * a_pOutData, size_t a_outBufferSize, const uint8_t * a_pInData, size_t a_inLen)
+{
+    size_t  inRemaining = a_inLen;
+    size_t  chunk;
+    size_t  outCount = 0;
+
+    lzs_compress_init_level(&compressParams, benchLevel);
+    compressParams.workBudget = benchWorkBudget;
+    compressParams.outPtr = a_pOutData;
+    compressParams.outLength = a_outBufferSize;
+    compressParams.inPtr = a_pInData;
+    compressParams.inLength = 0;
+    do
+    {
+        if (compressParams.inLength == 0)
+        {
+            chunk = LZSMIN(inRemaining, benchChunkSize);
+            compressParams.inLength = chunk;
+            inRemaining -= chunk;
+        }
+        outCount += lzs_compress_incremental(&compressParams, inRemaining == 0);
+    } while (((compressParams.status & LZS_C_STATUS_END_MARKER) == 0) &&
+             ((compressParams.status & LZS_C_STATUS_NO_OUTPUT_BUFFER_SPACE) == 0));
+    return outCount;
+}
+
+static size_t bench_simple_compress_incremental(uint8_t * a_pOutData, size_t a_outBufferSize, const uint8_t * a_pInData, size_t a_inLen)
+{
+    size_t  inRemaining = a_inLen;
+    size_t  chunk;
+    size_t  outCount = 0;
+
+    lzs_simple_compress_init(&simpleCompressParams);
+    simpleCompressParams.outPtr = a_pOutData;
+    simpleCompressParams.outLength = a_outBufferSize;
+    simpleCompressParams.inPtr = a_pInData;
+    do
+    {
+        chunk = LZSMIN(inRemaining, INCREMENTAL_INPUT_SIZE);
+        simpleCompressParams.inLength = chunk;
+        inRemaining -= chunk;
+        outCount += lzs_simple_compress_incremental(&simpleCompressParams, inRemaining == 0);
+    } while (((simpleCompressParams.status & LZS_C_STATUS_END_MARKER) == 0) &&
+             ((simpleCompressParams.status & LZS_C_STATUS_NO_OUTPUT_BUFFER_SPACE) == 0));
+    return outCount;
+}
+
+static size_t bench_compact_compress_incremental(uint8_t * a_pOutData, size_t a_outBufferSize, const uint8_t * a_pInData, size_t a_inLen)
+{
+    size_t  inRemaining = a_inLen;
+    size_t  chunk;
+    size_t  outCount = 0;
+
+    lzs_compact_compress_init(&compactCompressParams);
+    compactCompressParams.outPtr = a_pOutData;
+    compactCompressParams.outLength = a_outBufferSize;
+    compactCompressParams.inPtr = a_pInData;
+    do
+    {
+        chunk = LZSMIN(inRemaining, INCREMENTAL_INPUT_SIZE);
+        compactCompressParams.inLength = chunk;
+        inRemaining -= chunk;
+        outCount += lzs_compact_compress_incremental(&compactCompressParams, inRemaining == 0);
+    } while (((compactCompressParams.status & LZS_C_STATUS_END_MARKER) == 0) &&
+             ((compactCompressParams.status & LZS_C_STATUS_NO_OUTPUT_BUFFER_SPACE) == 0));
+    return outCount;
+}
+
+static size_t bench_lite_compress_incremental(uint8_t * a_pOutData, size_t a_outBufferSize, const uint8_t * a_pInData, size_t a_inLen)
+{
+    size_t  inRemaining = a_inLen;
+    size_t  chunk;
+    size_t  outCount = 0;
+
+    lzs_lite_compress_init(&liteCompressParams);
+    liteCompressParams.outPtr = a_pOutData;
+    liteCompressParams.outLength = a_outBufferSize;
+    liteCompressParams.inPtr = a_pInData;
+    do
+    {
+        chunk = LZSMIN(inRemaining, INCREMENTAL_INPUT_SIZE);
+        liteCompressParams.inLength = chunk;
+        inRemaining -= chunk;
+        outCount += lzs_lite_compress_incremental(&liteCompressParams, inRemaining == 0);
+    } while (((liteCompressParams.status & LZS_C_STATUS_END_MARKER) == 0) &&
+             ((liteCompressParams.status & LZS_C_STATUS_NO_OUTPUT_BUFFER_SPACE) == 0));
+    return outCount;
+}
+
+static size_t bench_decompress_incremental(uint8_t * a_pOutData, size_t a_outBufferSize, const uint8_t * a_pInData, size_t a_inLen)
+{
+    size_t  inRemaining = a_inLen;
+    size_t  chunk;
+    size_t  outCount = 0;
+
+    lzs_decompress_init(&decompressParams);
+    decompressParams.outPtr = a_pOutData;
+    decompressParams.outLength = a_outBufferSize;
+    decompressParams.inPtr = a_pInData;
+    do
+    {
+        chunk = LZSMIN(inRemaining, INCREMENTAL_INPUT_SIZE);
+        decompressParams.inLength = chunk;
+        inRemaining -= chunk;
+        outCount += lzs_decompress_incremental(&decompressParams);
+    } while (inRemaining > 0 &&
+             ((decompressParams.status & LZS_D_STATUS_END_MARKER) == 0) &&
+             ((decompressParams.status & LZS_D_STATUS_NO_OUTPUT_BUFFER_SPACE) == 0));
+    return outCount;
+}
+
+static const BenchCompressor_t compressors[] =
+{
+    { "lzs_compress",                       lzs_compress,                       0 },
+    { "lzs_compress_incremental",           bench_compress_incremental,         0 },
+    { "lzs_simple_compress",                lzs_simple_compress,                SIMPLE_CORPUS_SIZE },
+    { "lzs_simple_compress_incremental",    bench_simple_compress_incremental,  SIMPLE_CORPUS_SIZE },
+    { "lzs_compact_compress_incremental",   bench_compact_compress_incremental, 0 },
+    { "lzs_lite_compress",                  lzs_lite_compress,                  0 },
+    { "lzs_lite_compress_incremental",      bench_lite_compress_incremental,    0 },
+};
+
+/**
+ * \brief Time a compressor on one corpus entry, and check that the output decompresses correctly
+ *
+ * \param pCompressor: Compressor to run.
+ * \param pCorpus: Data to compress.
+ * \param pRatio: Set to compressed size as a percentage of the input size.
+ *
+ * \return double: Throughput in MB/s of input data, or negative if the round-trip failed.
+ */
+static double bench_compressor(const BenchCompressor_t * pCompressor, const BenchCorpus_t * pCorpus, double * pRatio)
+{
+    size_t      inLen;
+    size_t      outSize;
+    size_t      outLen = 0;
+    size_t      checkLen;
+    uint8_t   * pOut;
+    uint8_t   * pCheck;
+    unsigned    runs = 0;
+    double      start;
+    double      elapsed;
+
+    inLen = pCorpus->len;
+    if (pCompressor->maxInput && inLen > pCompressor->maxInput)
+    {
+        inLen = pCompressor->maxInput;
+    }
+    outSize = LZS_COMPRESSED_MAX(inLen);
+    pOut = bench_malloc(outSize);
+    pCheck = bench_malloc(inLen);
+
+    start = bench_now();
+    do
+    {
+        outLen = pCompressor->func(pOut, outSize, pCorpus->data, inLen);
+        runs++;
+        elapsed = bench_now() - start;
+    } while (elapsed < benchSeconds);
+
+    checkLen = lzs_decompress(pCheck, inLen, pOut, outLen);
+    *pRatio = inLen ? 100.0 * (double)outLen / (double)inLen : 0;
+    if (checkLen != inLen || memcmp(pCheck, pCorpus->data, inLen) != 0)
+    {
+        elapsed = -1.0;
+    }
+    free(pOut);
+    free(pCheck);
+    return (elapsed < 0) ? -1.0 : (double)inLen * runs / elapsed / 1e6;
+}
+
+/**
+ * \brief Read bits from compressed data, most significant bit first
+ *
+ * \param pData: Compressed data.
+ * \param pBitPos: Bit position to read from, advanced past the bits read.
+ * \param width: Number of bits to read.
+ *
+ * \return unsigned: The bits read. Bits past the end of the data must not be read.
+ */
+static unsigned bench_get_bits(const uint8_t * pData, size_t * pBitPos, unsigned width)
+{
+    unsigned    value = 0;
+
+    while (width--)
+    {
+        value = (value << 1u) | ((pData[*pBitPos / 8u] >> (7u - *pBitPos % 8u)) & 1u);
+        (*pBitPos)++;
+    }
+    return value;
+}
+
+/**
+ * \brief Count the literal and offset/length tokens in compressed data
+ *
+ * \param pData: Compressed data, which must be valid and end with an end marker.
+ * \param len: Length of compressed data.
+ *
+ * \return size_t: Number of tokens, not counting the end marker.
+ */
+static size_t bench_count_tokens(const uint8_t * pData, size_t len)
+{
+    size_t      bitPos = 0;
+    size_t      tokens = 0;
+    unsigned    length;
+
+    while (bitPos + 9u <= len * 8u)
+    {
+        if (bench_get_bits(pData, &bitPos, 1u) == 0)
+        {
+            bitPos += 8u;                   // Literal
+        }
+        else
+        {
+            if (bench_get_bits(pData, &bitPos, 1u))
+            {
+                if (bench_get_bits(pData, &bitPos, 7u) == 0)
+                {
+                    break;                  // End marker
+                }
+            }
+            else
+            {
+                bitPos += 11u;
+            }
+            // Length: 2 bits, then 2 more bits if those are 11, then 4-bit extended lengths while they are 1111
+            length = bench_get_bits(pData, &bitPos, 2u);
+            if (length == 3u && bench_get_bits(pData, &bitPos, 2u) == 3u)
+            {
+                while (bench_get_bits(pData, &bitPos, 4u) == 15u)
+                {
+                }
+            }
+        }
+        tokens++;
+    }
+    return tokens;
+}
+
+static void bench_print_row(const char * name, const char * variant, const char * corpusName, double ratio, double mbps)
+{
+    if (mbps < 0)
+    {
+        printf("%-34s %-8s %-10s %7.2f%%  ROUND-TRIP FAILED\n", name, variant, corpusName, ratio);
+    }
+    else
+    {
+        printf("%-34s %-8s %-10s %7.2f%% %9.2f MB/s\n", name, variant, corpusName, ratio, mbps);
+    }
+}
+
+
+/*****************************************************************************
+ * Benchmark sections
+ ****************************************************************************/
+
+/*
+ * Match-length kernels: nanoseconds per call for a range of match lengths,
+ * then throughput of each compressor using each kernel.
+ */
+static void bench_kernels(void)
+{
+    static const size_t lengths[] = { 2u, 8u, 12u, 15u, 32u, 64u, 256u, 1024u };
+    uint8_t         a[1100];
+    uint8_t         b[1100];
+    size_t          i;
+    size_t          k;
+    size_t          c;
+    size_t          sum;
+    unsigned        runs;
+    double          start;
+    double          elapsed;
+    double          ratio;
+    double          mbps;
+
+    for (i = 0; i < sizeof(a); i++)
+    {
+        a[i] = b[i] = (uint8_t)bench_random();
+    }
+
+    printf("\nMatch-length kernels (ns per call, by match length)\n");
+    printf("%-8s", "kernel");
+    for (i = 0; i < ARRAY_ENTRIES(lengths); i++)
+    {
+        printf(" %7zu", lengths[i]);
+    }
+    printf("\n");
+    for (k = LZS_MATCH_KERNEL_BYTE; k < NUM_LZS_MATCH_KERNELS; k++)
+    {
+        if (!lzs_match_kernel_select((LzsMatchKernel_t)k))
+        {
+            continue;
+        }
+        printf("%-8s", kernelNames[k]);
+        for (i = 0; i < ARRAY_ENTRIES(lengths); i++)
+        {
+            b[lengths[i]] ^= 0x55u;
+            sum = 0;
+            runs = 0;
+            start = bench_now();
+            do
+            {
+                for (c = 0; c < 1000u; c++)
+                {
+                    sum += lzs_match_len_func(a, b, lengths[i] + 1u);
+                }
+                runs += 1000u;
+                elapsed = bench_now() - start;
+            } while (elapsed < benchSeconds / 4);
+            b[lengths[i]] ^= 0x55u;
+            if (sum != (size_t)runs * lengths[i])
+            {
+                printf("  WRONG");
+            }
+            else
+            {
+                printf(" %7.2f", elapsed * 1e9 / runs);
+            }
+        }
+        printf("\n");
+    }
+
+    printf("\nCompressor throughput by match-length kernel\n");
+    for (c = 0; c < ARRAY_ENTRIES(compressors); c++)
+    {
+        for (i = 0; i < corpusCount; i++)
+        {
+            for (k = LZS_MATCH_KERNEL_BYTE; k < NUM_LZS_MATCH_KERNELS; k++)
+            {
+                if (!lzs_match_kernel_select((LzsMatchKernel_t)k))
+                {
+                    continue;
+                }
+                mbps = bench_compressor(&compressors[c], &corpus[i], &ratio);
+                bench_print_row(compressors[c].name, kernelNames[k], corpus[i].name, ratio, mbps);
+            }
+        }
+    }
+    lzs_match_kernel_select(LZS_MATCH_KERNEL_AUTO);
+}
+
+/*
+ * Compression levels: ratio and throughput of each level, single-call and incremental.
+ */
+static void bench_levels(void)
+{
+    static const BenchCompressor_t levelCompressors[] =
+    {
+        { "lzs_compress_level",                 bench_compress_level,               0 },
+        { "lzs_compress_incremental",           bench_compress_incremental,         0 },
+    };
+    char        variant[16];
+    double      ratio;
+    double      mbps;
+    size_t      c;
+    size_t      i;
+
+    for (c = 0; c < ARRAY_ENTRIES(levelCompressors); c++)
+    {
+        for (i = 0; i < corpusCount; i++)
+        {
+            for (benchLevel = LZS_COMPRESS_LEVEL_FASTEST; benchLevel <= LZS_COMPRESS_LEVEL_MAX; benchLevel++)
+            {
+                snprintf(variant, sizeof(variant), "level %u", benchLevel);
+                mbps = bench_compressor(&levelCompressors[c], &corpus[i], &ratio);
+                bench_print_row(levelCompressors[c].name, variant, corpus[i].name, ratio, mbps);
+            }
+        }
+    }
+    benchLevel = LZS_COMPRESS_LEVEL_DEFAULT;
+}
+
+/*
+ * Incremental compression with input in chunks of various sizes. Large chunks
+ * are read in place, rather than copied into the history buffer.
+ */
+static void bench_chunks(void)
+{
+    static const BenchCompressor_t incrementalCompressor = { "lzs_compress_incremental", bench_compress_incremental, 0 };
+    static const size_t chunkSizes[] = { 256u, INCREMENTAL_INPUT_SIZE, 64u * 1024u, CORPUS_SIZE };
+    char        variant[16];
+    double      ratio;
+    double      mbps;
+    size_t      c;
+    size_t      i;
+
+    for (c = 0; c < ARRAY_ENTRIES(chunkSizes); c++)
+    {
+        benchChunkSize = chunkSizes[c];
+        snprintf(variant, sizeof(variant), "%zu", benchChunkSize);
+        for (i = 0; i < corpusCount; i++)
+        {
+            mbps = bench_compressor(&incrementalCompressor, &corpus[i], &ratio);
+            bench_print_row(incrementalCompressor.name, variant, corpus[i].name, ratio, mbps);
+        }
+    }
+    benchChunkSize = INCREMENTAL_INPUT_SIZE;
+}
+
+/*
+ * Per-call work budget: the cost of stopping and resuming incremental
+ * compression every so many units of work, with the input in one chunk.
+ */
+static void bench_budget(void)
+{
+    static const BenchCompressor_t incrementalCompressor = { "lzs_compress_incremental", bench_compress_incremental, 0 };
+    static const size_t workBudgets[] = { 0u, 64u * 1024u, 4096u, 256u };
+    char        variant[16];
+    double      ratio;
+    double      mbps;
+    size_t      c;
+    size_t      i;
+
+    benchChunkSize = CORPUS_SIZE;
+    for (c = 0; c < ARRAY_ENTRIES(workBudgets); c++)
+    {
+        benchWorkBudget = workBudgets[c];
+        snprintf(variant, sizeof(variant), "%zu", benchWorkBudget);
+        for (i = 0; i < corpusCount; i++)
+        {
+            mbps = bench_compressor(&incrementalCompressor, &corpus[i], &ratio);
+            bench_print_row(incrementalCompressor.name, variant, corpus[i].name, ratio, mbps);
+        }
+    }
+    benchWorkBudget = 0;
+    benchChunkSize = INCREMENTAL_INPUT_SIZE;
+}
+
+/*
+ * Incremental compression contexts: the size in bytes of each context type,
+ * with the ratio and throughput it gives, at the default level for the one
+ * with hash chains.
+ */
+static void bench_contexts(void)
+{
+    static const struct
+    {
+        BenchCompressor_t   compressor;
+        size_t              size;
+    } contexts[] =
+    {
+        { { "lzs_compress_incremental",         bench_compress_incremental,         0 },                   sizeof(LzsCompressParameters_t) },
+        { { "lzs_compact_compress_incremental", bench_compact_compress_incremental, 0 },                   sizeof(LzsCompactCompressParameters_t) },
+        { { "lzs_lite_compress_incremental",    bench_lite_compress_incremental,    0 },                   sizeof(LzsLiteCompressParameters_t) },
+        { { "lzs_simple_compress_incremental",  bench_simple_compress_incremental,  SIMPLE_CORPUS_SIZE },  sizeof(LzsSimpleCompressParameters_t) },
+    };
+    char        variant[16];
+    double      ratio;
+    double      mbps;
+    size_t      c;
+    size_t      i;
+
+    for (c = 0; c < ARRAY_ENTRIES(contexts); c++)
+    {
+        snprintf(variant, sizeof(variant), "%zu B", contexts[c].size);
+        for (i = 0; i < corpusCount; i++)
+        {
+            mbps = bench_compressor(&contexts[c].compressor, &corpus[i], &ratio);
+            bench_print_row(contexts[c].compressor.name, variant, corpus[i].name, ratio, mbps);
+        }
+    }
+}
+
+/*
+ * Lazy matching: greedy, lazy and two-step lazy parsing with otherwise equal search parameters.
+ */
+static void bench_lazy(void)
+{
+    static const BenchCompressor_t configCompressor = { "lzs_compress_config", bench_compress_config, 0 };
+    static const struct
+    {
+        const char        * name;
+        uint8_t             lazyLength;
+        uint8_t             lazySteps;
+    } modes[] =
+    {
+        { "greedy",     0,      1u },
+        { "lazy",       13u,    1u },
+        { "lazy2",      13u,    2u },
+    };
+    double      ratio;
+    double      mbps;
+    size_t      i;
+    size_t      m;
+
+    for (i = 0; i < corpusCount; i++)
+    {
+        for (m = 0; m < ARRAY_ENTRIES(modes); m++)
+        {
+            lzs_compress_level_config(&benchConfig, LZS_COMPRESS_LEVEL_BEST);
+            benchConfig.lazyLength = modes[m].lazyLength;
+            benchConfig.lazySteps = modes[m].lazySteps;
+            mbps = bench_compressor(&configCompressor, &corpus[i], &ratio);
+            bench_print_row(configCompressor.name, modes[m].name, corpus[i].name, ratio, mbps);
+        }
+    }
+}
+
+/*
+ * Incompressible-data detection: searching every position, and searching only
+ * some positions after a run of literals, at the default level.
+ */
+static void bench_probe(void)
+{
+    static const BenchCompressor_t configCompressor = { "lzs_compress_config", bench_compress_config, 0 };
+    static const uint8_t incompressibleRuns[] = { 0, 64u };
+    char        variant[16];
+    double      ratio;
+    double      mbps;
+    size_t      i;
+    size_t      m;
+
+    for (i = 0; i < corpusCount; i++)
+    {
+        for (m = 0; m < ARRAY_ENTRIES(incompressibleRuns); m++)
+        {
+            lzs_compress_level_config(&benchConfig, LZS_COMPRESS_LEVEL_DEFAULT);
+            benchConfig.incompressibleRun = incompressibleRuns[m];
+            snprintf(variant, sizeof(variant), "%u", (unsigned)incompressibleRuns[m]);
+            mbps = bench_compressor(&configCompressor, &corpus[i], &ratio);
+            bench_print_row(configCompressor.name, variant, corpus[i].name, ratio, mbps);
+        }
+    }
+}
+
+/*
+ * Hash functions: each hash type and table size, at a fast, a medium and the default level.
+ */
+static void bench_hash(void)
+{
+    static const BenchCompressor_t wsCompressor = { "lzs_compress_config_ws", bench_compress_config_ws, 0 };
+    static const char * const hashNames[NUM_LZS_HASH_TYPES] = { "legacy", "2byte", "3byte", "4byte" };
+    static const unsigned int levels[] = { LZS_COMPRESS_LEVEL_FASTEST, 3u, LZS_COMPRESS_LEVEL_DEFAULT };
+    static const uint8_t hashBits[] = { INPUT_HASH_BITS, LZS_HASH_BITS_MAX };
+    char        variant[16];
+    double      ratio;
+    double      mbps;
+    size_t      i;
+    size_t      l;
+    size_t      t;
+    size_t      b;
+
+    for (i = 0; i < corpusCount; i++)
+    {
+        for (l = 0; l < ARRAY_ENTRIES(levels); l++)
+        {
+            for (t = 0; t < NUM_LZS_HASH_TYPES; t++)
+            {
+                for (b = 0; b < ARRAY_ENTRIES(hashBits); b++)
+                {
+                    lzs_compress_level_config(&benchConfig, levels[l]);
+                    benchConfig.hashType = t;
+                    benchConfig.hashBits = hashBits[b];
+                    snprintf(variant, sizeof(variant), "L%u %s/%u", levels[l], hashNames[t], hashBits[b]);
+                    mbps = bench_compressor(&wsCompressor, &corpus[i], &ratio);
+                    bench_print_row(wsCompressor.name, variant, corpus[i].name, ratio, mbps);
+                }
+            }
+        }
+    }
+}
+
+/*
+ * Match finders: hash chains and binary trees at the high levels, against the
+ * exhaustive search of lzs_simple_compress(), on the same length of input.
+ */
+static void bench_tree(void)
+{
+    static const BenchCompressor_t wsCompressor = { "lzs_compress_config_ws", bench_compress_config_ws, SIMPLE_CORPUS_SIZE };
+    static const BenchCompressor_t simpleCompressor = { "lzs_simple_compress", lzs_simple_compress, SIMPLE_CORPUS_SIZE };
+    static const char * const finderNames[NUM_LZS_MATCH_FINDERS] = { "chain", "tree" };
+    static const unsigned int levels[] = { 8u, LZS_COMPRESS_LEVEL_BEST, LZS_COMPRESS_LEVEL_MAX };
+    char        variant[16];
+    double      ratio;
+    double      mbps;
+    size_t      i;
+    size_t      l;
+    size_t      f;
+
+    for (i = 0; i < corpusCount; i++)
+    {
+        for (l = 0; l < ARRAY_ENTRIES(levels); l++)
+        {
+            for (f = 0; f < NUM_LZS_MATCH_FINDERS; f++)
+            {
+                lzs_compress_level_config(&benchConfig, levels[l]);
+                benchConfig.matchFinder = f;
+                snprintf(variant, sizeof(variant), "L%u %s", levels[l], finderNames[f]);
+                mbps = bench_compressor(&wsCompressor, &corpus[i], &ratio);
+                bench_print_row(wsCompressor.name, variant, corpus[i].name, ratio, mbps);
+            }
+        }
+        mbps = bench_compressor(&simpleCompressor, &corpus[i], &ratio);
+        bench_print_row(simpleCompressor.name, "", corpus[i].name, ratio, mbps);
+    }
+}
+
+/*
+ * Context reset: compress each PACKET_SIZE packet of the corpus as an independent
+ * stream, with single-call compression with the hash tables on the stack or in
+ * a reused workspace, and with an incremental context that is fully initialised
+ * or reset for each one. The "dict" mode also sets the start of the
+ * corpus as a preset dictionary for each packet, and the "prebuilt" mode
+ * attaches it with prebuilt hash tables.
+ */
+static void bench_reset(void)
+{
+    static const char * const modes[] = { "lzs_compress", "lzs_compress_ws", "init_full", "reset", "dict", "prebuilt" };
+    static LzsDictionary_t  dictionary;
+    LzsCompressConfig_t     config;
+    uint8_t     out[LZS_COMPRESSED_MAX(PACKET_SIZE)];
+    size_t      outLen;
+    size_t      pos;
+    size_t      len;
+    size_t      i;
+    size_t      m;
+    unsigned    runs;
+    double      start;
+    double      elapsed;
+
+    lzs_compress_level_config(&config, LZS_COMPRESS_LEVEL_DEFAULT);
+    for (i = 0; i < corpusCount; i++)
+    {
+        lzs_dictionary_init(&dictionary, corpus[i].data, LZSMIN(corpus[i].len, LZS_MAX_HISTORY_SIZE), &config);
+        for (m = 0; m < ARRAY_ENTRIES(modes); m++)
+        {
+            lzs_compress_init(&compressParams);
+            runs = 0;
+            outLen = 0;
+            start = bench_now();
+            do
+            {
+                for (pos = 0; pos < corpus[i].len; pos += len)
+                {
+                    len = LZSMIN(corpus[i].len - pos, PACKET_SIZE);
+                    if (m == 0)
+                    {
+                        outLen += lzs_compress(out, sizeof(out), corpus[i].data + pos, len);
+                        continue;
+                    }
+                    if (m == 1)
+                    {
+                        outLen += lzs_compress_ws(out, sizeof(out), corpus[i].data + pos, len, benchWorkspace);
+                        continue;
+                    }
+                    if (m == 2)
+                    {
+                        lzs_compress_init_full(&compressParams);
+                    }
+                    else
+                    {
+                        lzs_compress_reset(&compressParams);
+                    }
+                    if (m == 4)
+                    {
+                        lzs_compress_set_dictionary(&compressParams, corpus[i].data, LZSMIN(corpus[i].len, LZS_MAX_HISTORY_SIZE));
+                    }
+                    else if (m == 5)
+                    {
+                        lzs_compress_attach_dictionary(&compressParams, &dictionary);
+                    }
+                    compressParams.inPtr = corpus[i].data + pos;
+                    compressParams.inLength = len;
+                    compressParams.outPtr = out;
+                    compressParams.outLength = sizeof(out);
+                    do
+                    {
+                        outLen += lzs_compress_incremental(&compressParams, true);
+                    } while ((compressParams.status & LZS_C_STATUS_END_MARKER) == 0);
+                }
+                runs++;
+                elapsed = bench_now() - start;
+            } while (elapsed < benchSeconds);
+            bench_print_row("packets", modes[m], corpus[i].name,
+                            100.0 * (double)outLen / ((double)corpus[i].len * runs), (double)corpus[i].len * runs / elapsed / 1e6);
+        }
+    }
+}
+
+/*
+ * Batches of independent packets of various sizes: compression and
+ * decompression one packet per call, and the whole corpus in one batch call.
+ */
+static void bench_batch(void)
+{
+    static const size_t packetSizes[] = { 64u, 256u, PACKET_SIZE };
+    static const char * const modes[] = { "lzs_compress", "lzs_compress_batch", "lzs_decompress", "lzs_decompress_batch" };
+    LzsCompressConfig_t     config;
+    LzsConstBuffer_t      * pIn;
+    LzsBuffer_t           * pOut;
+    LzsConstBuffer_t      * pCompressed;
+    LzsBuffer_t           * pDecompressed;
+    uint8_t               * pOutData;
+    uint8_t               * pCheck;
+    char        variant[16];
+    size_t      packetSize;
+    size_t      outSize;
+    size_t      outLen;
+    size_t      count;
+    size_t      c;
+    size_t      i;
+    size_t      k;
+    size_t      m;
+    unsigned    runs;
+    double      start;
+    double      elapsed;
+
+    lzs_compress_level_config(&config, LZS_COMPRESS_LEVEL_DEFAULT);
+    for (c = 0; c < ARRAY_ENTRIES(packetSizes); c++)
+    {
+        packetSize = packetSizes[c];
+        outSize = LZS_COMPRESSED_MAX(packetSize);
+        snprintf(variant, sizeof(variant), "%zu", packetSize);
+        for (i = 0; i < corpusCount; i++)
+        {
+            count = (corpus[i].len + packetSize - 1u) / packetSize;
+            pIn = (LzsConstBuffer_t *)bench_malloc(count * sizeof(*pIn));
+            pOut = (LzsBuffer_t *)bench_malloc(count * sizeof(*pOut));
+            pCompressed = (LzsConstBuffer_t *)bench_malloc(count * sizeof(*pCompressed));
+            pDecompressed = (LzsBuffer_t *)bench_malloc(count * sizeof(*pDecompressed));
+            pOutData = bench_malloc(count * outSize);
+            pCheck = bench_malloc(corpus[i].len);
+            for (k = 0; k < count; k++)
+            {
+                pIn[k].ptr = corpus[i].data + k * packetSize;
+                pIn[k].len = LZSMIN(corpus[i].len - k * packetSize, packetSize);
+            }
+            for (m = 0; m < ARRAY_ENTRIES(modes); m++)
+            {
+                runs = 0;
+                outLen = 0;
+                start = bench_now();
+                do
+                {
+                    for (k = 0; k < count; k++)
+                    {
+                        pOut[k].ptr = pOutData + k * outSize;
+                        pOut[k].len = outSize;
+                        pDecompressed[k].ptr = pCheck + k * packetSize;
+                        pDecompressed[k].len = pIn[k].len;
+                    }
+                    switch (m)
+                    {
+                        case 0:
+                            for (k = 0; k < count; k++)
+                            {
+                                pOut[k].len = lzs_compress(pOut[k].ptr, pOut[k].len, pIn[k].ptr, pIn[k].len);
+                            }
+                            break;
+                        case 1:
+                            lzs_compress_batch(pOut, pIn, count, &config, benchWorkspace);
+                            break;
+                        case 2:
+                            for (k = 0; k < count; k++)
+                            {
+                                pDecompressed[k].len = lzs_decompress(pDecompressed[k].ptr, pDecompressed[k].len,
+                                                                      pCompressed[k].ptr, pCompressed[k].len);
+                            }
+                            break;
+                        default:
+                            lzs_decompress_batch(pDecompressed, pCompressed, count);
+                            break;
+                    }
+                    runs++;
+                    elapsed = bench_now() - start;
+                } while (elapsed < benchSeconds);
+
+                // Compressed packets are kept for the decompression modes.
+                for (k = 0; k < count; k++)
+                {
+                    if (m < 2)
+                    {
+                        pCompressed[k].ptr = pOut[k].ptr;
+                        pCompressed[k].len = pOut[k].len;
+                    }
+                    outLen += pCompressed[k].len;
+                }
+                if (m >= 2 && memcmp(pCheck, corpus[i].data, corpus[i].len) != 0)
+                {
+                    elapsed = -1.0;
+                }
+                bench_print_row(modes[m], variant, corpus[i].name, 100.0 * (double)outLen / (double)corpus[i].len,
+                                (elapsed < 0) ? -1.0 : (double)corpus[i].len * runs / elapsed / 1e6);
+            }
+            free(pIn);
+            free(pOut);
+            free(pCompressed);
+            free(pDecompressed);
+            free(pOutData);
+            free(pCheck);
+        }
+    }
+}
+
+/*
+ * Output bit writing: throughput of each compressor in input MB/s and in
+ * output tokens (literals and offset/length tokens) per second, and of the
+ * fastest level, which spends the largest share of its time writing tokens.
+ */
+static void bench_bits(void)
+{
+    static const BenchCompressor_t fastestCompressor = { "lzs_compress_level", bench_compress_level, 0 };
+    char        variant[16];
+    uint8_t   * pOut;
+    size_t      outLen;
+    size_t      inLen;
+    size_t      tokens;
+    size_t      c;
+    size_t      i;
+    double      ratio;
+    double      mbps;
+    const BenchCompressor_t * pCompressor;
+
+    for (c = 0; c <= ARRAY_ENTRIES(compressors); c++)
+    {
+        pCompressor = (c < ARRAY_ENTRIES(compressors)) ? &compressors[c] : &fastestCompressor;
+        benchLevel = (pCompressor == &fastestCompressor) ? LZS_COMPRESS_LEVEL_FASTEST : LZS_COMPRESS_LEVEL_DEFAULT;
+        snprintf(variant, sizeof(variant), (pCompressor == &fastestCompressor) ? "level %u" : "", benchLevel);
+        for (i = 0; i < corpusCount; i++)
+        {
+            inLen = corpus[i].len;
+            if (pCompressor->maxInput && inLen > pCompressor->maxInput)
+            {
+                inLen = pCompressor->maxInput;
+            }
+            pOut = bench_malloc(LZS_COMPRESSED_MAX(inLen));
+            outLen = pCompressor->func(pOut, LZS_COMPRESSED_MAX(inLen), corpus[i].data, inLen);
+            tokens = bench_count_tokens(pOut, outLen);
+            free(pOut);
+
+            mbps = bench_compressor(pCompressor, &corpus[i], &ratio);
+            if (mbps < 0)
+            {
+                bench_print_row(pCompressor->name, variant, corpus[i].name, ratio, mbps);
+                continue;
+            }
+            printf("%-34s %-8s %-10s %7.2f%% %9.2f MB/s %9.2f Mtokens/s\n", pCompressor->name, variant, corpus[i].name,
+                   ratio, mbps, inLen ? mbps * (double)tokens / (double)inLen : 0);
+        }
+    }
+    benchLevel = LZS_COMPRESS_LEVEL_DEFAULT;
+}
+
+/*
+ * Decompression: throughput in MB/s of decompressed data, for data compressed
+ * at the fastest level, which has the most literals and short matches, and at
+ * the default level.
+ */
+static void bench_decode(void)
+{
+    static const unsigned int levels[] = { LZS_COMPRESS_LEVEL_FASTEST, LZS_COMPRESS_LEVEL_DEFAULT };
+    static const BenchCompressor_t decompressors[] =
+    {
+        { "lzs_decompress",                     lzs_decompress,                     0 },
+        { "lzs_decompress_incremental",         bench_decompress_incremental,       0 },
+    };
+    char        variant[16];
+    uint8_t   * pCompressed;
+    uint8_t   * pCheck;
+    size_t      compressedLen;
+    size_t      checkLen;
+    size_t      c;
+    size_t      d;
+    size_t      i;
+    unsigned    runs;
+    double      start;
+    double      elapsed;
+
+    for (c = 0; c < ARRAY_ENTRIES(levels); c++)
+    {
+        snprintf(variant, sizeof(variant), "level %u", levels[c]);
+        for (i = 0; i < corpusCount; i++)
+        {
+            pCompressed = bench_malloc(LZS_COMPRESSED_MAX(corpus[i].len));
+            pCheck = bench_malloc(corpus[i].len);
+            compressedLen = lzs_compress_level(pCompressed, LZS_COMPRESSED_MAX(corpus[i].len),
+                                               corpus[i].data, corpus[i].len, levels[c]);
+            for (d = 0; d < ARRAY_ENTRIES(decompressors); d++)
+            {
+                runs = 0;
+                start = bench_now();
+                do
+                {
+                    checkLen = decompressors[d].func(pCheck, corpus[i].len, pCompressed, compressedLen);
+                    runs++;
+                    elapsed = bench_now() - start;
+                } while (elapsed < benchSeconds);
+
+                if (checkLen != corpus[i].len || memcmp(pCheck, corpus[i].data, corpus[i].len) != 0)
+                {
+                    elapsed = -1.0;
+                }
+                bench_print_row(decompressors[d].name, variant, corpus[i].name,
+                                100.0 * (double)compressedLen / (double)corpus[i].len,
+                                (elapsed < 0) ? -1.0 : (double)corpus[i].len * runs / elapsed / 1e6);
+            }
+            free(pCompressed);
+            free(pCheck);
+        }
+    }
+}
+
+static const BenchSection_t sections[] =
+{
+    { "kernels",    bench_kernels },
+    { "levels",     bench_levels },
+    { "chunks",     bench_chunks },
+    { "contexts",   bench_contexts },
+    { "budget",     bench_budget },
+    { "lazy",       bench_lazy },
+    { "probe",      bench_probe },
+    { "hash",       bench_hash },
+    { "tree",       bench_tree },
+    { "reset",      bench_reset },
+    { "batch",      bench_batch },
+    { "bits",       bench_bits },
+    { "decode",     bench_decode },
+};
+
+
+/*****************************************************************************
+ * Functions
+ ****************************************************************************/
+
+int main(int argc, char **argv)
+{
+    const char    * sectionName = NULL;
+    size_t          i;
+    int             opt;
+
+    while ((opt = getopt(argc, argv, "s:t:")) != -1)
+    {
+        switch (opt)
+        {
+            case 's':
+                sectionName = optarg;
+                break;
+            case 't':
+                benchSeconds = atof(optarg);
+                break;
+            default:
+                printf("Usage: %s [-s section] [-t seconds] [file ...]\n", argv[0]);
+                exit(1);
+        }
+    }
+
+    if (optind < argc)
+    {
+        for ( ; optind < argc; optind++)
+        {
+            corpus_load_file(argv[optind]);
+        }
+    }
+    else
+    {
+        corpus_make_text();
+        corpus_make_log();
+        corpus_make_json();
+        corpus_make_binary();
+        corpus_make_zeros();
+        corpus_make_random();
+    }
+
+    for (i = 0; i < ARRAY_ENTRIES(sections); i++)
+    {
+        if (sectionName == NULL || strcmp(sectionName, sections[i].name) == 0)
+        {
+            printf("== %s ==\n", sections[i].name);
+            sections[i].func();
+        }
+    }
+
+    return 0;
+}